@@ -100,6 +100,32 @@ SRes SzAr_DecodeFolder(const CSzAr *p, UInt32 folderIndex,
     Byte *outBuffer, size_t outSize,
     ISzAllocPtr allocMain);
 
+/*
+  CSzFolderStream decodes folder sequentially to small buffers.
+  LZMA and LZMA2 decoders use window of dictionary size (or folder size, if it's smaller).
+
+  SzFolderStream_Read returns next block of unpacked data in (*data, *size).
+    (*size) on input is max size of block.
+    Returned data is valid until next call of SzFolderStream_Read.
+    (*size == 0) is returned only at the end of folder.
+    It returns SZ_ERROR_CRC at the end of folder, if folder CRC is defined and wrong.
+
+  Call SzFolderStream_SetInStream before SzFolderStream_Read,
+  if (stream) was used for another reading after previous SzFolderStream_Read call.
+*/
+
+typedef struct CSzFolderStream_ CSzFolderStream;
+
+SRes SzAr_OpenFolderStream(const CSzAr *p, UInt32 folderIndex,
+    ILookInStream *stream, UInt64 startPos,
+    CSzFolderStream **folderStream,
+    ISzAllocPtr alloc);
+
+SRes SzFolderStream_Read(CSzFolderStream *p, const Byte **data, size_t *size);
+void SzFolderStream_SetInStream(CSzFolderStream *p, ILookInStream *stream);
+UInt64 SzFolderStream_GetPos(const CSzFolderStream *p);
+void SzFolderStream_Free(CSzFolderStream *p, ISzAllocPtr alloc);
+
 typedef struct
 {
   CSzAr db;
@@ -183,6 +209,120 @@ SRes SzArEx_Extract(
     ISzAllocPtr allocTemp);
 
 
+/*
+  CSzFolderCache is cache of several decoded solid blocks with LRU replacement.
+  (maxSize) is the limit for total size of cached blocks. If block is larger than
+  (maxSize), the cache keeps only that block.
+
+  SzArEx_ExtractCached extracts file from archive and returns pointer to file data in cache.
+  (*data) is valid until next call of SzArEx_ExtractCached or SzFolderCache_Free.
+  Call SzFolderCache_Init() before first call and SzFolderCache_Free() after last call.
+*/
+
+#define SZ_FOLDER_CACHE_ITEMS_MAX 32
+
+typedef struct
+{
+  UInt32 folderIndex;
+  Byte *buf;
+  size_t size;
+  UInt64 lastUse;
+} CSzFolderCacheItem;
+
+typedef struct
+{
+  size_t maxSize;
+  size_t totalSize;
+  UInt64 useCounter;
+  unsigned numItems;
+  CSzFolderCacheItem items[SZ_FOLDER_CACHE_ITEMS_MAX];
+} CSzFolderCache;
+
+void SzFolderCache_Init(CSzFolderCache *p, size_t maxSize);
+void SzFolderCache_Free(CSzFolderCache *p, ISzAllocPtr allocMain);
+
+SRes SzArEx_ExtractCached(
+    const CSzArEx *db,
+    ILookInStream *inStream,
+    UInt32 fileIndex,
+    CSzFolderCache *cache,
+    const Byte **data,
+    size_t *size,
+    ISzAllocPtr allocMain,
+    ISzAllocPtr allocTemp);
+
+
+/*
+  SzArEx_ExtractToStream extracts file from archive to outStream.
+  It doesn't allocate the buffer for whole solid block, so memory usage
+  is about dictionary size instead of solid block size.
+
+  Extracting cache:
+    (cache) can be NULL.
+    If (cache) is not NULL, it keeps the decoder of solid block between calls.
+    If you extract the files of solid block in archive order, the block is decoded only once.
+    Call SzFolderStreamCache_Init() before first call and
+    SzFolderStreamCache_Free() after last call.
+*/
+
+typedef struct
+{
+  UInt32 folderIndex;
+  CSzFolderStream *stream;
+} CSzFolderStreamCache;
+
+#define SzFolderStreamCache_Init(p) { (p)->folderIndex = (UInt32)(Int32)-1; (p)->stream = NULL; }
+void SzFolderStreamCache_Free(CSzFolderStreamCache *p, ISzAllocPtr alloc);
+
+SRes SzArEx_ExtractToStream(
+    const CSzArEx *db,
+    ILookInStream *inStream,
+    UInt32 fileIndex,
+    CSzFolderStreamCache *cache,
+    ISeqOutStream *outStream,
+    ISzAllocPtr alloc);
+
+
+/*
+  SzArEx_ExtractAllMt extracts all files from archive.
+  It decodes different solid blocks (folders) in parallel, using up to (numThreads) threads.
+  The caller's thread is one of the working threads.
+  Each thread uses its own stream inStreams[i] and allocator allocTemps[i]
+  for i in [0 ... numThreads - 1]. These streams must be opened for the same archive file.
+  Each thread allocates (with allocMain) one buffer for whole solid block,
+  so memory usage is about (numThreads * maxSolidBlockSize).
+
+  ISzFileSink::Write() is called once for each file in archive:
+    - for files without data stream (empty files and directories) it's called
+      first from caller's thread with (data == NULL) and (size == 0).
+    - for other files it's called from working threads after CRC check.
+      The calls are serialized, so the sink doesn't need locks.
+      The order of files is in archive order inside one solid block,
+      but solid blocks can be reported in any order.
+  If Write() returns error, the extraction is stopped and that error is returned.
+  If some thread can't be created, the function continues with fewer threads.
+  If _7ZIP_ST is defined, the function works in one thread with inStreams[0].
+*/
+
+#define SZ_EXTRACT_MT_THREADS_MAX 64
+
+typedef struct ISzFileSink ISzFileSink;
+struct ISzFileSink
+{
+  SRes (*Write)(const ISzFileSink *p, UInt32 fileIndex, const Byte *data, size_t size);
+};
+
+#define ISzFileSink_Write(p, fileIndex, data, size) (p)->Write(p, fileIndex, data, size)
+
+SRes SzArEx_ExtractAllMt(
+    const CSzArEx *db,
+    unsigned numThreads,
+    ILookInStream * const *inStreams,
+    const ISzAllocPtr *allocTemps,
+    const ISzFileSink *sink,
+    ISzAllocPtr allocMain);
+
+
 /*
 SzArEx_Open Errors:
 SZ_ERROR_NO_ARCHIVE
@@ -78,3 +78,84 @@ void SzFreeTemp(ISzAllocPtr p, void *address)
   #endif
   free(address);
 }
+
+
+/* each block starts with pointer to previous block, aligned for (UInt64) and SSE data */
+
+#define ARENA_ALIGN 16
+#define ARENA_HEADER_SIZE ARENA_ALIGN
+#define ARENA_ALIGN_SIZE(size) (((size) + (ARENA_ALIGN - 1)) & ~(size_t)(ARENA_ALIGN - 1))
+
+static void *SzAllocArena_AddBlock(CSzAllocArena *p, size_t size)
+{
+  Byte *block = (Byte *)ISzAlloc_Alloc(p->baseAlloc, ARENA_HEADER_SIZE + size);
+  if (!block)
+    return NULL;
+  *(void **)(void *)block = p->blocks;
+  p->blocks = block;
+  return block + ARENA_HEADER_SIZE;
+}
+
+static void *SzAllocArena_Alloc(ISzAllocPtr pp, size_t size)
+{
+  CSzAllocArena *p = CONTAINER_FROM_VTBL(pp, CSzAllocArena, vt);
+  Byte *res;
+  if (size == 0)
+    return NULL;
+  if (size > ((size_t)0 - ARENA_HEADER_SIZE - ARENA_ALIGN))
+    return NULL;
+  size = ARENA_ALIGN_SIZE(size);
+  
+  if (size <= (size_t)(p->lim - p->pos))
+  {
+    res = p->pos;
+    p->pos += size;
+    return res;
+  }
+
+  if (size > (p->blockSize >> 2))
+  {
+    /* big array gets its own block, and the tail of current block is still available */
+    return SzAllocArena_AddBlock(p, size);
+  }
+
+  res = (Byte *)SzAllocArena_AddBlock(p, p->blockSize);
+  if (!res)
+    return NULL;
+  p->pos = res + size;
+  p->lim = res + p->blockSize;
+  return res;
+}
+
+static void SzAllocArena_FreeItem(ISzAllocPtr pp, void *address)
+{
+  UNUSED_VAR(pp);
+  UNUSED_VAR(address);
+}
+
+void SzAllocArena_Init(CSzAllocArena *p, ISzAllocPtr baseAlloc, size_t blockSize)
+{
+  p->vt.Alloc = SzAllocArena_Alloc;
+  p->vt.Free = SzAllocArena_FreeItem;
+  p->baseAlloc = baseAlloc;
+  p->blocks = NULL;
+  p->pos = NULL;
+  p->lim = NULL;
+  if (blockSize == 0)
+    blockSize = SZ_ALLOC_ARENA_BLOCK_SIZE_DEFAULT;
+  p->blockSize = ARENA_ALIGN_SIZE(blockSize);
+}
+
+void SzAllocArena_Free(CSzAllocArena *p)
+{
+  void *block = p->blocks;
+  while (block)
+  {
+    void *prev = *(void **)block;
+    ISzAlloc_Free(p->baseAlloc, block);
+    block = prev;
+  }
+  p->blocks = NULL;
+  p->pos = NULL;
+  p->lim = NULL;
+}
@@ -14,6 +14,35 @@ void SzFree(ISzAllocPtr p, void *address);
 void *SzAllocTemp(ISzAllocPtr p, size_t size);
 void SzFreeTemp(ISzAllocPtr p, void *address);
 
+/*
+  CSzAllocArena : bump allocator for objects that are freed all together,
+  like the arrays of CSzArEx. It gets big blocks from (baseAlloc).
+  ISzAlloc_Free() for arena does nothing.
+  SzAllocArena_Free() releases all memory.
+
+  Usage:
+    SzAllocArena_Init(&arena, &g_Alloc, 0);
+    SzArEx_Open(&db, inStream, &arena.vt, allocTemp);
+    ...
+    SzArEx_Free(&db, &arena.vt);
+    SzAllocArena_Free(&arena);
+*/
+
+#define SZ_ALLOC_ARENA_BLOCK_SIZE_DEFAULT ((size_t)1 << 16)
+
+typedef struct
+{
+  ISzAlloc vt;
+  ISzAllocPtr baseAlloc;
+  void *blocks;
+  Byte *pos;
+  Byte *lim;
+  size_t blockSize;
+} CSzAllocArena;
+
+void SzAllocArena_Init(CSzAllocArena *p, ISzAllocPtr baseAlloc, size_t blockSize);
+void SzAllocArena_Free(CSzAllocArena *p);
+
 EXTERN_C_END
 
 #endif
@@ -1709,6 +1709,218 @@ SRes SzArEx_Extract(
 }
 
 
+void SzFolderCache_Init(CSzFolderCache *p, size_t maxSize)
+{
+  p->maxSize = maxSize;
+  p->totalSize = 0;
+  p->useCounter = 0;
+  p->numItems = 0;
+}
+
+static void SzFolderCache_Remove(CSzFolderCache *p, unsigned index, ISzAllocPtr allocMain)
+{
+  CSzFolderCacheItem *item = &p->items[index];
+  ISzAlloc_Free(allocMain, item->buf);
+  p->totalSize -= item->size;
+  *item = p->items[--p->numItems];
+}
+
+static void SzFolderCache_RemoveLru(CSzFolderCache *p, ISzAllocPtr allocMain)
+{
+  unsigned i, lru = 0;
+  for (i = 1; i < p->numItems; i++)
+    if (p->items[i].lastUse < p->items[lru].lastUse)
+      lru = i;
+  SzFolderCache_Remove(p, lru, allocMain);
+}
+
+void SzFolderCache_Free(CSzFolderCache *p, ISzAllocPtr allocMain)
+{
+  while (p->numItems != 0)
+    SzFolderCache_Remove(p, p->numItems - 1, allocMain);
+  p->useCounter = 0;
+}
+
+
+SRes SzArEx_ExtractCached(
+    const CSzArEx *p,
+    ILookInStream *inStream,
+    UInt32 fileIndex,
+    CSzFolderCache *cache,
+    const Byte **data,
+    size_t *size,
+    ISzAllocPtr allocMain,
+    ISzAllocPtr allocTemp)
+{
+  UInt32 folderIndex = p->FileToFolder[fileIndex];
+  CSzFolderCacheItem *item = NULL;
+  size_t offset;
+  unsigned i;
+
+  *data = NULL;
+  *size = 0;
+
+  if (folderIndex == (UInt32)-1)
+    return SZ_OK;
+
+  for (i = 0; i < cache->numItems; i++)
+    if (cache->items[i].folderIndex == folderIndex)
+    {
+      item = &cache->items[i];
+      break;
+    }
+
+  if (!item)
+  {
+    UInt64 unpackSizeSpec = SzAr_GetFolderUnpackSize(&p->db, folderIndex);
+    size_t unpackSize = (size_t)unpackSizeSpec;
+    Byte *buf = NULL;
+    SRes res;
+    
+    if (unpackSize != unpackSizeSpec)
+      return SZ_ERROR_MEM;
+
+    /* we free old blocks before allocation of new block to reduce peak memory usage */
+    while (cache->numItems != 0
+        && (cache->numItems == SZ_FOLDER_CACHE_ITEMS_MAX
+          || cache->totalSize > cache->maxSize
+          || unpackSize > cache->maxSize - cache->totalSize))
+      SzFolderCache_RemoveLru(cache, allocMain);
+
+    if (unpackSize != 0)
+    {
+      buf = (Byte *)ISzAlloc_Alloc(allocMain, unpackSize);
+      if (!buf)
+        return SZ_ERROR_MEM;
+    }
+    
+    res = SzAr_DecodeFolder(&p->db, folderIndex,
+        inStream, p->dataPos, buf, unpackSize, allocTemp);
+    if (res != SZ_OK)
+    {
+      ISzAlloc_Free(allocMain, buf);
+      return res;
+    }
+
+    item = &cache->items[cache->numItems++];
+    item->folderIndex = folderIndex;
+    item->buf = buf;
+    item->size = unpackSize;
+    cache->totalSize += unpackSize;
+  }
+
+  item->lastUse = ++cache->useCounter;
+
+  {
+    UInt64 unpackPos = p->UnpackPositions[fileIndex];
+    offset = (size_t)(unpackPos - p->UnpackPositions[p->FolderToFile[folderIndex]]);
+    *size = (size_t)(p->UnpackPositions[(size_t)fileIndex + 1] - unpackPos);
+    if (offset + *size > item->size)
+      return SZ_ERROR_FAIL;
+    *data = item->buf + offset;
+    if (SzBitWithVals_Check(&p->CRCs, fileIndex))
+      if (CrcCalc(*data, *size) != p->CRCs.Vals[fileIndex])
+        return SZ_ERROR_CRC;
+  }
+
+  return SZ_OK;
+}
+
+
+void SzFolderStreamCache_Free(CSzFolderStreamCache *p, ISzAllocPtr alloc)
+{
+  SzFolderStream_Free(p->stream, alloc);
+  SzFolderStreamCache_Init(p);
+}
+
+
+SRes SzArEx_ExtractToStream(
+    const CSzArEx *p,
+    ILookInStream *inStream,
+    UInt32 fileIndex,
+    CSzFolderStreamCache *cache,
+    ISeqOutStream *outStream,
+    ISzAllocPtr alloc)
+{
+  UInt32 folderIndex = p->FileToFolder[fileIndex];
+  CSzFolderStreamCache tempCache;
+  UInt64 skip, rem;
+  UInt32 crc = CRC_INIT_VAL;
+  SRes res = SZ_OK;
+
+  if (folderIndex == (UInt32)-1)
+    return SZ_OK;
+
+  if (!cache)
+  {
+    SzFolderStreamCache_Init(&tempCache);
+    cache = &tempCache;
+  }
+
+  skip = p->UnpackPositions[fileIndex] - p->UnpackPositions[p->FolderToFile[folderIndex]];
+  rem = SzArEx_GetFileSize(p, fileIndex);
+
+  if (cache->stream)
+  {
+    if (cache->folderIndex != folderIndex || SzFolderStream_GetPos(cache->stream) > skip)
+      SzFolderStreamCache_Free(cache, alloc);
+    else
+      SzFolderStream_SetInStream(cache->stream, inStream);
+  }
+  
+  if (!cache->stream)
+  {
+    res = SzAr_OpenFolderStream(&p->db, folderIndex, inStream, p->dataPos, &cache->stream, alloc);
+    cache->folderIndex = folderIndex;
+  }
+
+  if (res == SZ_OK)
+  {
+    skip -= SzFolderStream_GetPos(cache->stream);
+    
+    while (skip != 0 || rem != 0)
+    {
+      const Byte *data;
+      UInt64 cur = (skip != 0 ? skip : rem);
+      size_t size = (size_t)0 - 1;
+      if (size > cur)
+        size = (size_t)cur;
+      res = SzFolderStream_Read(cache->stream, &data, &size);
+      if (res != SZ_OK)
+        break;
+      if (size == 0)
+      {
+        res = SZ_ERROR_FAIL;
+        break;
+      }
+      if (skip != 0)
+        skip -= size;
+      else
+      {
+        crc = CrcUpdate(crc, data, size);
+        if (ISeqOutStream_Write(outStream, data, size) != size)
+        {
+          res = SZ_ERROR_WRITE;
+          break;
+        }
+        rem -= size;
+      }
+    }
+  }
+
+  if (res == SZ_OK)
+    if (SzBitWithVals_Check(&p->CRCs, fileIndex))
+      if (CRC_GET_DIGEST(crc) != p->CRCs.Vals[fileIndex])
+        res = SZ_ERROR_CRC;
+
+  if (res != SZ_OK || cache == &tempCache
+      || SzFolderStream_GetPos(cache->stream) == SzAr_GetFolderUnpackSize(&p->db, folderIndex))
+    SzFolderStreamCache_Free(cache, alloc);
+
+  return res;
+}
+
+
 size_t SzArEx_GetFileNameUtf16(const CSzArEx *p, size_t fileIndex, UInt16 *dest)
 {
   size_t offs = p->FileNameOffsets[fileIndex];
@@ -0,0 +1,269 @@
+/* 7zArcMt.c -- 7z multithreaded extraction
+Public domain */
+
+#include "Precomp.h"
+
+#include "7z.h"
+#include "7zCrc.h"
+
+#ifndef _7ZIP_ST
+#include "Threads.h"
+#endif
+
+struct CSzExtractMt_;
+
+typedef struct
+{
+  struct CSzExtractMt_ *mt;
+  ILookInStream *inStream;
+  ISzAllocPtr allocTemp;
+  Byte *buf;
+  size_t bufSize;
+  #ifndef _7ZIP_ST
+  CThread thread;
+  #endif
+} CSzExtractMtThread;
+
+typedef struct CSzExtractMt_
+{
+  const CSzArEx *db;
+  const ISzFileSink *sink;
+  ISzAllocPtr allocMain;
+  UInt32 nextFolder;
+  SRes res;
+  #ifndef _7ZIP_ST
+  CCriticalSection cs;
+  #endif
+  CSzExtractMtThread threads[SZ_EXTRACT_MT_THREADS_MAX];
+} CSzExtractMt;
+
+#ifndef _7ZIP_ST
+  #define MT_LOCK(p)    CriticalSection_Enter(&(p)->cs);
+  #define MT_UNLOCK(p)  CriticalSection_Leave(&(p)->cs);
+#else
+  #define MT_LOCK(p)
+  #define MT_UNLOCK(p)
+#endif
+
+
+static void SzExtractMt_SetError(CSzExtractMt *p, SRes res)
+{
+  MT_LOCK(p)
+  if (p->res == SZ_OK)
+    p->res = res;
+  MT_UNLOCK(p)
+}
+
+
+static SRes SzExtractMt_DecodeFolder(CSzExtractMtThread *t, UInt32 folderIndex)
+{
+  CSzExtractMt *p = t->mt;
+  const CSzArEx *db = p->db;
+  UInt32 fileIndex = db->FolderToFile[folderIndex];
+  UInt32 fileLim = db->FolderToFile[(size_t)folderIndex + 1];
+  UInt64 startPos;
+  UInt64 unpackSizeSpec;
+  size_t unpackSize;
+  SRes res = SZ_OK;
+
+  if (fileIndex == fileLim)
+    return SZ_OK;
+
+  unpackSizeSpec = SzAr_GetFolderUnpackSize(&db->db, folderIndex);
+  unpackSize = (size_t)unpackSizeSpec;
+  if (unpackSize != unpackSizeSpec)
+    return SZ_ERROR_MEM;
+
+  if (t->bufSize < unpackSize)
+  {
+    ISzAlloc_Free(p->allocMain, t->buf);
+    t->bufSize = 0;
+    t->buf = (Byte *)ISzAlloc_Alloc(p->allocMain, unpackSize);
+    if (!t->buf)
+      return SZ_ERROR_MEM;
+    t->bufSize = unpackSize;
+  }
+
+  RINOK(SzAr_DecodeFolder(&db->db, folderIndex,
+      t->inStream, db->dataPos, t->buf, unpackSize, t->allocTemp));
+
+  startPos = db->UnpackPositions[fileIndex];
+
+  /* we check CRCs of all files before any call of sink for that folder */
+  for (; fileIndex < fileLim; fileIndex++)
+  {
+    size_t offset, size;
+    if (db->FileToFolder[fileIndex] != folderIndex)
+      continue;
+    offset = (size_t)(db->UnpackPositions[fileIndex] - startPos);
+    size = (size_t)SzArEx_GetFileSize(db, fileIndex);
+    if (offset + size > unpackSize || offset + size < offset)
+      return SZ_ERROR_FAIL;
+    if (SzBitWithVals_Check(&db->CRCs, fileIndex))
+      if (CrcCalc(t->buf + offset, size) != db->CRCs.Vals[fileIndex])
+        return SZ_ERROR_CRC;
+  }
+
+  MT_LOCK(p)
+  if (p->res != SZ_OK)
+    res = p->res;
+  for (fileIndex = db->FolderToFile[folderIndex]; fileIndex < fileLim && res == SZ_OK; fileIndex++)
+  {
+    if (db->FileToFolder[fileIndex] != folderIndex)
+      continue;
+    res = ISzFileSink_Write(p->sink, fileIndex,
+        t->buf + (size_t)(db->UnpackPositions[fileIndex] - startPos),
+        (size_t)SzArEx_GetFileSize(db, fileIndex));
+  }
+  MT_UNLOCK(p)
+
+  return res;
+}
+
+
+static void SzExtractMt_ThreadLoop(CSzExtractMtThread *t)
+{
+  CSzExtractMt *p = t->mt;
+  for (;;)
+  {
+    UInt32 folderIndex;
+    SRes res;
+
+    MT_LOCK(p)
+    folderIndex = p->nextFolder;
+    if (p->res == SZ_OK && folderIndex < p->db->db.NumFolders)
+      p->nextFolder++;
+    else
+      folderIndex = (UInt32)(Int32)-1;
+    MT_UNLOCK(p)
+
+    if (folderIndex == (UInt32)(Int32)-1)
+      break;
+
+    res = SzExtractMt_DecodeFolder(t, folderIndex);
+    if (res != SZ_OK)
+    {
+      SzExtractMt_SetError(p, res);
+      break;
+    }
+  }
+
+  /* the buffer is not required anymore, so we free it here to reduce peak memory usage */
+  ISzAlloc_Free(p->allocMain, t->buf);
+  t->buf = NULL;
+  t->bufSize = 0;
+}
+
+
+#ifndef _7ZIP_ST
+
+static THREAD_FUNC_DECL SzExtractMt_ThreadFunc(void *pp)
+{
+  SzExtractMt_ThreadLoop((CSzExtractMtThread *)pp);
+  return 0;
+}
+
+#endif
+
+
+SRes SzArEx_ExtractAllMt(
+    const CSzArEx *db,
+    unsigned numThreads,
+    ILookInStream * const *inStreams,
+    const ISzAllocPtr *allocTemps,
+    const ISzFileSink *sink,
+    ISzAllocPtr allocMain)
+{
+  CSzExtractMt *p;
+  UInt32 i;
+  SRes res;
+
+  /* files without data stream (empty files and directories) */
+  for (i = 0; i < db->NumFiles; i++)
+    if (db->FileToFolder[i] == (UInt32)(Int32)-1)
+    {
+      RINOK(ISzFileSink_Write(sink, i, NULL, 0));
+    }
+
+  if (db->db.NumFolders == 0)
+    return SZ_OK;
+
+  #ifdef _7ZIP_ST
+  numThreads = 1;
+  #endif
+
+  if (numThreads > SZ_EXTRACT_MT_THREADS_MAX)
+    numThreads = SZ_EXTRACT_MT_THREADS_MAX;
+  if (numThreads > db->db.NumFolders)
+    numThreads = (unsigned)db->db.NumFolders;
+  if (numThreads == 0)
+    numThreads = 1;
+
+  p = (CSzExtractMt *)ISzAlloc_Alloc(allocMain, sizeof(CSzExtractMt));
+  if (!p)
+    return SZ_ERROR_MEM;
+
+  p->db = db;
+  p->sink = sink;
+  p->allocMain = allocMain;
+  p->nextFolder = 0;
+  p->res = SZ_OK;
+
+  for (i = 0; i < numThreads; i++)
+  {
+    CSzExtractMtThread *t = &p->threads[i];
+    t->mt = p;
+    t->inStream = inStreams[i];
+    t->allocTemp = allocTemps[i];
+    t->buf = NULL;
+    t->bufSize = 0;
+    #ifndef _7ZIP_ST
+    Thread_Construct(&t->thread);
+    #endif
+  }
+
+  #ifndef _7ZIP_ST
+
+  if (CriticalSection_Init(&p->cs) != 0)
+  {
+    ISzAlloc_Free(allocMain, p);
+    return SZ_ERROR_THREAD;
+  }
+
+  /* threads[0] works in the caller's thread.
+     If we can't create new thread, we continue with threads that were created already,
+     so in worst case all folders are decoded in the caller's thread. */
+  for (i = 1; i < numThreads; i++)
+  {
+    CSzExtractMtThread *t = &p->threads[i];
+    if (Thread_Create(&t->thread, SzExtractMt_ThreadFunc, t) != 0)
+    {
+      Thread_Construct(&t->thread);
+      break;
+    }
+  }
+
+  #endif
+
+  SzExtractMt_ThreadLoop(&p->threads[0]);
+
+  #ifndef _7ZIP_ST
+
+  for (i = 1; i < numThreads; i++)
+  {
+    CSzExtractMtThread *t = &p->threads[i];
+    if (Thread_WasCreated(&t->thread))
+    {
+      Thread_Wait(&t->thread);
+      Thread_Close(&t->thread);
+    }
+  }
+
+  CriticalSection_Delete(&p->cs);
+
+  #endif
+
+  res = p->res;
+  ISzAlloc_Free(allocMain, p);
+  return res;
+}
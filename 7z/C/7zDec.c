@@ -589,3 +589,781 @@ SRes SzAr_DecodeFolder(const CSzAr *p, UInt32 folderIndex,
     return res;
   }
 }
+
+
+
+/* ---------- Folder stream decoding ---------- */
+
+/*
+  CSzFolderStream decodes folder to bounded buffers instead of one buffer of folder size.
+  LZMA and LZMA2 decoders use cyclic dictionary buffer of (dictionary size) bytes
+  (or (unpack size) bytes, if it's smaller). Other coders and filters use small buffers.
+  BCJ2 folder reads 4 pack streams in parallel, so each coder stream remembers
+  its own position in (inStream), and we seek the stream, when another coder reads it.
+*/
+
+#define SZ_STREAM_BUF_SIZE (1 << 16)
+#define SZ_STREAM_LOOK_SIZE (1 << 18)
+
+#define SZ_NUM_CODER_STREAMS 4
+
+typedef struct CSzCoderStream_ CSzCoderStream;
+
+#ifdef _7ZIP_PPMD_SUPPPORT
+
+typedef struct
+{
+  IByteIn vt;
+  const Byte *cur;
+  const Byte *end;
+  const Byte *begin;
+  Bool extra;
+  SRes res;
+  CSzCoderStream *coder;
+} CByteInToCoder;
+
+#endif
+
+struct CSzCoderStream_
+{
+  UInt32 methodID;
+  CSzFolderStream *folder;
+  UInt64 inPos;   /* absolute position of next byte in pack stream */
+  UInt64 inRem;   /* remaining size of pack stream */
+  UInt64 outRem;  /* remaining unpack size */
+  Byte *buf;
+  size_t bufSize;
+  CLzma2Dec lzma2; /* (lzma2.decoder) is used for LZMA */
+  #ifdef _7ZIP_PPMD_SUPPPORT
+  Bool ppmdAllocated;
+  Bool ppmdStarted;
+  CPpmd7 ppmd;
+  CPpmd7z_RangeDec rc;
+  CByteInToCoder byteIn;
+  #endif
+};
+
+struct CSzFolderStream_
+{
+  ILookInStream *inStream;
+  const CSzCoderStream *inOwner;
+  UInt64 pos;
+  UInt64 size;
+  UInt32 crc;
+  Bool crcDefined;
+  UInt32 crcExpected;
+
+  unsigned numCoderStreams;
+  CSzCoderStream coders[SZ_NUM_CODER_STREAMS];
+
+  UInt32 filterID;
+  unsigned deltaDist;
+  UInt32 x86State;
+  UInt32 filterIp;
+  size_t filterPos;
+  size_t filterConv;
+  size_t filterLim;
+  Byte *filterBuf;
+  Byte deltaState[DELTA_STATE_SIZE];
+
+  Bool isBcj2;
+  CBcj2Dec bcj2;
+  const Byte *bcj2Pend[BCJ2_NUM_STREAMS];
+  size_t bcj2PendSize[BCJ2_NUM_STREAMS];
+  unsigned bcj2ExtraSize[BCJ2_NUM_STREAMS];
+  Byte bcj2Extra[BCJ2_NUM_STREAMS][4];
+};
+
+
+static SRes SzCoderStream_Look(CSzCoderStream *p, const void **buf, size_t *size)
+{
+  CSzFolderStream *f = p->folder;
+  if (f->inOwner != p)
+  {
+    RINOK(LookInStream_SeekTo(f->inStream, p->inPos));
+    f->inOwner = p;
+  }
+  if (*size > p->inRem)
+    *size = (size_t)p->inRem;
+  return ILookInStream_Look(f->inStream, buf, size);
+}
+
+static SRes SzCoderStream_Skip(CSzCoderStream *p, size_t size)
+{
+  p->inPos += size;
+  p->inRem -= size;
+  return ILookInStream_Skip(p->folder->inStream, size);
+}
+
+
+#ifdef _7ZIP_PPMD_SUPPPORT
+
+static Byte ReadByte_Coder(const IByteIn *pp)
+{
+  CByteInToCoder *p = CONTAINER_FROM_VTBL(pp, CByteInToCoder, vt);
+  if (p->cur != p->end)
+    return *p->cur++;
+  if (p->res == SZ_OK)
+  {
+    size_t size = p->cur - p->begin;
+    p->begin = p->cur = p->end = NULL;
+    p->res = SzCoderStream_Skip(p->coder, size);
+    if (p->res == SZ_OK)
+    {
+      size = SZ_STREAM_LOOK_SIZE;
+      p->res = SzCoderStream_Look(p->coder, (const void **)&p->begin, &size);
+      if (p->res == SZ_OK)
+      {
+        p->cur = p->begin;
+        p->end = p->begin + size;
+        if (size != 0)
+          return *p->cur++;
+      }
+    }
+  }
+  p->extra = True;
+  return 0;
+}
+
+/* it skips the bytes that were read by range decoder,
+   so other coder streams can use (inStream) */
+
+static SRes ByteInToCoder_Release(CByteInToCoder *p)
+{
+  size_t size = p->cur - p->begin;
+  p->begin = p->cur = p->end = NULL;
+  if (p->res == SZ_OK)
+    p->res = SzCoderStream_Skip(p->coder, size);
+  return p->res;
+}
+
+static SRes SzCoderStream_ReadPpmd(CSzCoderStream *p, size_t size)
+{
+  CByteInToCoder *s = &p->byteIn;
+  size_t i;
+  SRes res = SZ_OK;
+  
+  if (!p->ppmdStarted)
+  {
+    p->ppmdStarted = True;
+    if (!Ppmd7z_RangeDec_Init(&p->rc))
+      res = SZ_ERROR_DATA;
+    else if (s->extra)
+      res = (s->res != SZ_OK ? s->res : SZ_ERROR_DATA);
+  }
+  
+  if (res == SZ_OK)
+  {
+    for (i = 0; i < size; i++)
+    {
+      int sym = Ppmd7_DecodeSymbol(&p->ppmd, &p->rc.vt);
+      if (s->extra || sym < 0)
+        break;
+      p->buf[i] = (Byte)sym;
+    }
+    if (i != size)
+      res = (s->res != SZ_OK ? s->res : SZ_ERROR_DATA);
+  }
+  
+  {
+    SRes res2 = ByteInToCoder_Release(s);
+    if (res == SZ_OK)
+      res = res2;
+  }
+  
+  if (res == SZ_OK && p->outRem == size)
+    if (p->inRem != 0 || !Ppmd7z_RangeDec_IsFinishedOK(&p->rc))
+      res = SZ_ERROR_DATA;
+  return res;
+}
+
+#endif
+
+
+static SRes SzCoderStream_ReadLzma(CSzCoderStream *p, const Byte **data, size_t *size)
+{
+  CLzmaDec *dec = &p->lzma2.decoder;
+  SizeT start, limit;
+  Bool isLast;
+
+  if (dec->dicPos == dec->dicBufSize)
+    dec->dicPos = 0;
+  start = dec->dicPos;
+  limit = dec->dicBufSize - start;
+  if (limit > *size)
+    limit = *size;
+  isLast = (limit == p->outRem);
+  limit += start;
+
+  for (;;)
+  {
+    const void *inBuf = NULL;
+    size_t lookahead = SZ_STREAM_LOOK_SIZE;
+    SizeT inProcessed, dicPos = dec->dicPos;
+    ELzmaFinishMode finishMode = (isLast ? LZMA_FINISH_END : LZMA_FINISH_ANY);
+    ELzmaStatus status;
+    SRes res;
+
+    RINOK(SzCoderStream_Look(p, &inBuf, &lookahead));
+    inProcessed = (SizeT)lookahead;
+    
+    #ifndef _7Z_NO_METHOD_LZMA2
+    if (p->methodID == k_LZMA2)
+      res = Lzma2Dec_DecodeToDic(&p->lzma2, limit, (const Byte *)inBuf, &inProcessed, finishMode, &status);
+    else
+    #endif
+      res = LzmaDec_DecodeToDic(dec, limit, (const Byte *)inBuf, &inProcessed, finishMode, &status);
+    
+    RINOK(res);
+    RINOK(SzCoderStream_Skip(p, inProcessed));
+
+    if (status == LZMA_STATUS_FINISHED_WITH_MARK)
+    {
+      if (dec->dicPos != limit || !isLast || p->inRem != 0)
+        return SZ_ERROR_DATA;
+      break;
+    }
+
+    if (dec->dicPos == limit)
+    {
+      if (!isLast)
+        break;
+      /* LZMA2 stream must contain end marker. LZMA stream can be finished without marker */
+      if (p->methodID == k_LZMA && p->inRem == 0 && status == LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK)
+        break;
+    }
+
+    if (inProcessed == 0 && dicPos == dec->dicPos)
+      return SZ_ERROR_DATA;
+  }
+
+  *data = dec->dic + start;
+  *size = dec->dicPos - start;
+  return SZ_OK;
+}
+
+
+/*
+  SzCoderStream_Read returns next decoded block in (*data, *size).
+  (*size) on input is max size of block.
+  Returned data is valid until next call of SzCoderStream_Read for same coder stream.
+  It returns (*size == 0) only at the end of coder stream.
+*/
+
+static SRes SzCoderStream_Read(CSzCoderStream *p, const Byte **data, size_t *size)
+{
+  size_t rem = *size;
+  *size = 0;
+  if (rem > p->outRem)
+    rem = (size_t)p->outRem;
+  if (rem == 0)
+    return SZ_OK;
+
+  if (p->methodID == k_Copy)
+  {
+    const void *inBuf;
+    if (rem > p->bufSize)
+      rem = p->bufSize;
+    RINOK(SzCoderStream_Look(p, &inBuf, &rem));
+    if (rem == 0)
+      return SZ_ERROR_INPUT_EOF;
+    memcpy(p->buf, inBuf, rem);
+    RINOK(SzCoderStream_Skip(p, rem));
+    *data = p->buf;
+  }
+  #ifdef _7ZIP_PPMD_SUPPPORT
+  else if (p->methodID == k_PPMD)
+  {
+    if (rem > p->bufSize)
+      rem = p->bufSize;
+    RINOK(SzCoderStream_ReadPpmd(p, rem));
+    *data = p->buf;
+  }
+  #endif
+  else
+  {
+    RINOK(SzCoderStream_ReadLzma(p, data, &rem));
+  }
+
+  p->outRem -= rem;
+  *size = rem;
+  return SZ_OK;
+}
+
+
+static void SzCoderStream_Free(CSzCoderStream *p, ISzAllocPtr alloc)
+{
+  Lzma2Dec_FreeProbs(&p->lzma2, alloc);
+  #ifdef _7ZIP_PPMD_SUPPPORT
+  if (p->ppmdAllocated)
+    Ppmd7_Free(&p->ppmd, alloc);
+  p->ppmdAllocated = False;
+  #endif
+  ISzAlloc_Free(alloc, p->buf);
+  p->buf = NULL;
+}
+
+
+static SRes SzCoderStream_Alloc(CSzCoderStream *p, size_t size, ISzAllocPtr alloc)
+{
+  if (size == 0)
+    size = 1;
+  p->bufSize = size;
+  p->buf = (Byte *)ISzAlloc_Alloc(alloc, size);
+  return p->buf ? SZ_OK : SZ_ERROR_MEM;
+}
+
+
+static SRes SzCoderStream_Create(CSzCoderStream *p, const CSzCoderInfo *coder, const Byte *propsData,
+    UInt64 packPos, UInt64 packSize, UInt64 unpackSize, ISzAllocPtr alloc)
+{
+  const Byte *props = propsData + coder->PropsOffset;
+  unsigned propsSize = coder->PropsSize;
+  UInt32 dicSize;
+
+  p->methodID = (UInt32)coder->MethodID;
+  p->inPos = packPos;
+  p->inRem = packSize;
+  p->outRem = unpackSize;
+
+  if (p->methodID == k_Copy)
+  {
+    if (packSize != unpackSize)
+      return SZ_ERROR_DATA;
+    return SzCoderStream_Alloc(p, SZ_STREAM_BUF_SIZE, alloc);
+  }
+
+  #ifdef _7ZIP_PPMD_SUPPPORT
+  if (p->methodID == k_PPMD)
+  {
+    unsigned order;
+    UInt32 memSize;
+    if (propsSize != 5)
+      return SZ_ERROR_UNSUPPORTED;
+    order = props[0];
+    memSize = GetUi32(props + 1);
+    if (order < PPMD7_MIN_ORDER ||
+        order > PPMD7_MAX_ORDER ||
+        memSize < PPMD7_MIN_MEM_SIZE ||
+        memSize > PPMD7_MAX_MEM_SIZE)
+      return SZ_ERROR_UNSUPPORTED;
+    if (!Ppmd7_Alloc(&p->ppmd, memSize, alloc))
+      return SZ_ERROR_MEM;
+    p->ppmdAllocated = True;
+    Ppmd7_Init(&p->ppmd, order);
+    p->byteIn.vt.Read = ReadByte_Coder;
+    p->byteIn.begin = p->byteIn.end = p->byteIn.cur = NULL;
+    p->byteIn.extra = False;
+    p->byteIn.res = SZ_OK;
+    p->byteIn.coder = p;
+    Ppmd7z_RangeDec_CreateVTable(&p->rc);
+    p->rc.Stream = &p->byteIn.vt;
+    return SzCoderStream_Alloc(p, SZ_STREAM_BUF_SIZE, alloc);
+  }
+  #endif
+  
+  #ifndef _7Z_NO_METHOD_LZMA2
+  if (p->methodID == k_LZMA2)
+  {
+    unsigned prop;
+    if (propsSize != 1)
+      return SZ_ERROR_DATA;
+    prop = props[0];
+    if (prop > 40)
+      return SZ_ERROR_UNSUPPORTED;
+    dicSize = (prop == 40) ? 0xFFFFFFFF : (((UInt32)2 | (prop & 1)) << (prop / 2 + 11));
+    RINOK(Lzma2Dec_AllocateProbs(&p->lzma2, (Byte)prop, alloc));
+  }
+  else
+  #endif
+  if (p->methodID == k_LZMA)
+  {
+    CLzmaProps lzmaProps;
+    RINOK(LzmaProps_Decode(&lzmaProps, props, propsSize));
+    dicSize = lzmaProps.dicSize;
+    RINOK(LzmaDec_AllocateProbs(&p->lzma2.decoder, props, propsSize, alloc));
+  }
+  else
+    return SZ_ERROR_UNSUPPORTED;
+
+  {
+    UInt64 dicBufSize = dicSize;
+    if (dicBufSize > unpackSize)
+      dicBufSize = unpackSize;
+    if ((size_t)dicBufSize != dicBufSize)
+      return SZ_ERROR_MEM;
+    RINOK(SzCoderStream_Alloc(p, (size_t)dicBufSize, alloc));
+  }
+  
+  p->lzma2.decoder.dic = p->buf;
+  p->lzma2.decoder.dicBufSize = p->bufSize;
+  #ifndef _7Z_NO_METHOD_LZMA2
+  if (p->methodID == k_LZMA2)
+    Lzma2Dec_Init(&p->lzma2);
+  else
+  #endif
+    LzmaDec_Init(&p->lzma2.decoder);
+  return SZ_OK;
+}
+
+
+#ifndef _7Z_NO_METHODS_FILTERS
+
+#define CASE_BRA_CONV_STREAM(isa) case k_ ## isa: processed = isa ## _Convert(buf, size, p->filterIp, 0); break;
+
+static SRes SzFolderStream_ReadFilter(CSzFolderStream *p, const Byte **data, size_t *size)
+{
+  if (p->filterPos == p->filterConv)
+  {
+    CSzCoderStream *coder = &p->coders[0];
+    size_t rem = p->filterLim - p->filterConv;
+    memmove(p->filterBuf, p->filterBuf + p->filterConv, rem);
+    p->filterPos = p->filterConv = 0;
+    p->filterLim = rem;
+    
+    while (p->filterLim != SZ_STREAM_BUF_SIZE && coder->outRem != 0)
+    {
+      const Byte *src;
+      size_t cur = SZ_STREAM_BUF_SIZE - p->filterLim;
+      RINOK(SzCoderStream_Read(coder, &src, &cur));
+      memcpy(p->filterBuf + p->filterLim, src, cur);
+      p->filterLim += cur;
+    }
+    
+    {
+      Byte *buf = p->filterBuf;
+      SizeT size = p->filterLim;
+      SizeT processed = size;
+      switch (p->filterID)
+      {
+        case k_Delta:
+          Delta_Decode(p->deltaState, p->deltaDist, buf, size);
+          break;
+        case k_BCJ:
+          processed = x86_Convert(buf, size, p->filterIp, &p->x86State, 0);
+          break;
+        CASE_BRA_CONV_STREAM(PPC)
+        CASE_BRA_CONV_STREAM(IA64)
+        CASE_BRA_CONV_STREAM(SPARC)
+        CASE_BRA_CONV_STREAM(ARM)
+        CASE_BRA_CONV_STREAM(ARMT)
+        default:
+          return SZ_ERROR_UNSUPPORTED;
+      }
+      /* the filter doesn't convert last bytes of stream */
+      if (coder->outRem == 0)
+        processed = size;
+      p->filterIp += (UInt32)processed;
+      p->filterConv = processed;
+    }
+  }
+  
+  {
+    size_t rem = p->filterConv - p->filterPos;
+    if (*size > rem)
+      *size = rem;
+    *data = p->filterBuf + p->filterPos;
+    p->filterPos += *size;
+  }
+  return SZ_OK;
+}
+
+#endif
+
+
+/* BCJ2 requires (BUF_SIZE % 4 == 0) for CALL and JUMP streams,
+   so we join split 32-bit values in (bcj2Extra) buffer */
+
+static SRes SzFolderStream_FeedBcj2(CSzFolderStream *p, unsigned s)
+{
+  CSzCoderStream *coder = &p->coders[s];
+  
+  if (!BCJ2_IS_32BIT_STREAM(s))
+  {
+    const Byte *data;
+    size_t size = (size_t)0 - 1;
+    RINOK(SzCoderStream_Read(coder, &data, &size));
+    if (size == 0)
+      return SZ_ERROR_DATA;
+    p->bcj2.bufs[s] = data;
+    p->bcj2.lims[s] = data + size;
+    return SZ_OK;
+  }
+
+  for (;;)
+  {
+    if (p->bcj2PendSize[s] == 0)
+    {
+      size_t size = (size_t)0 - 1;
+      RINOK(SzCoderStream_Read(coder, &p->bcj2Pend[s], &size));
+      if (size == 0)
+        return SZ_ERROR_DATA;
+      p->bcj2PendSize[s] = size;
+    }
+    
+    if (p->bcj2ExtraSize[s] == 0 && p->bcj2PendSize[s] >= 4)
+    {
+      size_t size = p->bcj2PendSize[s] & ~(size_t)3;
+      p->bcj2.bufs[s] = p->bcj2Pend[s];
+      p->bcj2.lims[s] = p->bcj2Pend[s] + size;
+      p->bcj2Pend[s] += size;
+      p->bcj2PendSize[s] -= size;
+      return SZ_OK;
+    }
+    
+    while (p->bcj2ExtraSize[s] != 4 && p->bcj2PendSize[s] != 0)
+    {
+      p->bcj2Extra[s][p->bcj2ExtraSize[s]++] = *p->bcj2Pend[s]++;
+      p->bcj2PendSize[s]--;
+    }
+    
+    if (p->bcj2ExtraSize[s] == 4)
+    {
+      p->bcj2ExtraSize[s] = 0;
+      p->bcj2.bufs[s] = p->bcj2Extra[s];
+      p->bcj2.lims[s] = p->bcj2Extra[s] + 4;
+      return SZ_OK;
+    }
+  }
+}
+
+
+static SRes SzFolderStream_ReadBcj2(CSzFolderStream *p, const Byte **data, size_t *size)
+{
+  if (*size > SZ_STREAM_BUF_SIZE)
+    *size = SZ_STREAM_BUF_SIZE;
+  p->bcj2.dest = p->filterBuf;
+  p->bcj2.destLim = p->filterBuf + *size;
+  
+  while (p->bcj2.dest != p->bcj2.destLim)
+  {
+    if (Bcj2Dec_Decode(&p->bcj2) != SZ_OK)
+      return SZ_ERROR_DATA;
+    if (p->bcj2.dest == p->bcj2.destLim)
+      break;
+    if (p->bcj2.state >= BCJ2_NUM_STREAMS)
+      return SZ_ERROR_DATA;
+    RINOK(SzFolderStream_FeedBcj2(p, p->bcj2.state));
+  }
+
+  if (p->pos + *size == p->size)
+  {
+    unsigned i;
+    /* decoder reads last byte of RC stream only if it's available in buffer */
+    if (p->bcj2.bufs[BCJ2_STREAM_RC] == p->bcj2.lims[BCJ2_STREAM_RC]
+        && p->coders[BCJ2_STREAM_RC].outRem != 0)
+    {
+      RINOK(SzFolderStream_FeedBcj2(p, BCJ2_STREAM_RC));
+      if (Bcj2Dec_Decode(&p->bcj2) != SZ_OK)
+        return SZ_ERROR_DATA;
+    }
+    for (i = 0; i < BCJ2_NUM_STREAMS; i++)
+      if (p->bcj2.bufs[i] != p->bcj2.lims[i]
+          || p->coders[i].outRem != 0
+          || p->bcj2PendSize[i] != 0
+          || p->bcj2ExtraSize[i] != 0)
+        return SZ_ERROR_DATA;
+    if (!Bcj2Dec_IsFinished(&p->bcj2))
+      return SZ_ERROR_DATA;
+  }
+  
+  *data = p->filterBuf;
+  return SZ_OK;
+}
+
+
+void SzFolderStream_Free(CSzFolderStream *p, ISzAllocPtr alloc)
+{
+  unsigned i;
+  if (!p)
+    return;
+  for (i = 0; i < SZ_NUM_CODER_STREAMS; i++)
+    SzCoderStream_Free(&p->coders[i], alloc);
+  ISzAlloc_Free(alloc, p->filterBuf);
+  ISzAlloc_Free(alloc, p);
+}
+
+
+static SRes SzFolderStream_Create(CSzFolderStream *p, const CSzFolder *folder,
+    const Byte *propsData,
+    const UInt64 *unpackSizes,
+    const UInt64 *packPositions,
+    UInt64 startPos, ISzAllocPtr alloc)
+{
+  RINOK(CheckSupportedFolder(folder));
+
+  if (folder->NumCoders == 4)
+  {
+    /* (coders[]) are indexed by BCJ2 stream: MAIN, CALL, JUMP, RC */
+    unsigned ci;
+    for (ci = 0; ci < 3; ci++)
+    {
+      static const Byte packIndices[] = { 3, 2, 0 };
+      unsigned si = packIndices[ci];
+      RINOK(SzCoderStream_Create(&p->coders[BCJ2_STREAM_JUMP - ci], &folder->Coders[ci], propsData,
+          startPos + packPositions[si], packPositions[(size_t)si + 1] - packPositions[si],
+          unpackSizes[ci], alloc));
+    }
+    {
+      CSzCoderInfo copyCoder;
+      copyCoder.PropsOffset = 0;
+      copyCoder.MethodID = k_Copy;
+      copyCoder.NumStreams = 1;
+      copyCoder.PropsSize = 0;
+      RINOK(SzCoderStream_Create(&p->coders[BCJ2_STREAM_RC], &copyCoder, propsData,
+          startPos + packPositions[1], packPositions[2] - packPositions[1],
+          packPositions[2] - packPositions[1], alloc));
+    }
+    if ((unpackSizes[1] & 3) != 0 ||
+        (unpackSizes[0] & 3) != 0 ||
+        unpackSizes[0] + unpackSizes[1] + unpackSizes[2] != p->size)
+      return SZ_ERROR_DATA;
+    p->numCoderStreams = 4;
+    p->isBcj2 = True;
+    Bcj2Dec_Init(&p->bcj2);
+  }
+  else
+  {
+    RINOK(SzCoderStream_Create(&p->coders[0], &folder->Coders[0], propsData,
+        startPos + packPositions[0], packPositions[1] - packPositions[0], p->size, alloc));
+    p->numCoderStreams = 1;
+    
+    #ifndef _7Z_NO_METHODS_FILTERS
+    if (folder->NumCoders == 2)
+    {
+      const CSzCoderInfo *coder = &folder->Coders[1];
+      p->filterID = (UInt32)coder->MethodID;
+      if (p->filterID == k_Delta)
+      {
+        if (coder->PropsSize != 1)
+          return SZ_ERROR_UNSUPPORTED;
+        p->deltaDist = (unsigned)propsData[coder->PropsOffset] + 1;
+        Delta_Init(p->deltaState);
+      }
+      else if (coder->PropsSize != 0)
+        return SZ_ERROR_UNSUPPORTED;
+      x86_Convert_Init(p->x86State);
+    }
+    #endif
+  }
+
+  if (p->isBcj2 || p->filterID != 0)
+  {
+    p->filterBuf = (Byte *)ISzAlloc_Alloc(alloc, SZ_STREAM_BUF_SIZE);
+    if (!p->filterBuf)
+      return SZ_ERROR_MEM;
+  }
+  return SZ_OK;
+}
+
+
+SRes SzAr_OpenFolderStream(const CSzAr *p, UInt32 folderIndex,
+    ILookInStream *inStream, UInt64 startPos,
+    CSzFolderStream **stream, ISzAllocPtr alloc)
+{
+  SRes res;
+  CSzFolder folder;
+  CSzData sd;
+  CSzFolderStream *s;
+  
+  const Byte *data = p->CodersData + p->FoCodersOffsets[folderIndex];
+  sd.Data = data;
+  sd.Size = p->FoCodersOffsets[(size_t)folderIndex + 1] - p->FoCodersOffsets[folderIndex];
+
+  *stream = NULL;
+  
+  RINOK(SzGetNextFolderItem(&folder, &sd));
+  
+  if (sd.Size != 0
+      || folder.UnpackStream != p->FoToMainUnpackSizeIndex[folderIndex])
+    return SZ_ERROR_FAIL;
+
+  s = (CSzFolderStream *)ISzAlloc_Alloc(alloc, sizeof(CSzFolderStream));
+  if (!s)
+    return SZ_ERROR_MEM;
+  memset(s, 0, sizeof(*s));
+  {
+    unsigned i;
+    for (i = 0; i < SZ_NUM_CODER_STREAMS; i++)
+    {
+      s->coders[i].folder = s;
+      Lzma2Dec_Construct(&s->coders[i].lzma2);
+      #ifdef _7ZIP_PPMD_SUPPPORT
+      Ppmd7_Construct(&s->coders[i].ppmd);
+      #endif
+    }
+  }
+  
+  s->inStream = inStream;
+  s->size = SzAr_GetFolderUnpackSize(p, folderIndex);
+  s->crc = CRC_INIT_VAL;
+  s->crcDefined = SzBitWithVals_Check(&p->FolderCRCs, folderIndex);
+  if (s->crcDefined)
+    s->crcExpected = p->FolderCRCs.Vals[folderIndex];
+  
+  res = SzFolderStream_Create(s, &folder, data,
+      &p->CoderUnpackSizes[p->FoToCoderUnpackSizes[folderIndex]],
+      p->PackPositions + p->FoStartPackStreamIndex[folderIndex],
+      startPos, alloc);
+
+  if (res != SZ_OK)
+  {
+    SzFolderStream_Free(s, alloc);
+    return res;
+  }
+  *stream = s;
+  return SZ_OK;
+}
+
+
+void SzFolderStream_SetInStream(CSzFolderStream *p, ILookInStream *inStream)
+{
+  p->inStream = inStream;
+  p->inOwner = NULL;
+}
+
+
+UInt64 SzFolderStream_GetPos(const CSzFolderStream *p)
+{
+  return p->pos;
+}
+
+
+SRes SzFolderStream_Read(CSzFolderStream *p, const Byte **data, size_t *size)
+{
+  size_t rem = *size;
+  *size = 0;
+  if (rem > p->size - p->pos)
+    rem = (size_t)(p->size - p->pos);
+  if (rem == 0)
+    return SZ_OK;
+  
+  if (p->isBcj2)
+  {
+    RINOK(SzFolderStream_ReadBcj2(p, data, &rem));
+  }
+  #ifndef _7Z_NO_METHODS_FILTERS
+  else if (p->filterID != 0)
+  {
+    RINOK(SzFolderStream_ReadFilter(p, data, &rem));
+  }
+  #endif
+  else
+  {
+    RINOK(SzCoderStream_Read(&p->coders[0], data, &rem));
+  }
+  
+  if (rem == 0)
+    return SZ_ERROR_DATA;
+  
+  p->pos += rem;
+  *size = rem;
+  
+  if (p->crcDefined)
+  {
+    p->crc = CrcUpdate(p->crc, *data, rem);
+    if (p->pos == p->size && CRC_GET_DIGEST(p->crc) != p->crcExpected)
+      return SZ_ERROR_CRC;
+  }
+  return SZ_OK;
+}
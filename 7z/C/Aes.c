@@ -31,6 +31,7 @@ void MY_FAST_CALL AesCtr_Code(UInt32 *ivAes, Byte *data, size_t numBlocks);
 
 void MY_FAST_CALL AesCbc_Encode_Intel(UInt32 *ivAes, Byte *data, size_t numBlocks);
 void MY_FAST_CALL AesCbc_Decode_Intel(UInt32 *ivAes, Byte *data, size_t numBlocks);
+void MY_FAST_CALL AesCbc_Decode_Intel_V256(UInt32 *ivAes, Byte *data, size_t numBlocks);
 void MY_FAST_CALL AesCtr_Code_Intel(UInt32 *ivAes, Byte *data, size_t numBlocks);
 
 AES_CODE_FUNC g_AesCbc_Encode;
@@ -100,6 +101,8 @@ void AesGenTables(void)
     g_AesCbc_Encode = AesCbc_Encode_Intel;
     g_AesCbc_Decode = AesCbc_Decode_Intel;
     g_AesCtr_Code = AesCtr_Code_Intel;
+    if (CPU_Is_VAES_Supported())
+      g_AesCbc_Decode = AesCbc_Decode_Intel_V256;
   }
   #endif
 }
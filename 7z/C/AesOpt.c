@@ -6,15 +6,48 @@
 #include "CpuArch.h"
 
 #ifdef MY_CPU_X86_OR_AMD64
-#if (_MSC_VER > 1500) || (_MSC_FULL_VER >= 150030729)
-#define USE_INTEL_AES
+  #if defined(__clang__)
+    #if (__clang_major__ >= 4)
+      #define USE_INTEL_AES
+      #define ATTRIB_AES __attribute__((__target__("aes")))
+      #if (__clang_major__ >= 8)
+        #define USE_INTEL_VAES
+        #define ATTRIB_VAES __attribute__((__target__("aes,vaes,avx2")))
+      #endif
+    #endif
+  #elif defined(__GNUC__)
+    #if (__GNUC__ >= 5)
+      #define USE_INTEL_AES
+      #define ATTRIB_AES __attribute__((__target__("aes")))
+      #if (__GNUC__ >= 8)
+        #define USE_INTEL_VAES
+        #define ATTRIB_VAES __attribute__((__target__("aes,vaes,avx2")))
+      #endif
+    #endif
+  #elif (_MSC_VER > 1500) || (_MSC_FULL_VER >= 150030729)
+    #define USE_INTEL_AES
+    #if (_MSC_VER >= 1920)
+      #define USE_INTEL_VAES
+    #endif
+  #endif
 #endif
+
+#ifndef ATTRIB_AES
+#define ATTRIB_AES
+#endif
+#ifndef ATTRIB_VAES
+#define ATTRIB_VAES
 #endif
 
 #ifdef USE_INTEL_AES
 
 #include <wmmintrin.h>
 
+void MY_FAST_CALL AesCbc_Encode_Intel(__m128i *p, __m128i *data, size_t numBlocks);
+void MY_FAST_CALL AesCbc_Decode_Intel(__m128i *p, __m128i *data, size_t numBlocks);
+void MY_FAST_CALL AesCtr_Code_Intel(__m128i *p, __m128i *data, size_t numBlocks);
+
+ATTRIB_AES
 void MY_FAST_CALL AesCbc_Encode_Intel(__m128i *p, __m128i *data, size_t numBlocks)
 {
   __m128i m = *p;
@@ -38,13 +71,21 @@ void MY_FAST_CALL AesCbc_Encode_Intel(__m128i *p, __m128i *data, size_t numBlock
   *p = m;
 }
 
-#define NUM_WAYS 3
+/* CBC decoding and CTR blocks are independent, so we interleave NUM_WAYS blocks
+   to hide the latency of aesdec / aesenc instructions */
+
+#define NUM_WAYS 8
 
 #define AES_OP_W(op, n) { \
     const __m128i t = w[n]; \
     m0 = op(m0, t); \
     m1 = op(m1, t); \
     m2 = op(m2, t); \
+    m3 = op(m3, t); \
+    m4 = op(m4, t); \
+    m5 = op(m5, t); \
+    m6 = op(m6, t); \
+    m7 = op(m7, t); \
     }
 
 #define AES_DEC(n) AES_OP_W(_mm_aesdec_si128, n)
@@ -52,6 +93,7 @@ void MY_FAST_CALL AesCbc_Encode_Intel(__m128i *p, __m128i *data, size_t numBlock
 #define AES_ENC(n) AES_OP_W(_mm_aesenc_si128, n)
 #define AES_ENC_LAST(n) AES_OP_W(_mm_aesenclast_si128, n)
 
+ATTRIB_AES
 void MY_FAST_CALL AesCbc_Decode_Intel(__m128i *p, __m128i *data, size_t numBlocks)
 {
   __m128i iv = *p;
@@ -59,12 +101,17 @@ void MY_FAST_CALL AesCbc_Decode_Intel(__m128i *p, __m128i *data, size_t numBlock
   {
     UInt32 numRounds2 = *(const UInt32 *)(p + 1);
     const __m128i *w = p + numRounds2 * 2;
-    __m128i m0, m1, m2;
+    __m128i m0, m1, m2, m3, m4, m5, m6, m7;
     {
       const __m128i t = w[2];
       m0 = _mm_xor_si128(t, data[0]);
       m1 = _mm_xor_si128(t, data[1]);
       m2 = _mm_xor_si128(t, data[2]);
+      m3 = _mm_xor_si128(t, data[3]);
+      m4 = _mm_xor_si128(t, data[4]);
+      m5 = _mm_xor_si128(t, data[5]);
+      m6 = _mm_xor_si128(t, data[6]);
+      m7 = _mm_xor_si128(t, data[7]);
     }
     numRounds2--;
     do
@@ -82,6 +129,11 @@ void MY_FAST_CALL AesCbc_Decode_Intel(__m128i *p, __m128i *data, size_t numBlock
       t = _mm_xor_si128(m0, iv); iv = data[0]; data[0] = t;
       t = _mm_xor_si128(m1, iv); iv = data[1]; data[1] = t;
       t = _mm_xor_si128(m2, iv); iv = data[2]; data[2] = t;
+      t = _mm_xor_si128(m3, iv); iv = data[3]; data[3] = t;
+      t = _mm_xor_si128(m4, iv); iv = data[4]; data[4] = t;
+      t = _mm_xor_si128(m5, iv); iv = data[5]; data[5] = t;
+      t = _mm_xor_si128(m6, iv); iv = data[6]; data[6] = t;
+      t = _mm_xor_si128(m7, iv); iv = data[7]; data[7] = t;
     }
   }
   for (; numBlocks != 0; numBlocks--, data++)
@@ -107,22 +159,26 @@ void MY_FAST_CALL AesCbc_Decode_Intel(__m128i *p, __m128i *data, size_t numBlock
   *p = iv;
 }
 
+ATTRIB_AES
 void MY_FAST_CALL AesCtr_Code_Intel(__m128i *p, __m128i *data, size_t numBlocks)
 {
   __m128i ctr = *p;
-  __m128i one;
-  one.m128i_u64[0] = 1;
-  one.m128i_u64[1] = 0;
+  const __m128i one = _mm_set_epi32(0, 0, 0, 1);
   for (; numBlocks >= NUM_WAYS; numBlocks -= NUM_WAYS, data += NUM_WAYS)
   {
     UInt32 numRounds2 = *(const UInt32 *)(p + 1) - 1;
     const __m128i *w = p;
-    __m128i m0, m1, m2;
+    __m128i m0, m1, m2, m3, m4, m5, m6, m7;
     {
       const __m128i t = w[2];
       ctr = _mm_add_epi64(ctr, one); m0 = _mm_xor_si128(ctr, t);
       ctr = _mm_add_epi64(ctr, one); m1 = _mm_xor_si128(ctr, t);
       ctr = _mm_add_epi64(ctr, one); m2 = _mm_xor_si128(ctr, t);
+      ctr = _mm_add_epi64(ctr, one); m3 = _mm_xor_si128(ctr, t);
+      ctr = _mm_add_epi64(ctr, one); m4 = _mm_xor_si128(ctr, t);
+      ctr = _mm_add_epi64(ctr, one); m5 = _mm_xor_si128(ctr, t);
+      ctr = _mm_add_epi64(ctr, one); m6 = _mm_xor_si128(ctr, t);
+      ctr = _mm_add_epi64(ctr, one); m7 = _mm_xor_si128(ctr, t);
     }
     w += 3;
     do
@@ -137,6 +193,11 @@ void MY_FAST_CALL AesCtr_Code_Intel(__m128i *p, __m128i *data, size_t numBlocks)
     data[0] = _mm_xor_si128(data[0], m0);
     data[1] = _mm_xor_si128(data[1], m1);
     data[2] = _mm_xor_si128(data[2], m2);
+    data[3] = _mm_xor_si128(data[3], m3);
+    data[4] = _mm_xor_si128(data[4], m4);
+    data[5] = _mm_xor_si128(data[5], m5);
+    data[6] = _mm_xor_si128(data[6], m6);
+    data[7] = _mm_xor_si128(data[7], m7);
   }
   for (; numBlocks != 0; numBlocks--, data++)
   {
@@ -160,12 +221,116 @@ void MY_FAST_CALL AesCtr_Code_Intel(__m128i *p, __m128i *data, size_t numBlocks)
   *p = ctr;
 }
 
+#ifdef USE_INTEL_VAES
+
+#include <immintrin.h>
+
+/* VAES code: each 256-bit register holds 2 AES blocks, so we decode (NUM_WAYS * 2) blocks per iteration.
+   AesCbc_Decode_Intel_V256() must be called only if CPU_Is_VAES_Supported() returns True. */
+
+void MY_FAST_CALL AesCbc_Decode_Intel_V256(__m128i *p, __m128i *data, size_t numBlocks);
+
+#define AES_OP_Y(op, n) { \
+    const __m256i t = _mm256_broadcastsi128_si256(w[n]); \
+    m0 = op(m0, t); \
+    m1 = op(m1, t); \
+    m2 = op(m2, t); \
+    m3 = op(m3, t); \
+    m4 = op(m4, t); \
+    m5 = op(m5, t); \
+    m6 = op(m6, t); \
+    m7 = op(m7, t); \
+    }
+
+#define AES_DEC_Y(n) AES_OP_Y(_mm256_aesdec_epi128, n)
+#define AES_DEC_LAST_Y(n) AES_OP_Y(_mm256_aesdeclast_epi128, n)
+
+#define LOAD_Y(k) _mm256_loadu_si256((const __m256i *)(const void *)(data + (k) * 2))
+
+/* (data + k * 2 - 1) points to previous ciphertext block pair */
+#define LOAD_PREV_Y(k) _mm256_loadu_si256((const __m256i *)(const void *)(data + (k) * 2 - 1))
+
+#define XOR_STORE_Y(k, m, prev) \
+    _mm256_storeu_si256((__m256i *)(void *)(data + (k) * 2), _mm256_xor_si256(m, prev));
+
+ATTRIB_VAES
+void MY_FAST_CALL AesCbc_Decode_Intel_V256(__m128i *p, __m128i *data, size_t numBlocks)
+{
+  __m128i iv = *p;
+  for (; numBlocks >= NUM_WAYS * 2; numBlocks -= NUM_WAYS * 2, data += NUM_WAYS * 2)
+  {
+    UInt32 numRounds2 = *(const UInt32 *)(p + 1);
+    const __m128i *w = p + numRounds2 * 2;
+    __m256i m0, m1, m2, m3, m4, m5, m6, m7;
+    {
+      const __m256i t = _mm256_broadcastsi128_si256(w[2]);
+      m0 = _mm256_xor_si256(t, LOAD_Y(0));
+      m1 = _mm256_xor_si256(t, LOAD_Y(1));
+      m2 = _mm256_xor_si256(t, LOAD_Y(2));
+      m3 = _mm256_xor_si256(t, LOAD_Y(3));
+      m4 = _mm256_xor_si256(t, LOAD_Y(4));
+      m5 = _mm256_xor_si256(t, LOAD_Y(5));
+      m6 = _mm256_xor_si256(t, LOAD_Y(6));
+      m7 = _mm256_xor_si256(t, LOAD_Y(7));
+    }
+    numRounds2--;
+    do
+    {
+      AES_DEC_Y(1)
+      AES_DEC_Y(0)
+      w -= 2;
+    }
+    while (--numRounds2 != 0);
+    AES_DEC_Y(1)
+    AES_DEC_LAST_Y(0)
+
+    {
+      /* all ciphertext blocks that we need are read before the first store */
+      const __m256i prev0 = _mm256_inserti128_si256(_mm256_castsi128_si256(iv), data[0], 1);
+      const __m256i prev1 = LOAD_PREV_Y(1);
+      const __m256i prev2 = LOAD_PREV_Y(2);
+      const __m256i prev3 = LOAD_PREV_Y(3);
+      const __m256i prev4 = LOAD_PREV_Y(4);
+      const __m256i prev5 = LOAD_PREV_Y(5);
+      const __m256i prev6 = LOAD_PREV_Y(6);
+      const __m256i prev7 = LOAD_PREV_Y(7);
+      iv = data[NUM_WAYS * 2 - 1];
+      XOR_STORE_Y(0, m0, prev0)
+      XOR_STORE_Y(1, m1, prev1)
+      XOR_STORE_Y(2, m2, prev2)
+      XOR_STORE_Y(3, m3, prev3)
+      XOR_STORE_Y(4, m4, prev4)
+      XOR_STORE_Y(5, m5, prev5)
+      XOR_STORE_Y(6, m6, prev6)
+      XOR_STORE_Y(7, m7, prev7)
+    }
+  }
+  *p = iv;
+  AesCbc_Decode_Intel(p, data, numBlocks);
+}
+
+#else
+
+void MY_FAST_CALL AesCbc_Decode_Intel_V256(__m128i *p, __m128i *data, size_t numBlocks);
+
+void MY_FAST_CALL AesCbc_Decode_Intel_V256(__m128i *p, __m128i *data, size_t numBlocks)
+{
+  AesCbc_Decode_Intel(p, data, numBlocks);
+}
+
+#endif
+
 #else
 
 void MY_FAST_CALL AesCbc_Encode(UInt32 *ivAes, Byte *data, size_t numBlocks);
 void MY_FAST_CALL AesCbc_Decode(UInt32 *ivAes, Byte *data, size_t numBlocks);
 void MY_FAST_CALL AesCtr_Code(UInt32 *ivAes, Byte *data, size_t numBlocks);
 
+void MY_FAST_CALL AesCbc_Encode_Intel(UInt32 *p, Byte *data, size_t numBlocks);
+void MY_FAST_CALL AesCbc_Decode_Intel(UInt32 *p, Byte *data, size_t numBlocks);
+void MY_FAST_CALL AesCbc_Decode_Intel_V256(UInt32 *p, Byte *data, size_t numBlocks);
+void MY_FAST_CALL AesCtr_Code_Intel(UInt32 *p, Byte *data, size_t numBlocks);
+
 void MY_FAST_CALL AesCbc_Encode_Intel(UInt32 *p, Byte *data, size_t numBlocks)
 {
   AesCbc_Encode(p, data, numBlocks);
@@ -176,6 +341,11 @@ void MY_FAST_CALL AesCbc_Decode_Intel(UInt32 *p, Byte *data, size_t numBlocks)
   AesCbc_Decode(p, data, numBlocks);
 }
 
+void MY_FAST_CALL AesCbc_Decode_Intel_V256(UInt32 *p, Byte *data, size_t numBlocks)
+{
+  AesCbc_Decode(p, data, numBlocks);
+}
+
 void MY_FAST_CALL AesCtr_Code_Intel(UInt32 *p, Byte *data, size_t numBlocks)
 {
   AesCtr_Code(p, data, numBlocks);
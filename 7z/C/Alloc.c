@@ -5,6 +5,9 @@
 
 #ifdef _WIN32
 #include <windows.h>
+#elif defined(__linux__)
+#include <stdio.h>
+#include <sys/mman.h>
 #endif
 #include <stdlib.h>
 
@@ -133,6 +136,160 @@ void BigFree(void *address)
   VirtualFree(address, 0, MEM_RELEASE);
 }
 
+#else
+
+/*
+  Linux: BigAlloc() uses huge pages after SetLargePageSize() call:
+    - mmap(MAP_HUGETLB), if the system has reserved huge pages (vm.nr_hugepages),
+    - otherwise mmap() of region aligned for huge pages, and madvise(MADV_HUGEPAGE)
+      that allows transparent huge pages for that region.
+  Each block from BigAlloc() is preceded by BIG_ALLOC_HEADER_SIZE bytes that keep
+  the size of mmap() region, or 0 for malloc() block.
+*/
+
+#if defined(__linux__) && (defined(MAP_HUGETLB) || defined(MADV_HUGEPAGE))
+#define _7ZIP_LARGE_PAGES_LINUX
+#endif
+
+#ifdef _7ZIP_LARGE_PAGES_LINUX
+
+#define BIG_ALLOC_HEADER_SIZE 64
+
+static size_t g_LargePageSize = 0;
+
+void SetLargePageSize()
+{
+  size_t size = (size_t)1 << 21;
+  FILE *f = fopen("/proc/meminfo", "r");
+  if (f)
+  {
+    char line[128];
+    while (fgets(line, sizeof(line), f))
+    {
+      unsigned long kb;
+      if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1)
+      {
+        size = (size_t)kb << 10;
+        break;
+      }
+    }
+    fclose(f);
+  }
+  if (size == 0 || (size & (size - 1)) != 0)
+    return;
+  g_LargePageSize = size;
+}
+
+static void *BigAlloc_Map(size_t size, size_t ps)
+{
+  void *res;
+  size_t size2;
+  
+  ps--;
+  size2 = (size + BIG_ALLOC_HEADER_SIZE + ps) & ~ps;
+  if (size2 < size)
+    return NULL;
+  
+  #ifdef MAP_HUGETLB
+  res = mmap(NULL, size2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (res != MAP_FAILED)
+  {
+    *(size_t *)res = size2;
+    return (Byte *)res + BIG_ALLOC_HEADER_SIZE;
+  }
+  #endif
+  
+  #ifdef MADV_HUGEPAGE
+  {
+    /* we map (ps) additional bytes, and unmap the unaligned head and tail */
+    Byte *base;
+    size_t head;
+    if (size2 + ps < size2)
+      return NULL;
+    res = mmap(NULL, size2 + ps, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (res == MAP_FAILED)
+      return NULL;
+    base = (Byte *)res;
+    head = (0 - (size_t)base) & ps;
+    if (head != 0)
+      munmap(base, head);
+    if (ps - head != 0)
+      munmap(base + head + size2, ps - head);
+    base += head;
+    madvise(base, size2, MADV_HUGEPAGE);
+    *(size_t *)(void *)base = size2;
+    return base + BIG_ALLOC_HEADER_SIZE;
+  }
+  #else
+  return NULL;
+  #endif
+}
+
+void *BigAlloc(size_t size)
+{
+  Byte *p;
+  if (size == 0)
+    return NULL;
+  #ifdef _SZ_ALLOC_DEBUG
+  fprintf(stderr, "\nAlloc_Big %10u bytes;  count = %10d", size, g_allocCountBig++);
+  #endif
+
+  {
+    size_t ps = g_LargePageSize;
+    if (ps != 0 && ps <= ((size_t)1 << 30) && size > (ps / 2))
+    {
+      void *res = BigAlloc_Map(size, ps);
+      if (res)
+        return res;
+    }
+  }
+
+  if (size + BIG_ALLOC_HEADER_SIZE < size)
+    return NULL;
+  p = (Byte *)malloc(size + BIG_ALLOC_HEADER_SIZE);
+  if (!p)
+    return NULL;
+  *(size_t *)(void *)p = 0;
+  return p + BIG_ALLOC_HEADER_SIZE;
+}
+
+void BigFree(void *address)
+{
+  Byte *p;
+  size_t mapSize;
+  #ifdef _SZ_ALLOC_DEBUG
+  if (address)
+    fprintf(stderr, "\nFree_Big; count = %10d", --g_allocCountBig);
+  #endif
+
+  if (!address)
+    return;
+  p = (Byte *)address - BIG_ALLOC_HEADER_SIZE;
+  mapSize = *(const size_t *)(const void *)p;
+  if (mapSize != 0)
+    munmap(p, mapSize);
+  else
+    free(p);
+}
+
+#else
+
+void SetLargePageSize()
+{
+}
+
+void *BigAlloc(size_t size)
+{
+  return MyAlloc(size);
+}
+
+void BigFree(void *address)
+{
+  MyFree(address);
+}
+
+#endif
+
 #endif
 
 
@@ -22,10 +22,13 @@ void BigFree(void *address);
 
 #else
 
+/* SetLargePageSize() enables huge pages for BigAlloc() in Linux */
+void SetLargePageSize();
+
 #define MidAlloc(size) MyAlloc(size)
 #define MidFree(address) MyFree(address)
-#define BigAlloc(size) MyAlloc(size)
-#define BigFree(address) MyFree(address)
+void *BigAlloc(size_t size);
+void BigFree(void *address);
 
 #endif
 
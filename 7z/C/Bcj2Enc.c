@@ -12,7 +12,6 @@
 #define PRF(x)
 #endif
 
-#include <windows.h>
 #include <string.h>
 
 #include "Bcj2.h"
@@ -53,6 +52,117 @@ void Bcj2Enc_Init(CBcj2Enc *p)
     p->probs[i] = kBitModelTotal >> 1;
 }
 
+/*
+  Bcj2Enc_GetPlainSize() returns the number of leading bytes in [src, lim)
+  that are neither E8/E9 nor 0F. Such bytes are just copied to main stream.
+  SIMD code compares 16 or 32 bytes at once and gets the position of the first
+  candidate byte from the bit mask.
+  SSE2 and NEON are always supported by x64 and ARM64 CPUs.
+  AVX2 code is used, if the compiler generates AVX2 code for whole program.
+*/
+
+#if defined(MY_CPU_AMD64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define USE_BCJ2_SSE2
+  #ifdef __AVX2__
+    #define USE_BCJ2_AVX2
+  #endif
+#elif defined(MY_CPU_ARM64)
+  #define USE_BCJ2_NEON
+#endif
+
+#if defined(USE_BCJ2_SSE2) || defined(USE_BCJ2_NEON)
+
+#define USE_BCJ2_SIMD
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+static MY_FORCE_INLINE unsigned Bcj2_Ctz32(UInt32 v) { unsigned long i; _BitScanForward(&i, v); return (unsigned)i; }
+#ifdef USE_BCJ2_NEON
+static MY_FORCE_INLINE unsigned Bcj2_Ctz64(UInt64 v) { unsigned long i; _BitScanForward64(&i, v); return (unsigned)i; }
+#endif
+#else
+#define Bcj2_Ctz32(v) ((unsigned)__builtin_ctz(v))
+#define Bcj2_Ctz64(v) ((unsigned)__builtin_ctzll(v))
+#endif
+
+#ifdef USE_BCJ2_SSE2
+#ifdef USE_BCJ2_AVX2
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+#endif
+
+#ifdef USE_BCJ2_NEON
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <arm64_neon.h>
+#else
+#include <arm_neon.h>
+#endif
+#endif
+
+static MY_FORCE_INLINE SizeT Bcj2Enc_GetPlainSize(const Byte *src, const Byte *lim)
+{
+  const Byte *p = src;
+  #ifdef USE_BCJ2_AVX2
+  {
+    const __m256i mask = _mm256_set1_epi8((char)0xFE);
+    const __m256i e8 = _mm256_set1_epi8((char)0xE8);
+    const __m256i x0f = _mm256_set1_epi8(0x0F);
+    for (; (SizeT)(lim - p) >= 32; p += 32)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i *)(const void *)p);
+      UInt32 m = (UInt32)_mm256_movemask_epi8(_mm256_or_si256(
+          _mm256_cmpeq_epi8(_mm256_and_si256(v, mask), e8),
+          _mm256_cmpeq_epi8(v, x0f)));
+      if (m != 0)
+        return (SizeT)(p - src) + Bcj2_Ctz32(m);
+    }
+  }
+  #endif
+  #ifdef USE_BCJ2_SSE2
+  {
+    const __m128i mask = _mm_set1_epi8((char)0xFE);
+    const __m128i e8 = _mm_set1_epi8((char)0xE8);
+    const __m128i x0f = _mm_set1_epi8(0x0F);
+    for (; (SizeT)(lim - p) >= 16; p += 16)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i *)(const void *)p);
+      UInt32 m = (UInt32)_mm_movemask_epi8(_mm_or_si128(
+          _mm_cmpeq_epi8(_mm_and_si128(v, mask), e8),
+          _mm_cmpeq_epi8(v, x0f)));
+      if (m != 0)
+        return (SizeT)(p - src) + Bcj2_Ctz32(m);
+    }
+  }
+  #endif
+  #ifdef USE_BCJ2_NEON
+  {
+    const uint8x16_t mask = vdupq_n_u8(0xFE);
+    const uint8x16_t e8 = vdupq_n_u8(0xE8);
+    const uint8x16_t x0f = vdupq_n_u8(0x0F);
+    for (; (SizeT)(lim - p) >= 16; p += 16)
+    {
+      uint8x16_t v = vld1q_u8(p);
+      uint8x16_t c = vorrq_u8(vceqq_u8(vandq_u8(v, mask), e8), vceqq_u8(v, x0f));
+      /* 4 bits of mask per byte */
+      UInt64 m = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(c), 4)), 0);
+      if (m != 0)
+        return (SizeT)(p - src) + (Bcj2_Ctz64(m) >> 2);
+    }
+  }
+  #endif
+  for (; p != lim; p++)
+  {
+    Byte b = *p;
+    if ((b & 0xFE) == 0xE8 || b == 0x0F)
+      break;
+  }
+  return (SizeT)(p - src);
+}
+
+#endif
+
 static Bool MY_FAST_CALL RangeEnc_ShiftLow(CBcj2Enc *p)
 {
   if ((UInt32)p->low < (UInt32)0xFF000000 || (UInt32)(p->low >> 32) != 0)
@@ -133,7 +243,21 @@ static void Bcj2Enc_Encode_2(CBcj2Enc *p)
           *dest = src[0];
         else for (;;)
         {
-          Byte b = *src;
+          Byte b;
+          #ifdef USE_BCJ2_SIMD
+          {
+            SizeT plain = Bcj2Enc_GetPlainSize(src, srcLim);
+            if (plain != 0)
+            {
+              memcpy(dest, src, plain);
+              dest += plain;
+              src += plain;
+              if (src == srcLim)
+                break;
+            }
+          }
+          #endif
+          b = *src;
           *dest = b;
           if (b != 0x0F)
           {
@@ -4,9 +4,109 @@
 #include "Precomp.h"
 
 #include "Bra.h"
+#include "CpuArch.h"
 
 #define Test86MSByte(b) ((((b) + 1) & 0xFE) == 0)
 
+/*
+  x86_FindE8() returns the first (p) in [p, lim) with ((*p & 0xFE) == 0xE8), or (lim).
+  If (p >= lim) already, it returns (p).
+  SIMD code compares 16 or 32 bytes at once and gets the position of the first
+  candidate byte from the bit mask. So runs without E8/E9 bytes are skipped fast.
+  SSE2 and NEON are always supported by x64 and ARM64 CPUs.
+  AVX2 code is used, if the compiler generates AVX2 code for whole program.
+*/
+
+#if defined(MY_CPU_AMD64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define USE_BRA86_SSE2
+  #ifdef __AVX2__
+    #define USE_BRA86_AVX2
+  #endif
+#elif defined(MY_CPU_ARM64)
+  #define USE_BRA86_NEON
+#endif
+
+#if defined(USE_BRA86_SSE2) || defined(USE_BRA86_NEON)
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+static MY_FORCE_INLINE unsigned Bra86_Ctz32(UInt32 v) { unsigned long i; _BitScanForward(&i, v); return (unsigned)i; }
+#ifdef USE_BRA86_NEON
+static MY_FORCE_INLINE unsigned Bra86_Ctz64(UInt64 v) { unsigned long i; _BitScanForward64(&i, v); return (unsigned)i; }
+#endif
+#else
+#define Bra86_Ctz32(v) ((unsigned)__builtin_ctz(v))
+#define Bra86_Ctz64(v) ((unsigned)__builtin_ctzll(v))
+#endif
+
+#endif
+
+#ifdef USE_BRA86_SSE2
+#ifdef USE_BRA86_AVX2
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+#endif
+
+#ifdef USE_BRA86_NEON
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <arm64_neon.h>
+#else
+#include <arm_neon.h>
+#endif
+#endif
+
+static MY_FORCE_INLINE Byte *x86_FindE8(Byte *p, const Byte *lim)
+{
+  if (p >= lim)
+    return p;
+  #ifdef USE_BRA86_AVX2
+  {
+    const __m256i mask = _mm256_set1_epi8((char)0xFE);
+    const __m256i e8 = _mm256_set1_epi8((char)0xE8);
+    for (; (SizeT)(lim - p) >= 32; p += 32)
+    {
+      UInt32 m = (UInt32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+          _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(const void *)p), mask), e8));
+      if (m != 0)
+        return p + Bra86_Ctz32(m);
+    }
+  }
+  #endif
+  #ifdef USE_BRA86_SSE2
+  {
+    const __m128i mask = _mm_set1_epi8((char)0xFE);
+    const __m128i e8 = _mm_set1_epi8((char)0xE8);
+    for (; (SizeT)(lim - p) >= 16; p += 16)
+    {
+      UInt32 m = (UInt32)_mm_movemask_epi8(_mm_cmpeq_epi8(
+          _mm_and_si128(_mm_loadu_si128((const __m128i *)(const void *)p), mask), e8));
+      if (m != 0)
+        return p + Bra86_Ctz32(m);
+    }
+  }
+  #endif
+  #ifdef USE_BRA86_NEON
+  {
+    const uint8x16_t mask = vdupq_n_u8(0xFE);
+    const uint8x16_t e8 = vdupq_n_u8(0xE8);
+    for (; (SizeT)(lim - p) >= 16; p += 16)
+    {
+      uint8x16_t c = vceqq_u8(vandq_u8(vld1q_u8(p), mask), e8);
+      /* 4 bits of mask per byte */
+      UInt64 m = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(c), 4)), 0);
+      if (m != 0)
+        return p + (Bra86_Ctz64(m) >> 2);
+    }
+  }
+  #endif
+  for (; p < lim; p++)
+    if ((*p & 0xFE) == 0xE8)
+      break;
+  return p;
+}
+
 SizeT x86_Convert(Byte *data, SizeT size, UInt32 ip, UInt32 *state, int encoding)
 {
   SizeT pos = 0;
@@ -18,11 +118,8 @@ SizeT x86_Convert(Byte *data, SizeT size, UInt32 ip, UInt32 *state, int encoding
 
   for (;;)
   {
-    Byte *p = data + pos;
     const Byte *limit = data + size;
-    for (; p < limit; p++)
-      if ((*p & 0xFE) == 0xE8)
-        break;
+    Byte *p = x86_FindE8(data + pos, limit);
 
     {
       SizeT d = (SizeT)(p - data - pos);
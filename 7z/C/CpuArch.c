@@ -11,7 +11,7 @@
 #define USE_ASM
 #endif
 
-#if !defined(USE_ASM) && _MSC_VER >= 1500
+#if (!defined(USE_ASM) && _MSC_VER >= 1500) || (defined(_MSC_VER) && (_MSC_FULL_VER >= 160040219))
 #include <intrin.h>
 #endif
 
@@ -99,7 +99,7 @@ void MyCPUID(UInt32 function, UInt32 *a, UInt32 *b, UInt32 *c, UInt32 *d)
   #endif
       "=c" (*c) ,
       "=d" (*d)
-    : "0" (function)) ;
+    : "0" (function), "2" (0)) ;
 
   #endif
   
@@ -197,4 +197,112 @@ Bool CPU_Is_Aes_Supported()
   return (p.c >> 25) & 1;
 }
 
+/* VAES code uses 256-bit AVX registers, so OS must save YMM state (XCR0 bits 1 and 2) */
+
+static Bool CPU_Sys_Is_Avx_Supported(const Cx86cpuid *p)
+{
+  UInt32 xcr0;
+  /* OSXSAVE and AVX */
+  if (((p->c >> 27) & 3) != 3)
+    return False;
+  #if defined(_MSC_VER) && (_MSC_FULL_VER >= 160040219)
+  xcr0 = (UInt32)_xgetbv(0);
+  #elif defined(__GNUC__)
+  {
+    UInt32 xcr0_hi;
+    __asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a" (xcr0), "=d" (xcr0_hi) : "c" (0));
+  }
+  #else
+  return False;
+  #endif
+  return (xcr0 & 6) == 6;
+}
+
+Bool CPU_Is_VAES_Supported()
+{
+  Cx86cpuid p;
+  UInt32 a, b, c, d;
+  CHECK_SYS_SSE_SUPPORT
+  if (!x86cpuid_CheckAndRead(&p))
+    return False;
+  if (p.maxFunc < 7 || ((p.c >> 25) & 1) == 0 || !CPU_Sys_Is_Avx_Supported(&p))
+    return False;
+  MyCPUID(7, &a, &b, &c, &d);
+  /* AVX2 and VAES */
+  return ((b >> 5) & 1) && ((c >> 9) & 1);
+}
+
+Bool CPU_Is_SSE41_Supported()
+{
+  Cx86cpuid p;
+  CHECK_SYS_SSE_SUPPORT
+  if (!x86cpuid_CheckAndRead(&p))
+    return False;
+  return (p.c >> 19) & 1;
+}
+
+Bool CPU_Is_Avx2_Supported()
+{
+  Cx86cpuid p;
+  UInt32 a, b, c, d;
+  CHECK_SYS_SSE_SUPPORT
+  if (!x86cpuid_CheckAndRead(&p))
+    return False;
+  if (p.maxFunc < 7 || !CPU_Sys_Is_Avx_Supported(&p))
+    return False;
+  MyCPUID(7, &a, &b, &c, &d);
+  return (b >> 5) & 1;
+}
+
+Bool CPU_Is_Sha256_Supported()
+{
+  Cx86cpuid p;
+  UInt32 a, b, c, d;
+  CHECK_SYS_SSE_SUPPORT
+  if (!x86cpuid_CheckAndRead(&p))
+    return False;
+  /* hardware SHA-256 code also uses SSSE3 and SSE4.1 instructions */
+  if (p.maxFunc < 7 || ((p.c >> 9) & 1) == 0 || ((p.c >> 19) & 1) == 0)
+    return False;
+  MyCPUID(7, &a, &b, &c, &d);
+  return (b >> 29) & 1;
+}
+
+#elif defined(MY_CPU_ARM64)
+
+#if defined(_WIN32)
+
+#include <windows.h>
+
+Bool CPU_Is_Sha256_Supported()
+{
+  return IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE) ? True : False;
+}
+
+#elif defined(__linux__)
+
+#include <sys/auxv.h>
+
+#ifndef HWCAP_SHA2
+#define HWCAP_SHA2 (1 << 6)
+#endif
+
+Bool CPU_Is_Sha256_Supported()
+{
+  return (getauxval(AT_HWCAP) & HWCAP_SHA2) ? True : False;
+}
+
+#else
+
+Bool CPU_Is_Sha256_Supported()
+{
+  #if defined(__ARM_FEATURE_CRYPTO) || defined(__APPLE__)
+  return True;
+  #else
+  return False;
+  #endif
+}
+
+#endif
+
 #endif
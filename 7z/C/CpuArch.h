@@ -327,6 +327,14 @@ int x86cpuid_GetFirm(const Cx86cpuid *p);
 
 Bool CPU_Is_InOrder();
 Bool CPU_Is_Aes_Supported();
+Bool CPU_Is_VAES_Supported();
+Bool CPU_Is_SSE41_Supported();
+Bool CPU_Is_Avx2_Supported();
+Bool CPU_Is_Sha256_Supported();
+
+#elif defined(MY_CPU_ARM64)
+
+Bool CPU_Is_Sha256_Supported();
 
 #endif
 
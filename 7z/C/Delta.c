@@ -3,8 +3,36 @@
 
 #include "Precomp.h"
 
+#include "CpuArch.h"
 #include "Delta.h"
 
+/*
+  SIMD code for big blocks:
+    Encode: (data[i] -= data[i - delta]) is calculated from the end of block
+            to the start for any delta, so source bytes are not changed yet.
+    Decode: (data[i] += data[i - delta]) is calculated from the start of block.
+            If (delta >= 16), the vector of (data[i - delta]) is already decoded.
+            For (delta = 1, 2, 4, 8) we calculate prefix sums inside vector
+            with (delta) stride, and we add last (delta) decoded bytes
+            broadcasted over the vector.
+            Other distances use scalar code.
+  SSE2 and NEON are always supported by x64 and ARM64 CPUs.
+*/
+
+#if defined(MY_CPU_AMD64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define USE_DELTA_SSE2
+  #define USE_DELTA_SIMD
+  #include <emmintrin.h>
+#elif defined(MY_CPU_ARM64)
+  #define USE_DELTA_NEON
+  #define USE_DELTA_SIMD
+  #if defined(_MSC_VER) && !defined(__clang__)
+  #include <arm64_neon.h>
+  #else
+  #include <arm_neon.h>
+  #endif
+#endif
+
 void Delta_Init(Byte *state)
 {
   unsigned i;
@@ -19,10 +47,110 @@ static void MyMemCpy(Byte *dest, const Byte *src, unsigned size)
     dest[i] = src[i];
 }
 
+#ifdef USE_DELTA_SIMD
+
+#ifdef USE_DELTA_SSE2
+  #define V_TYPE  __m128i
+  #define V_LOAD(p)  _mm_loadu_si128((const __m128i *)(const void *)(p))
+  #define V_STORE(p, v)  _mm_storeu_si128((__m128i *)(void *)(p), v)
+  #define V_ADD(a, b)  _mm_add_epi8(a, b)
+  #define V_SUB(a, b)  _mm_sub_epi8(a, b)
+  #define V_SHL_BYTES(v, n)  _mm_slli_si128(v, n)
+#else
+  #define V_TYPE  uint8x16_t
+  #define V_LOAD(p)  vld1q_u8(p)
+  #define V_STORE(p, v)  vst1q_u8(p, v)
+  #define V_ADD(a, b)  vaddq_u8(a, b)
+  #define V_SUB(a, b)  vsubq_u8(a, b)
+  #define V_SHL_BYTES(v, n)  vextq_u8(vdupq_n_u8(0), v, 16 - (n))
+#endif
+
+/* it processes data[delta ... size - 1]. (size >= delta) */
+
+static void Delta_Encode_Vec(unsigned delta, Byte *data, SizeT size)
+{
+  SizeT i = size;
+  for (; i - delta >= 16; i -= 16)
+    V_STORE(data + i - 16, V_SUB(V_LOAD(data + i - 16), V_LOAD(data + i - 16 - delta)));
+  while (i != delta)
+  {
+    i--;
+    data[i] = (Byte)(data[i] - data[i - delta]);
+  }
+}
+
+#define DELTA_DEC_PREFIX(d) \
+  for (; size - i >= 16; i += 16) \
+  { \
+    V_TYPE v = V_LOAD(data + i); \
+    v = V_ADD(v, V_SHL_BYTES(v, d)); \
+    if (d < 8) v = V_ADD(v, V_SHL_BYTES(v, (d < 4 ? d * 2 : 8))); \
+    if (d < 4) v = V_ADD(v, V_SHL_BYTES(v, (d < 2 ? 4 : 8))); \
+    if (d < 2) v = V_ADD(v, V_SHL_BYTES(v, 8)); \
+    v = V_ADD(v, carry); \
+    V_STORE(data + i, v); \
+    carry = BROADCAST_LAST_ ## d(v); \
+  }
+
+#ifdef USE_DELTA_SSE2
+  #define BROADCAST_LAST_8(v)  _mm_unpackhi_epi64(v, v)
+  #define BROADCAST_LAST_4(v)  _mm_shuffle_epi32(v, 0xFF)
+  #define BROADCAST_LAST_2(v)  _mm_shuffle_epi32(_mm_shufflehi_epi16(v, 0xFF), 0xFF)
+  #define BROADCAST_LAST_1(v)  BROADCAST_LAST_2(_mm_unpackhi_epi8(v, v))
+#else
+  #define BROADCAST_LAST_8(v)  vreinterpretq_u8_u64(vdupq_laneq_u64(vreinterpretq_u64_u8(v), 1))
+  #define BROADCAST_LAST_4(v)  vreinterpretq_u8_u32(vdupq_laneq_u32(vreinterpretq_u32_u8(v), 3))
+  #define BROADCAST_LAST_2(v)  vreinterpretq_u8_u16(vdupq_laneq_u16(vreinterpretq_u16_u8(v), 7))
+  #define BROADCAST_LAST_1(v)  vdupq_laneq_u8(v, 15)
+#endif
+
+/* it processes data[delta ... size - 1]. (size >= delta)
+   data[0 ... delta - 1] must be decoded already.
+   it returns 0, if (delta) is not supported by SIMD code. */
+
+static int Delta_Decode_Vec(unsigned delta, Byte *data, SizeT size)
+{
+  SizeT i = delta;
+  if (delta >= 16)
+  {
+    for (; size - i >= 16; i += 16)
+      V_STORE(data + i, V_ADD(V_LOAD(data + i), V_LOAD(data + i - delta)));
+  }
+  else
+  {
+    /* the vector with last decoded bytes data[i - delta ... i - 1] */
+    V_TYPE carry = V_LOAD(data + i - delta);
+    switch (delta)
+    {
+      case 1: carry = BROADCAST_LAST_1(V_SHL_BYTES(carry, 15)); DELTA_DEC_PREFIX(1) break;
+      case 2: carry = BROADCAST_LAST_2(V_SHL_BYTES(carry, 14)); DELTA_DEC_PREFIX(2) break;
+      case 4: carry = BROADCAST_LAST_4(V_SHL_BYTES(carry, 12)); DELTA_DEC_PREFIX(4) break;
+      case 8: carry = BROADCAST_LAST_8(V_SHL_BYTES(carry, 8)); DELTA_DEC_PREFIX(8) break;
+      default: return 0;
+    }
+  }
+  for (; i < size; i++)
+    data[i] = (Byte)(data[i] + data[i - delta]);
+  return 1;
+}
+
+#endif
+
 void Delta_Encode(Byte *state, unsigned delta, Byte *data, SizeT size)
 {
   Byte buf[DELTA_STATE_SIZE];
   unsigned j = 0;
+  #ifdef USE_DELTA_SIMD
+  if (size >= (SizeT)delta + 16)
+  {
+    MyMemCpy(buf, data + size - delta, delta);
+    Delta_Encode_Vec(delta, data, size);
+    for (j = 0; j < delta; j++)
+      data[j] = (Byte)(data[j] - state[j]);
+    MyMemCpy(state, buf, delta);
+    return;
+  }
+  #endif
   MyMemCpy(buf, state, delta);
   {
     SizeT i;
@@ -46,6 +174,23 @@ void Delta_Decode(Byte *state, unsigned delta, Byte *data, SizeT size)
 {
   Byte buf[DELTA_STATE_SIZE];
   unsigned j = 0;
+  #ifdef USE_DELTA_SIMD
+  if (size >= (SizeT)delta + 16)
+  {
+    for (j = 0; j < delta; j++)
+      data[j] = (Byte)(data[j] + state[j]);
+    if (Delta_Decode_Vec(delta, data, size))
+    {
+      MyMemCpy(state, data + size - delta, delta);
+      return;
+    }
+    /* data[0 ... delta - 1] is decoded already, so we continue with scalar code */
+    MyMemCpy(buf, data, delta);
+    data += delta;
+    size -= delta;
+  }
+  else
+  #endif
   MyMemCpy(buf, state, delta);
   {
     SizeT i;
@@ -5,6 +5,7 @@
 
 #include <string.h>
 
+#include "CpuArch.h"
 #include "LzFind.h"
 #include "LzHash.h"
 
@@ -136,6 +137,8 @@ static void MatchFinder_SetDefaultSettings(CMatchFinder *p)
 
 #define kCrcPoly 0xEDB88320
 
+static void LzFind_PrepareNormalize(void);
+
 void MatchFinder_Construct(CMatchFinder *p)
 {
   UInt32 i;
@@ -153,6 +156,8 @@ void MatchFinder_Construct(CMatchFinder *p)
       r = (r >> 1) ^ (kCrcPoly & ((UInt32)0 - (r & 1)));
     p->crc[i] = r;
   }
+
+  LzFind_PrepareNormalize();
 }
 
 static void MatchFinder_FreeThisClassMemory(CMatchFinder *p, ISzAllocPtr alloc)
@@ -300,21 +305,29 @@ static void MatchFinder_SetLimits(CMatchFinder *p)
 
 void MatchFinder_Init_LowHash(CMatchFinder *p)
 {
-  size_t i;
   CLzRef *items = p->hash;
   size_t numItems = p->fixedHashSize;
+  #if kEmptyHashValue == 0
+  memset(items, 0, numItems * sizeof(CLzRef));
+  #else
+  size_t i;
   for (i = 0; i < numItems; i++)
     items[i] = kEmptyHashValue;
+  #endif
 }
 
 
 void MatchFinder_Init_HighHash(CMatchFinder *p)
 {
-  size_t i;
   CLzRef *items = p->hash + p->fixedHashSize;
   size_t numItems = (size_t)p->hashMask + 1;
+  #if kEmptyHashValue == 0
+  memset(items, 0, numItems * sizeof(CLzRef));
+  #else
+  size_t i;
   for (i = 0; i < numItems; i++)
     items[i] = kEmptyHashValue;
+  #endif
 }
 
 
@@ -347,7 +360,7 @@ static UInt32 MatchFinder_GetSubValue(CMatchFinder *p)
   return (p->pos - p->historySize - 1) & kNormalizeMask;
 }
 
-void MatchFinder_Normalize3(UInt32 subValue, CLzRef *items, size_t numItems)
+static void MY_FAST_CALL LzFind_Normalize(UInt32 subValue, CLzRef *items, size_t numItems)
 {
   size_t i;
   for (i = 0; i < numItems; i++)
@@ -361,6 +374,185 @@ void MatchFinder_Normalize3(UInt32 subValue, CLzRef *items, size_t numItems)
   }
 }
 
+/*
+  SIMD versions of LzFind_Normalize.
+  (value <= subValue ? 0 : value - subValue) is (max(value, subValue) - subValue)
+  for unsigned values, and it's unsigned saturated subtraction in NEON.
+  The loops process head items until (items) is aligned for vector stores,
+  then 4 vectors per iteration, and tail items with scalar code.
+*/
+
+#if kEmptyHashValue == 0
+
+#ifdef MY_CPU_X86_OR_AMD64
+  #if defined(__clang__)
+    #if (__clang_major__ >= 4)
+      #define USE_LZFIND_SSE41
+      #define ATTRIB_SSE41 __attribute__((__target__("sse4.1")))
+      #define USE_LZFIND_AVX2
+      #define ATTRIB_AVX2 __attribute__((__target__("avx2")))
+    #endif
+  #elif defined(__GNUC__)
+    #if (__GNUC__ >= 5)
+      #define USE_LZFIND_SSE41
+      #define ATTRIB_SSE41 __attribute__((__target__("sse4.1")))
+      #define USE_LZFIND_AVX2
+      #define ATTRIB_AVX2 __attribute__((__target__("avx2")))
+    #endif
+  #elif defined(_MSC_VER)
+    #if (_MSC_VER >= 1600)
+      #define USE_LZFIND_SSE41
+    #endif
+    #if (_MSC_VER >= 1800)
+      #define USE_LZFIND_AVX2
+    #endif
+  #endif
+#elif defined(MY_CPU_ARM64)
+  #define USE_LZFIND_NEON
+#endif
+
+#ifndef ATTRIB_SSE41
+#define ATTRIB_SSE41
+#endif
+#ifndef ATTRIB_AVX2
+#define ATTRIB_AVX2
+#endif
+
+#define LZFIND_NORM_HEAD(vecSize) \
+  for (; numItems != 0 && ((size_t)items & ((vecSize) - 1)) != 0; numItems--, items++) \
+  { UInt32 v = *items; *items = (v <= subValue ? kEmptyHashValue : v - subValue); }
+
+#define LZFIND_NORM_TAIL \
+  LzFind_Normalize(subValue, items, numItems);
+
+#ifdef USE_LZFIND_SSE41
+
+#include <smmintrin.h>
+
+#define SSE41_NORM(k) \
+  { __m128i v = _mm_load_si128(vp + (k)); \
+    _mm_store_si128(vp + (k), _mm_sub_epi32(_mm_max_epu32(v, sub), sub)); }
+
+ATTRIB_SSE41
+static void MY_FAST_CALL LzFind_Normalize_SSE41(UInt32 subValue, CLzRef *items, size_t numItems)
+{
+  LZFIND_NORM_HEAD(16)
+  {
+    const __m128i sub = _mm_set1_epi32((Int32)subValue);
+    __m128i *vp = (__m128i *)(void *)items;
+    __m128i *lim = vp + (numItems >> 4) * 4;
+    for (; vp != lim; vp += 4)
+    {
+      SSE41_NORM(0)
+      SSE41_NORM(1)
+      SSE41_NORM(2)
+      SSE41_NORM(3)
+    }
+    items = (CLzRef *)(void *)vp;
+    numItems &= 15;
+  }
+  LZFIND_NORM_TAIL
+}
+
+#endif
+
+#ifdef USE_LZFIND_AVX2
+
+#include <immintrin.h>
+
+#define AVX2_NORM(k) \
+  { __m256i v = _mm256_load_si256(vp + (k)); \
+    _mm256_store_si256(vp + (k), _mm256_sub_epi32(_mm256_max_epu32(v, sub), sub)); }
+
+ATTRIB_AVX2
+static void MY_FAST_CALL LzFind_Normalize_AVX2(UInt32 subValue, CLzRef *items, size_t numItems)
+{
+  LZFIND_NORM_HEAD(32)
+  {
+    const __m256i sub = _mm256_set1_epi32((Int32)subValue);
+    __m256i *vp = (__m256i *)(void *)items;
+    __m256i *lim = vp + (numItems >> 5) * 4;
+    for (; vp != lim; vp += 4)
+    {
+      AVX2_NORM(0)
+      AVX2_NORM(1)
+      AVX2_NORM(2)
+      AVX2_NORM(3)
+    }
+    items = (CLzRef *)(void *)vp;
+    numItems &= 31;
+  }
+  LZFIND_NORM_TAIL
+}
+
+#endif
+
+#ifdef USE_LZFIND_NEON
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <arm64_neon.h>
+#else
+#include <arm_neon.h>
+#endif
+
+#define NEON_NORM(k) \
+  vst1q_u32(items + (k) * 4, vqsubq_u32(vld1q_u32(items + (k) * 4), sub));
+
+static void MY_FAST_CALL LzFind_Normalize_NEON(UInt32 subValue, CLzRef *items, size_t numItems)
+{
+  LZFIND_NORM_HEAD(16)
+  {
+    const uint32x4_t sub = vdupq_n_u32(subValue);
+    CLzRef *lim = items + (numItems & ~(size_t)15);
+    for (; items != lim; items += 16)
+    {
+      NEON_NORM(0)
+      NEON_NORM(1)
+      NEON_NORM(2)
+      NEON_NORM(3)
+    }
+    numItems &= 15;
+  }
+  LZFIND_NORM_TAIL
+}
+
+#endif
+
+#endif
+
+typedef void (MY_FAST_CALL *LZFIND_NORMALIZE_FUNC)(UInt32 subValue, CLzRef *items, size_t numItems);
+
+static LZFIND_NORMALIZE_FUNC g_LzFind_Normalize = LzFind_Normalize;
+static Bool g_LzFind_Normalize_WasPrepared = False;
+
+/* it's called from MatchFinder_Construct(). CPUID is executed only once.
+   Concurrent calls write same values, so it doesn't need locking. */
+
+static void LzFind_PrepareNormalize(void)
+{
+  LZFIND_NORMALIZE_FUNC f = LzFind_Normalize;
+  if (g_LzFind_Normalize_WasPrepared)
+    return;
+  #ifdef USE_LZFIND_NEON
+  f = LzFind_Normalize_NEON;
+  #endif
+  #ifdef USE_LZFIND_SSE41
+  if (CPU_Is_SSE41_Supported())
+    f = LzFind_Normalize_SSE41;
+  #endif
+  #ifdef USE_LZFIND_AVX2
+  if (CPU_Is_Avx2_Supported())
+    f = LzFind_Normalize_AVX2;
+  #endif
+  g_LzFind_Normalize = f;
+  g_LzFind_Normalize_WasPrepared = True;
+}
+
+void MatchFinder_Normalize3(UInt32 subValue, CLzRef *items, size_t numItems)
+{
+  g_LzFind_Normalize(subValue, items, numItems);
+}
+
 static void MatchFinder_Normalize(CMatchFinder *p)
 {
   UInt32 subValue = MatchFinder_GetSubValue(p);
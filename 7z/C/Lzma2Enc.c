@@ -372,6 +372,7 @@ typedef struct
   size_t outBufSize;
   size_t outBufsDataSizes[MTCODER__BLOCKS_MAX];
   Bool mtCoder_WasConstructed;
+  Bool mtCoder_WasUsed;
   CMtCoder mtCoder;
   Byte *outBufs[MTCODER__BLOCKS_MAX];
 
@@ -400,6 +401,7 @@ CLzma2EncHandle Lzma2Enc_Create(ISzAllocPtr alloc, ISzAllocPtr allocBig)
   
   #ifndef _7ZIP_ST
   p->mtCoder_WasConstructed = False;
+  p->mtCoder_WasUsed = False;
   {
     unsigned i;
     for (i = 0; i < MTCODER__BLOCKS_MAX; i++)
@@ -720,10 +722,10 @@ SRes Lzma2Enc_Encode2(CLzma2EncHandle pp,
   CLzma2Enc *p = (CLzma2Enc *)pp;
 
   if (inStream && inData)
-    return E_INVALIDARG;
+    return SZ_ERROR_PARAM;
 
   if (outStream && outBuf)
-    return E_INVALIDARG;
+    return SZ_ERROR_PARAM;
 
   {
     unsigned i;
@@ -733,6 +735,8 @@ SRes Lzma2Enc_Encode2(CLzma2EncHandle pp,
 
   #ifndef _7ZIP_ST
   
+  p->mtCoder_WasUsed = False;
+
   if (p->props.numBlockThreads_Reduced > 1)
   {
     IMtCoderCallback2 vt;
@@ -779,6 +783,7 @@ SRes Lzma2Enc_Encode2(CLzma2EncHandle pp,
 
     p->mtCoder.numThreadsMax = p->props.numBlockThreads_Max;
     p->mtCoder.expectedDataSize = p->expectedDataSize;
+    p->mtCoder_WasUsed = True;
     
     {
       SRes res = MtCoder_Code(&p->mtCoder);
@@ -798,3 +803,25 @@ SRes Lzma2Enc_Encode2(CLzma2EncHandle pp,
       True, /* finished */
       progress);
 }
+
+
+Bool Lzma2Enc_GetThreadStat(CLzma2EncHandle pp, unsigned threadIndex, UInt64 *numCodedBlocks, UInt64 *numWindowWaits)
+{
+  #ifndef _7ZIP_ST
+  CLzma2Enc *p = (CLzma2Enc *)pp;
+  CMtCoderThreadStat stat;
+  if (p->mtCoder_WasConstructed && p->mtCoder_WasUsed
+      && MtCoder_GetThreadStat(&p->mtCoder, threadIndex, &stat))
+  {
+    *numCodedBlocks = stat.numCodedBlocks;
+    *numWindowWaits = stat.numWindowWaits;
+    return True;
+  }
+  #else
+  UNUSED_VAR(pp);
+  UNUSED_VAR(threadIndex);
+  #endif
+  *numCodedBlocks = 0;
+  *numWindowWaits = 0;
+  return False;
+}
@@ -50,6 +50,14 @@ SRes Lzma2Enc_Encode2(CLzma2EncHandle p,
     const Byte *inData, size_t inDataSize,
     ICompressProgress *progress);
 
+/* Lzma2Enc_GetThreadStat() returns the counters of thread (threadIndex) for last Lzma2Enc_Encode2() call:
+     numCodedBlocks : the number of blocks coded by thread (busy)
+     numWindowWaits : the number of waits for free block, when all blocks of reorder window were busy (idle)
+   They can be used to tune (numBlockThreads_Max).
+   It returns False, if that thread was not used, or if multithreading was not used. */
+
+Bool Lzma2Enc_GetThreadStat(CLzma2EncHandle p, unsigned threadIndex, UInt64 *numCodedBlocks, UInt64 *numWindowWaits);
+
 EXTERN_C_END
 
 #endif
@@ -3,6 +3,7 @@
 
 #include "Precomp.h"
 
+#include "CpuArch.h"
 #include "LzmaDec.h"
 
 #include <string.h>
@@ -124,6 +125,14 @@ StopCompilingDueBUG
 
 #define LZMA_DIC_MIN (1 << 12)
 
+/* _LZMA_DEC_OPT selects LzmaDec_DecodeReal_3(), that is faster on CPUs with conditional moves.
+   It's enabled by default for x64 and arm64. Define _LZMA_DEC_NO_OPT to use LzmaDec_DecodeReal(). */
+
+#if !defined(_LZMA_DEC_OPT) && !defined(_LZMA_DEC_NO_OPT) && !defined(_LZMA_SIZE_OPT) \
+    && (defined(MY_CPU_AMD64) || defined(MY_CPU_ARM64))
+#define _LZMA_DEC_OPT
+#endif
+
 /* First LZMA-symbol is always decoded.
 And it decodes new LZMA-symbols while (buf < bufLimit), but "buf" is without last normalization
 Out:
@@ -137,6 +146,405 @@ Out:
     = kMatchSpecLenStart + 2 : State Init Marker (unused now)
 */
 
+#ifdef _LZMA_DEC_OPT
+
+/*
+LzmaDec_DecodeReal_3() is an alternative decoder core with the same interface and results as LzmaDec_DecodeReal().
+  - bits that are hard to predict (literals, length trees, pos slots, align bits) are decoded
+    without branches: the decoded bit is converted to (mask) and all updates are masked.
+  - long matches are copied with 8-byte words, if source and destination don't overlap in a word.
+  - the dictionary line of a long-distance match is prefetched before the align bits are decoded.
+*/
+
+#define BL_BIT(p, i) \
+  ttt = *(p); NORMALIZE; bound = (range >> kNumBitModelTotalBits) * ttt; \
+  mask = (UInt32)0 - (UInt32)(code >= bound); \
+  range = bound + ((range - bound - bound) & mask); \
+  code -= bound & mask; \
+  *(p) = (CLzmaProb)(ttt + (((kBitModelTotal - ttt) >> kNumMoveBits) & ~mask) - ((ttt >> kNumMoveBits) & mask)); \
+  i = (i + i) - mask;
+
+#define BL_TREE_GET_BIT(probs, i) { BL_BIT((probs + i), i); }
+
+#define BL_TREE_3_DECODE(probs, i) \
+  { i = 1; \
+  BL_TREE_GET_BIT(probs, i); \
+  BL_TREE_GET_BIT(probs, i); \
+  BL_TREE_GET_BIT(probs, i); }
+
+#define BL_TREE_6_DECODE(probs, i) \
+  { i = 1; \
+  BL_TREE_GET_BIT(probs, i); \
+  BL_TREE_GET_BIT(probs, i); \
+  BL_TREE_GET_BIT(probs, i); \
+  BL_TREE_GET_BIT(probs, i); \
+  BL_TREE_GET_BIT(probs, i); \
+  BL_TREE_GET_BIT(probs, i); \
+  i -= 0x40; }
+
+#define BL_TREE_8_DECODE(probs, i) \
+  { i = 1; \
+  BL_TREE_GET_BIT(probs, i); \
+  BL_TREE_GET_BIT(probs, i); \
+  BL_TREE_GET_BIT(probs, i); \
+  BL_TREE_GET_BIT(probs, i); \
+  BL_TREE_GET_BIT(probs, i); \
+  BL_TREE_GET_BIT(probs, i); \
+  BL_TREE_GET_BIT(probs, i); \
+  BL_TREE_GET_BIT(probs, i); \
+  i -= 0x100; }
+
+/* reverse bit: (i) is tree index, (dist) gets (add) for bit 1 */
+#define BL_REV_BIT(p, i, dist, add) \
+  { unsigned i2 = i; BL_BIT((p) + i2, i2); i = i2; } \
+  dist |= (add) & mask;
+
+#define BL_NORMAL_LITER_DEC BL_BIT(prob + symbol, symbol)
+#define BL_MATCHED_LITER_DEC \
+  matchByte <<= 1; \
+  bit = (matchByte & offs); \
+  probLit = prob + offs + bit + symbol; \
+  BL_BIT(probLit, symbol) \
+  offs &= ~(bit ^ (unsigned)mask);
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define LZMA_PREFETCH(a) __builtin_prefetch(a)
+#elif defined(_MSC_VER) && defined(MY_CPU_X86_OR_AMD64)
+  #include <xmmintrin.h>
+  #define LZMA_PREFETCH(a) _mm_prefetch((const char *)(a), _MM_HINT_T0)
+#else
+  #define LZMA_PREFETCH(a)
+#endif
+
+static int MY_FAST_CALL LzmaDec_DecodeReal_3(CLzmaDec *p, SizeT limit, const Byte *bufLimit)
+{
+  CLzmaProb *probs = p->probs;
+
+  unsigned state = p->state;
+  UInt32 rep0 = p->reps[0], rep1 = p->reps[1], rep2 = p->reps[2], rep3 = p->reps[3];
+  unsigned pbMask = ((unsigned)1 << (p->prop.pb)) - 1;
+  unsigned lpMask = ((unsigned)1 << (p->prop.lp)) - 1;
+  unsigned lc = p->prop.lc;
+
+  Byte *dic = p->dic;
+  SizeT dicBufSize = p->dicBufSize;
+  SizeT dicPos = p->dicPos;
+  
+  UInt32 processedPos = p->processedPos;
+  UInt32 checkDicSize = p->checkDicSize;
+  unsigned len = 0;
+
+  const Byte *buf = p->buf;
+  UInt32 range = p->range;
+  UInt32 code = p->code;
+
+  do
+  {
+    CLzmaProb *prob;
+    UInt32 bound;
+    UInt32 mask;
+    unsigned ttt;
+    unsigned posState = processedPos & pbMask;
+
+    prob = probs + IsMatch + (state << kNumPosBitsMax) + posState;
+    IF_BIT_0(prob)
+    {
+      unsigned symbol;
+      UPDATE_0(prob);
+      prob = probs + Literal;
+      if (processedPos != 0 || checkDicSize != 0)
+        prob += ((UInt32)LZMA_LIT_SIZE * (((processedPos & lpMask) << lc) +
+            (dic[(dicPos == 0 ? dicBufSize : dicPos) - 1] >> (8 - lc))));
+      processedPos++;
+
+      symbol = 1;
+      if (state < kNumLitStates)
+      {
+        state -= (state < 4) ? state : 3;
+        BL_NORMAL_LITER_DEC
+        BL_NORMAL_LITER_DEC
+        BL_NORMAL_LITER_DEC
+        BL_NORMAL_LITER_DEC
+        BL_NORMAL_LITER_DEC
+        BL_NORMAL_LITER_DEC
+        BL_NORMAL_LITER_DEC
+        BL_NORMAL_LITER_DEC
+      }
+      else
+      {
+        unsigned matchByte = dic[dicPos - rep0 + (dicPos < rep0 ? dicBufSize : 0)];
+        unsigned offs = 0x100;
+        unsigned bit;
+        CLzmaProb *probLit;
+        state -= (state < 10) ? 3 : 6;
+        BL_MATCHED_LITER_DEC
+        BL_MATCHED_LITER_DEC
+        BL_MATCHED_LITER_DEC
+        BL_MATCHED_LITER_DEC
+        BL_MATCHED_LITER_DEC
+        BL_MATCHED_LITER_DEC
+        BL_MATCHED_LITER_DEC
+        BL_MATCHED_LITER_DEC
+      }
+
+      dic[dicPos++] = (Byte)symbol;
+      continue;
+    }
+    
+    {
+      UPDATE_1(prob);
+      prob = probs + IsRep + state;
+      IF_BIT_0(prob)
+      {
+        UPDATE_0(prob);
+        state += kNumStates;
+        prob = probs + LenCoder;
+      }
+      else
+      {
+        UPDATE_1(prob);
+        if (checkDicSize == 0 && processedPos == 0)
+          return SZ_ERROR_DATA;
+        prob = probs + IsRepG0 + state;
+        IF_BIT_0(prob)
+        {
+          UPDATE_0(prob);
+          prob = probs + IsRep0Long + (state << kNumPosBitsMax) + posState;
+          IF_BIT_0(prob)
+          {
+            UPDATE_0(prob);
+            dic[dicPos] = dic[dicPos - rep0 + (dicPos < rep0 ? dicBufSize : 0)];
+            dicPos++;
+            processedPos++;
+            state = state < kNumLitStates ? 9 : 11;
+            continue;
+          }
+          UPDATE_1(prob);
+        }
+        else
+        {
+          UInt32 distance;
+          UPDATE_1(prob);
+          prob = probs + IsRepG1 + state;
+          IF_BIT_0(prob)
+          {
+            UPDATE_0(prob);
+            distance = rep1;
+          }
+          else
+          {
+            UPDATE_1(prob);
+            prob = probs + IsRepG2 + state;
+            IF_BIT_0(prob)
+            {
+              UPDATE_0(prob);
+              distance = rep2;
+            }
+            else
+            {
+              UPDATE_1(prob);
+              distance = rep3;
+              rep3 = rep2;
+            }
+            rep2 = rep1;
+          }
+          rep1 = rep0;
+          rep0 = distance;
+        }
+        state = state < kNumLitStates ? 8 : 11;
+        prob = probs + RepLenCoder;
+      }
+      
+      {
+        CLzmaProb *probLen = prob + LenChoice;
+        IF_BIT_0(probLen)
+        {
+          UPDATE_0(probLen);
+          probLen = prob + LenLow + (posState << kLenNumLowBits);
+          BL_TREE_3_DECODE(probLen, len);
+          len -= 8;
+        }
+        else
+        {
+          UPDATE_1(probLen);
+          probLen = prob + LenChoice2;
+          IF_BIT_0(probLen)
+          {
+            UPDATE_0(probLen);
+            probLen = prob + LenMid + (posState << kLenNumMidBits);
+            BL_TREE_3_DECODE(probLen, len);
+          }
+          else
+          {
+            UPDATE_1(probLen);
+            probLen = prob + LenHigh;
+            BL_TREE_8_DECODE(probLen, len);
+            len += kLenNumLowSymbols + kLenNumMidSymbols;
+          }
+        }
+      }
+
+      if (state >= kNumStates)
+      {
+        UInt32 distance;
+        prob = probs + PosSlot +
+            ((len < kNumLenToPosStates ? len : kNumLenToPosStates - 1) << kNumPosSlotBits);
+        BL_TREE_6_DECODE(prob, distance);
+        if (distance >= kStartPosModelIndex)
+        {
+          unsigned posSlot = (unsigned)distance;
+          unsigned numDirectBits = (unsigned)(((distance >> 1) - 1));
+          distance = (2 | (distance & 1));
+          if (posSlot < kEndPosModelIndex)
+          {
+            distance <<= numDirectBits;
+            prob = probs + SpecPos + distance - posSlot - 1;
+            {
+              UInt32 add = 1;
+              unsigned i = 1;
+              do
+              {
+                BL_REV_BIT(prob, i, distance, add);
+                add <<= 1;
+              }
+              while (--numDirectBits != 0);
+            }
+          }
+          else
+          {
+            numDirectBits -= kNumAlignBits;
+            do
+            {
+              NORMALIZE
+              range >>= 1;
+              
+              {
+                UInt32 t;
+                code -= range;
+                t = (0 - ((UInt32)code >> 31)); /* (UInt32)((Int32)code >> 31) */
+                distance = (distance << 1) + (t + 1);
+                code += range & t;
+              }
+            }
+            while (--numDirectBits != 0);
+            distance <<= kNumAlignBits;
+            {
+              /* the low 4 bits are not known yet, but the cache line is known for most matches */
+              SizeT pos = dicPos - distance - 1;
+              if (distance < dicPos)
+                LZMA_PREFETCH(dic + pos);
+              else if (distance < dicBufSize)
+                LZMA_PREFETCH(dic + pos + dicBufSize);
+            }
+            prob = probs + Align;
+            {
+              unsigned i = 1;
+              BL_REV_BIT(prob, i, distance, 1);
+              BL_REV_BIT(prob, i, distance, 2);
+              BL_REV_BIT(prob, i, distance, 4);
+              BL_REV_BIT(prob, i, distance, 8);
+            }
+            if (distance == (UInt32)0xFFFFFFFF)
+            {
+              len += kMatchSpecLenStart;
+              state -= kNumStates;
+              break;
+            }
+          }
+        }
+        
+        rep3 = rep2;
+        rep2 = rep1;
+        rep1 = rep0;
+        rep0 = distance + 1;
+        if (checkDicSize == 0)
+        {
+          if (distance >= processedPos)
+          {
+            p->dicPos = dicPos;
+            return SZ_ERROR_DATA;
+          }
+        }
+        else if (distance >= checkDicSize)
+        {
+          p->dicPos = dicPos;
+          return SZ_ERROR_DATA;
+        }
+        state = (state < kNumStates + kNumLitStates) ? kNumLitStates : kNumLitStates + 3;
+      }
+
+      len += kMatchMinLen;
+
+      {
+        SizeT rem;
+        unsigned curLen;
+        SizeT pos;
+        
+        if ((rem = limit - dicPos) == 0)
+        {
+          p->dicPos = dicPos;
+          return SZ_ERROR_DATA;
+        }
+        
+        curLen = ((rem < len) ? (unsigned)rem : len);
+        pos = dicPos - rep0 + (dicPos < rep0 ? dicBufSize : 0);
+
+        processedPos += curLen;
+
+        len -= curLen;
+        if (curLen <= dicBufSize - pos)
+        {
+          Byte *dest = dic + dicPos;
+          ptrdiff_t src = (ptrdiff_t)pos - (ptrdiff_t)dicPos;
+          const Byte *lim = dest + curLen;
+          dicPos += curLen;
+          #ifdef MY_CPU_LE_UNALIGN
+          /* we read 8 bytes before writing them, so only (rep0 >= 8) is required */
+          if (rep0 >= 8)
+            for (; lim - dest >= 8; dest += 8)
+              SetUi64(dest, GetUi64(dest + src));
+          if (dest != lim)
+          #endif
+          do
+            *(dest) = (Byte)*(dest + src);
+          while (++dest != lim);
+        }
+        else
+        {
+          do
+          {
+            dic[dicPos++] = dic[pos];
+            if (++pos == dicBufSize)
+              pos = 0;
+          }
+          while (--curLen != 0);
+        }
+      }
+    }
+  }
+  while (dicPos < limit && buf < bufLimit);
+
+  NORMALIZE;
+  
+  p->buf = buf;
+  p->range = range;
+  p->code = code;
+  p->remainLen = len;
+  p->dicPos = dicPos;
+  p->processedPos = processedPos;
+  p->reps[0] = rep0;
+  p->reps[1] = rep1;
+  p->reps[2] = rep2;
+  p->reps[3] = rep3;
+  p->state = state;
+
+  return SZ_OK;
+}
+
+#define LZMA_DECODE_REAL LzmaDec_DecodeReal_3
+
+#else
+
 static int MY_FAST_CALL LzmaDec_DecodeReal(CLzmaDec *p, SizeT limit, const Byte *bufLimit)
 {
   CLzmaProb *probs = p->probs;
@@ -512,6 +920,10 @@ static int MY_FAST_CALL LzmaDec_DecodeReal(CLzmaDec *p, SizeT limit, const Byte
   return SZ_OK;
 }
 
+#define LZMA_DECODE_REAL LzmaDec_DecodeReal
+
+#endif
+
 static void MY_FAST_CALL LzmaDec_WriteRem(CLzmaDec *p, SizeT limit)
 {
   if (p->remainLen != 0 && p->remainLen < kMatchSpecLenStart)
@@ -552,7 +964,7 @@ static int MY_FAST_CALL LzmaDec_DecodeReal2(CLzmaDec *p, SizeT limit, const Byte
         limit2 = p->dicPos + rem;
     }
     
-    RINOK(LzmaDec_DecodeReal(p, limit2, bufLimit));
+    RINOK(LZMA_DECODE_REAL(p, limit2, bufLimit));
     
     if (p->checkDicSize == 0 && p->processedPos >= p->prop.dicSize)
       p->checkDicSize = p->prop.dicSize;
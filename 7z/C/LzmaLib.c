@@ -2,10 +2,16 @@
 2015-06-13 : Igor Pavlov : Public domain */
 
 #include "Alloc.h"
+#include "Lzma2Dec.h"
+#include "Lzma2Enc.h"
 #include "LzmaDec.h"
 #include "LzmaEnc.h"
 #include "LzmaLib.h"
 
+#ifndef _7ZIP_ST
+#include "Threads.h"
+#endif
+
 MY_STDAPI LzmaCompress(unsigned char *dest, size_t *destLen, const unsigned char *src, size_t srcLen,
   unsigned char *outProps, size_t *outPropsSize,
   int level, /* 0 <= level <= 9, default = 5 */
@@ -38,3 +44,389 @@ MY_STDAPI LzmaUncompress(unsigned char *dest, size_t *destLen, const unsigned ch
   ELzmaStatus status;
   return LzmaDecode(dest, destLen, src, srcLen, props, (unsigned)propsSize, LZMA_FINISH_ANY, &status, &g_Alloc);
 }
+
+
+#define LZMA2_MT_THREADS_MAX 64
+
+MY_STDAPI Lzma2CompressMt(unsigned char *dest, size_t *destLen, const unsigned char *src, size_t srcLen,
+  unsigned char *outProp,
+  int level,
+  unsigned dictSize,
+  size_t blockSize,
+  int numThreads
+)
+{
+  CLzma2EncProps props;
+  CLzma2EncHandle enc;
+  SRes res;
+
+  if (numThreads <= 0)
+    numThreads = 2;
+  if (numThreads > LZMA2_MT_THREADS_MAX)
+    numThreads = LZMA2_MT_THREADS_MAX;
+
+  Lzma2EncProps_Init(&props);
+  props.lzmaProps.level = level;
+  props.lzmaProps.dictSize = dictSize;
+  props.lzmaProps.reduceSize = srcLen;
+  props.numTotalThreads = numThreads;
+
+  if (blockSize == 0)
+  {
+    /* we don't use LZMA2_ENC_PROPS__BLOCK_SIZE__AUTO here,
+       because it selects solid block for one thread, and solid block can't be decoded in parallel */
+    const UInt32 kMinSize = (UInt32)1 << 20;
+    const UInt32 kMaxSize = (UInt32)1 << 28;
+    CLzmaEncProps lzmaProps = props.lzmaProps;
+    UInt64 size;
+    LzmaEncProps_Normalize(&lzmaProps);
+    size = (UInt64)lzmaProps.dictSize << 2;
+    if (size < kMinSize) size = kMinSize;
+    if (size > kMaxSize) size = kMaxSize;
+    size += (kMinSize - 1);
+    size &= ~(UInt64)(kMinSize - 1);
+    props.blockSize = size;
+  }
+  else
+  {
+    if (blockSize < ((size_t)1 << 16))
+      blockSize = (size_t)1 << 16;
+    props.blockSize = blockSize;
+  }
+
+  enc = Lzma2Enc_Create(&g_Alloc, &g_BigAlloc);
+  if (!enc)
+    return SZ_ERROR_MEM;
+  
+  res = Lzma2Enc_SetProps(enc, &props);
+  if (res == SZ_OK)
+  {
+    Lzma2Enc_SetDataSize(enc, srcLen);
+    *outProp = Lzma2Enc_WriteProperties(enc);
+    res = Lzma2Enc_Encode2(enc, NULL, dest, destLen, NULL, src, srcLen, NULL);
+  }
+  else
+    *destLen = 0;
+  
+  Lzma2Enc_Destroy(enc);
+  return res;
+}
+
+
+/* ---------- Lzma2UncompressMt ---------- */
+
+/*
+  LZMA2 chunk header:
+    0x00             : end marker
+    0x01             : copy chunk with dictionary reset
+    0x02             : copy chunk without dictionary reset
+      2 bytes : (unpackSize - 1)
+    0x80 - 0xFF      : LZMA chunk. bits [5,6] - mode. mode 3 - dictionary reset
+      2 bytes : low bits of (unpackSize - 1) ; bits [0,4] of control are high bits
+      2 bytes : (packSize - 1)
+      1 byte  : lc/lp/pb, if (mode >= 2)
+*/
+
+typedef struct
+{
+  const Byte *src;
+  size_t srcSize;
+  size_t destPos;
+  size_t destSize;
+} CLzma2MtSegment;
+
+/* if (segments == NULL), it only counts the segments */
+
+static SRes Lzma2Mt_Parse(const Byte *src, size_t srcLen, size_t destLen,
+    CLzma2MtSegment *segments, size_t *numSegments,
+    size_t *srcProcessed, size_t *destProcessed)
+{
+  size_t pos = 0;
+  size_t destPos = 0;
+  size_t num = 0;
+
+  for (;;)
+  {
+    unsigned control;
+    size_t headerSize, unpackSize, packSize;
+
+    if (pos == srcLen)
+      return SZ_ERROR_INPUT_EOF;
+    
+    control = src[pos];
+    
+    if (control == 0)
+    {
+      pos++;
+      break;
+    }
+    
+    if (control < 0x80)
+    {
+      if (control > 2)
+        return SZ_ERROR_DATA;
+      headerSize = 3;
+    }
+    else
+      headerSize = 5 + (((control >> 5) & 3) >= 2 ? 1 : 0);
+    
+    if (srcLen - pos < headerSize)
+      return SZ_ERROR_INPUT_EOF;
+    
+    unpackSize = ((size_t)src[pos + 1] << 8) + src[pos + 2] + 1;
+    if (control < 0x80)
+      packSize = unpackSize;
+    else
+    {
+      unpackSize += (size_t)(control & 0x1F) << 16;
+      packSize = ((size_t)src[pos + 3] << 8) + src[pos + 4] + 1;
+    }
+
+    if (control == 1 || control >= 0xE0)
+    {
+      if (segments)
+      {
+        if (num != 0)
+          segments[num - 1].srcSize = (size_t)(src + pos - segments[num - 1].src);
+        segments[num].src = src + pos;
+        segments[num].destPos = destPos;
+      }
+      num++;
+    }
+    else if (num == 0)
+      return SZ_ERROR_DATA;
+
+    pos += headerSize;
+    if (srcLen - pos < packSize)
+      return SZ_ERROR_INPUT_EOF;
+    pos += packSize;
+
+    if (destLen - destPos < unpackSize)
+      return SZ_ERROR_OUTPUT_EOF;
+    destPos += unpackSize;
+
+    if (segments)
+      segments[num - 1].destSize = destPos - segments[num - 1].destPos;
+  }
+
+  if (segments && num != 0)
+    segments[num - 1].srcSize = (size_t)(src + pos - segments[num - 1].src);
+  
+  *numSegments = num;
+  *srcProcessed = pos;
+  *destProcessed = destPos;
+  return SZ_OK;
+}
+
+
+struct CLzma2DecMt_;
+
+typedef struct
+{
+  struct CLzma2DecMt_ *mt;
+  #ifndef _7ZIP_ST
+  CThread thread;
+  #endif
+} CLzma2DecMtThread;
+
+typedef struct CLzma2DecMt_
+{
+  Byte *dest;
+  Byte prop;
+  const CLzma2MtSegment *segments;
+  size_t numSegments;
+  size_t nextSegment;
+  SRes res;
+  #ifndef _7ZIP_ST
+  CCriticalSection cs;
+  #endif
+  CLzma2DecMtThread threads[LZMA2_MT_THREADS_MAX];
+} CLzma2DecMt;
+
+#ifndef _7ZIP_ST
+  #define MT_LOCK(p)    CriticalSection_Enter(&(p)->cs);
+  #define MT_UNLOCK(p)  CriticalSection_Leave(&(p)->cs);
+#else
+  #define MT_LOCK(p)
+  #define MT_UNLOCK(p)
+#endif
+
+
+static SRes Lzma2DecMt_DecodeSegment(CLzma2Dec *dec, Byte *dest, const CLzma2MtSegment *seg)
+{
+  ELzmaStatus status;
+  SizeT srcLen = seg->srcSize;
+  dec->decoder.dic = dest + seg->destPos;
+  dec->decoder.dicBufSize = seg->destSize;
+  Lzma2Dec_Init(dec);
+  /* the last segment ends with end marker, and other segments end at the end of chunk */
+  RINOK(Lzma2Dec_DecodeToDic(dec, seg->destSize, seg->src, &srcLen, LZMA_FINISH_END, &status));
+  if (srcLen != seg->srcSize || dec->decoder.dicPos != seg->destSize)
+    return SZ_ERROR_DATA;
+  return SZ_OK;
+}
+
+
+static void Lzma2DecMt_ThreadLoop(CLzma2DecMt *p)
+{
+  CLzma2Dec dec;
+  SRes res;
+  
+  Lzma2Dec_Construct(&dec);
+  res = Lzma2Dec_AllocateProbs(&dec, p->prop, &g_Alloc);
+  
+  while (res == SZ_OK)
+  {
+    size_t index;
+    
+    MT_LOCK(p)
+    index = p->nextSegment;
+    if (p->res == SZ_OK && index < p->numSegments)
+      p->nextSegment++;
+    else
+      index = p->numSegments;
+    MT_UNLOCK(p)
+    
+    if (index == p->numSegments)
+      break;
+    
+    res = Lzma2DecMt_DecodeSegment(&dec, p->dest, &p->segments[index]);
+  }
+
+  Lzma2Dec_FreeProbs(&dec, &g_Alloc);
+
+  if (res != SZ_OK)
+  {
+    MT_LOCK(p)
+    if (p->res == SZ_OK)
+      p->res = res;
+    MT_UNLOCK(p)
+  }
+}
+
+
+#ifndef _7ZIP_ST
+
+static THREAD_FUNC_DECL Lzma2DecMt_ThreadFunc(void *pp)
+{
+  Lzma2DecMt_ThreadLoop(((CLzma2DecMtThread *)pp)->mt);
+  return 0;
+}
+
+#endif
+
+
+MY_STDAPI Lzma2UncompressMt(unsigned char *dest, size_t *destLen, const unsigned char *src, SizeT *srcLen,
+  unsigned char prop, int numThreads)
+{
+  CLzma2DecMt *p;
+  CLzma2MtSegment *segments;
+  size_t numSegments, srcProcessed, destProcessed;
+  size_t outSize = *destLen;
+  size_t inSize = *srcLen;
+  SRes res;
+
+  *destLen = 0;
+  *srcLen = 0;
+
+  if (prop > 40)
+    return SZ_ERROR_UNSUPPORTED;
+
+  RINOK(Lzma2Mt_Parse(src, inSize, outSize, NULL, &numSegments, &srcProcessed, &destProcessed));
+
+  if (numSegments == 0)
+  {
+    *srcLen = srcProcessed;
+    return SZ_OK;
+  }
+  
+  #ifdef _7ZIP_ST
+  numThreads = 1;
+  #endif
+  
+  if (numThreads > LZMA2_MT_THREADS_MAX)
+    numThreads = LZMA2_MT_THREADS_MAX;
+  if ((size_t)numThreads > numSegments)
+    numThreads = (int)numSegments;
+  if (numThreads <= 0)
+    numThreads = 1;
+
+  segments = (CLzma2MtSegment *)ISzAlloc_Alloc(&g_Alloc, numSegments * sizeof(CLzma2MtSegment));
+  if (!segments)
+    return SZ_ERROR_MEM;
+  p = (CLzma2DecMt *)ISzAlloc_Alloc(&g_Alloc, sizeof(CLzma2DecMt));
+  if (!p)
+  {
+    ISzAlloc_Free(&g_Alloc, segments);
+    return SZ_ERROR_MEM;
+  }
+
+  Lzma2Mt_Parse(src, inSize, outSize, segments, &numSegments, &srcProcessed, &destProcessed);
+
+  p->dest = dest;
+  p->prop = prop;
+  p->segments = segments;
+  p->numSegments = numSegments;
+  p->nextSegment = 0;
+  p->res = SZ_OK;
+
+  {
+    #ifndef _7ZIP_ST
+    
+    int i;
+    
+    if (CriticalSection_Init(&p->cs) != 0)
+      p->res = SZ_ERROR_THREAD;
+    else
+    {
+      /* threads[0] works in the caller's thread */
+      for (i = 1; i < numThreads; i++)
+      {
+        CLzma2DecMtThread *t = &p->threads[i];
+        t->mt = p;
+        Thread_Construct(&t->thread);
+        if (Thread_Create(&t->thread, Lzma2DecMt_ThreadFunc, t) != 0)
+        {
+          Thread_Construct(&t->thread);
+          MT_LOCK(p)
+          p->res = SZ_ERROR_THREAD;
+          MT_UNLOCK(p)
+          numThreads = i;
+          break;
+        }
+      }
+      
+      Lzma2DecMt_ThreadLoop(p);
+      
+      for (i = 1; i < numThreads; i++)
+      {
+        CLzma2DecMtThread *t = &p->threads[i];
+        if (Thread_WasCreated(&t->thread))
+        {
+          Thread_Wait(&t->thread);
+          Thread_Close(&t->thread);
+        }
+      }
+      
+      CriticalSection_Delete(&p->cs);
+    }
+    
+    #else
+    
+    Lzma2DecMt_ThreadLoop(p);
+    
+    #endif
+  }
+
+  res = p->res;
+  
+  ISzAlloc_Free(&g_Alloc, p);
+  ISzAlloc_Free(&g_Alloc, segments);
+
+  if (res == SZ_OK)
+  {
+    *destLen = destProcessed;
+    *srcLen = srcProcessed;
+  }
+  return res;
+}
@@ -126,6 +126,79 @@ Returns:
 MY_STDAPI LzmaUncompress(unsigned char *dest, size_t *destLen, const unsigned char *src, SizeT *srcLen,
   const unsigned char *props, size_t propsSize);
 
+
+/*
+Lzma2CompressMt
+---------------
+
+Lzma2CompressMt writes LZMA2 stream with end marker.
+The data is split to independent blocks (each block starts with dictionary reset).
+The blocks are compressed in parallel, and Lzma2UncompressMt can decompress them in parallel.
+
+outProp - the pointer to 1 byte of LZMA2 properties (dictionary size).
+          Lzma2UncompressMt needs that byte.
+
+level, dictSize - the same meaning as in LzmaCompress.
+
+blockSize - the size of block of input data.
+     0 : default block size (dictSize * 4, 1 MB minimum, 256 MB maximum)
+     Sizes smaller than 64 KB are increased to 64 KB.
+     Each block requires separate memory for encoder (about dictSize * 11.5).
+
+numThreads - the total number of threads: 1 <= numThreads <= 64. The default value is 2.
+     The block threads use (numThreads / 2) threads, if level >= 5 (BT match finder),
+     and numThreads threads otherwise.
+
+Use Lzma2CompressBound(srcLen) as size of dest buffer to avoid SZ_ERROR_OUTPUT_EOF.
+
+Returns:
+  SZ_OK               - OK
+  SZ_ERROR_MEM        - Memory allocation error
+  SZ_ERROR_PARAM      - Incorrect paramater
+  SZ_ERROR_OUTPUT_EOF - output buffer overflow
+  SZ_ERROR_THREAD     - errors in multithreading functions
+*/
+
+#define Lzma2CompressBound(srcLen) ((srcLen) + ((srcLen) >> 10) + 16)
+
+MY_STDAPI Lzma2CompressMt(unsigned char *dest, size_t *destLen, const unsigned char *src, size_t srcLen,
+  unsigned char *outProp, /* 1 byte */
+  int level,          /* 0 <= level <= 9, default = 5 */
+  unsigned dictSize,  /* default = (1 << 24) */
+  size_t blockSize,   /* 0 = default */
+  int numThreads      /* 1 <= numThreads <= 64, default = 2 */
+  );
+
+/*
+Lzma2UncompressMt
+-----------------
+It decodes the blocks that start with dictionary reset in parallel.
+Each thread decodes directly to dest, so no additional buffers are required.
+Stream from one-threaded LZMA2 encoder with solid block is decoded in one thread.
+
+In:
+  dest     - output data
+  destLen  - output data size
+  src      - input data
+  srcLen   - input data size
+  prop     - LZMA2 properties byte
+  numThreads - the number of threads: 1 <= numThreads <= 64
+Out:
+  destLen  - processed output size
+  srcLen   - processed input size (including end marker)
+Returns:
+  SZ_OK                - OK
+  SZ_ERROR_DATA        - Data error
+  SZ_ERROR_MEM         - Memory allocation arror
+  SZ_ERROR_UNSUPPORTED - Unsupported properties
+  SZ_ERROR_INPUT_EOF   - it needs more bytes in input buffer (src)
+  SZ_ERROR_OUTPUT_EOF  - output buffer (dest) is too small for whole stream
+  SZ_ERROR_THREAD      - errors in multithreading functions
+*/
+
+MY_STDAPI Lzma2UncompressMt(unsigned char *dest, size_t *destLen, const unsigned char *src, SizeT *srcLen,
+  unsigned char prop, int numThreads);
+
 EXTERN_C_END
 
 #endif
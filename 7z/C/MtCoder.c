@@ -132,16 +132,75 @@ static void MtCoderThread_Destruct(CMtCoderThread *t)
   }
 
   Event_Close(&t->startEvent);
+}
+
+
+/* input buffers are not released after MtCoder_Code() call (even after error).
+   So next MtCoder_Code() call can reuse them. */
 
-  if (t->inBuf)
+static void MtCoder_FreeInBufs(CMtCoder *p)
+{
+  unsigned i;
+  for (i = 0; i < MTCODER__THREADS_MAX; i++)
   {
-    ISzAlloc_Free(t->mtCoder->allocBig, t->inBuf);
-    t->inBuf = NULL;
+    CMtCoderThread *t = &p->threads[i];
+    if (t->inBuf)
+    {
+      ISzAlloc_Free(p->allocBig, t->inBuf);
+      t->inBuf = NULL;
+    }
   }
+  p->allocatedBufsSize = 0;
 }
 
 
 
+#define FREE_BLOCK_INDEX_MASK  ((UInt32)0xFF)
+#define FREE_BLOCK_TAG_ADD     ((UInt32)0x100)
+
+static unsigned FreeBlocks_Pop(CMtCoder *p)
+{
+  for (;;)
+  {
+    LONG head = p->freeBlockHead;
+    unsigned index = (unsigned)((UInt32)head & FREE_BLOCK_INDEX_MASK);
+    LONG newHead = (LONG)((((UInt32)head + FREE_BLOCK_TAG_ADD) & ~FREE_BLOCK_INDEX_MASK) | p->freeBlockList[index]);
+    if (Interlocked_CompareExchange(&p->freeBlockHead, newHead, head) == head)
+      return index;
+  }
+}
+
+static void FreeBlocks_Push(CMtCoder *p, unsigned index)
+{
+  for (;;)
+  {
+    LONG head = p->freeBlockHead;
+    LONG newHead = (LONG)((((UInt32)head + FREE_BLOCK_TAG_ADD) & ~FREE_BLOCK_INDEX_MASK) | index);
+    p->freeBlockList[index] = (Byte)((UInt32)head & FREE_BLOCK_INDEX_MASK);
+    if (Interlocked_CompareExchange(&p->freeBlockHead, newHead, head) == head)
+      return;
+  }
+}
+
+
+#ifndef MTCODER__USE_WRITE_THREAD
+
+/*
+  blockStates[bi] is changed only with Interlocked_CompareExchange():
+    BLOCK_STATE_EMPTY   : the block is not coded yet, and no thread waits for it
+    BLOCK_STATE_READY   : the block was coded, and the writer will write it later
+    BLOCK_STATE_WAITING : the writer has written all previous blocks and exited.
+                          The thread that finishes that block becomes new writer.
+*/
+
+#define BLOCK_STATE_EMPTY    0
+#define BLOCK_STATE_READY    1
+#define BLOCK_STATE_WAITING  2
+
+#endif
+
+
+
 static SRes FullRead(ISeqInStream *stream, Byte *data, size_t *processedSize)
 {
   size_t size = *processedSize;
@@ -204,7 +263,7 @@ static SRes ThreadFunc2(CMtCoderThread *t)
       {
         if (!t->inBuf)
         {
-          t->inBuf = (Byte *)ISzAlloc_Alloc(mtc->allocBig, mtc->blockSize);
+          t->inBuf = (Byte *)ISzAlloc_Alloc(mtc->allocBig, mtc->allocatedBufsSize);
           if (!t->inBuf)
             res = SZ_ERROR_MEM;
         }
@@ -241,6 +300,11 @@ static SRes ThreadFunc2(CMtCoderThread *t)
 
     res2 = SZ_OK;
 
+    /* it's not exact value, since writer can release block at same time */
+    if (mtc->numReadBlocks - (UInt32)mtc->numReleasedBlocks >= mtc->numBlocksMax)
+      t->stat.numWindowWaits++;
+    mtc->numReadBlocks++;
+
     if (Semaphore_Wait(&mtc->blocksSemaphore) != 0)
     {
       res2 = SZ_ERROR_THREAD;
@@ -290,13 +354,11 @@ static SRes ThreadFunc2(CMtCoderThread *t)
 
     if (res == SZ_OK)
     {
-      CriticalSection_Enter(&mtc->cs);
-      bufIndex = mtc->freeBlockHead;
-      mtc->freeBlockHead = mtc->freeBlockList[bufIndex];
-      CriticalSection_Leave(&mtc->cs);
+      bufIndex = FreeBlocks_Pop(mtc);
       
       res = mtc->mtCallback->Code(mtc->mtCallbackObject, t->index, bufIndex,
           mtc->inStream ? t->inBuf : inData, size, finished);
+      t->stat.numCodedBlocks++;
       
       MtProgress_Reinit(&mtc->mtProgress, t->index);
 
@@ -315,32 +377,31 @@ static SRes ThreadFunc2(CMtCoderThread *t)
       RINOK_THREAD(Event_Set(&mtc->writeEvents[bi]))
     #else
     {
-      unsigned wi;
-      {
-        CriticalSection_Enter(&mtc->cs);
-        wi = mtc->writeIndex;
-        if (wi == bi)
-          mtc->writeIndex = (unsigned)(int)-1;
-        else
-          mtc->ReadyBlocks[bi] = True;
-        CriticalSection_Leave(&mtc->cs);
-      }
+      unsigned wi = bi;
 
-      if (wi != bi)
+      if (Interlocked_CompareExchange(&mtc->blockStates[bi],
+          BLOCK_STATE_READY, BLOCK_STATE_EMPTY) == BLOCK_STATE_EMPTY)
       {
+        /* the writer is busy with previous blocks. It will write our block later */
         if (res != SZ_OK || finished)
           return 0;
         continue;
       }
 
+      /* the writer was waiting for our block. Now we are the writer */
+      mtc->blockStates[bi] = BLOCK_STATE_EMPTY;
+
       if (mtc->writeRes != SZ_OK)
         res = mtc->writeRes;
 
       for (;;)
       {
+        Bool isReady;
+
         if (res == SZ_OK && bufIndex != (unsigned)(int)-1)
         {
           res = mtc->mtCallback->Write(mtc->mtCallbackObject, bufIndex);
+          t->stat.numWrittenBlocks++;
           if (res != SZ_OK)
           {
             mtc->writeRes = res;
@@ -348,33 +409,22 @@ static SRes ThreadFunc2(CMtCoderThread *t)
           }
         }
 
+        if (bufIndex != (unsigned)(int)-1)
+          FreeBlocks_Push(mtc, bufIndex);
+
         if (++wi >= mtc->numBlocksMax)
           wi = 0;
-        {
-          Bool isReady;
 
-          CriticalSection_Enter(&mtc->cs);
-          
-          if (bufIndex != (unsigned)(int)-1)
-          {
-            mtc->freeBlockList[bufIndex] = mtc->freeBlockHead;
-            mtc->freeBlockHead = bufIndex;
-          }
-          
-          isReady = mtc->ReadyBlocks[wi];
-          
-          if (isReady)
-            mtc->ReadyBlocks[wi] = False;
-          else
-            mtc->writeIndex = wi;
-          
-          CriticalSection_Leave(&mtc->cs);
+        isReady = (Interlocked_CompareExchange(&mtc->blockStates[wi],
+            BLOCK_STATE_WAITING, BLOCK_STATE_EMPTY) == BLOCK_STATE_READY);
+        if (isReady)
+          mtc->blockStates[wi] = BLOCK_STATE_EMPTY;
 
-          RINOK_THREAD(Semaphore_Release1(&mtc->blocksSemaphore))
+        Interlocked_Increment(&mtc->numReleasedBlocks);
+        RINOK_THREAD(Semaphore_Release1(&mtc->blocksSemaphore))
 
-          if (!isReady)
-            break;
-        }
+        if (!isReady)
+          break;
 
         {
           CMtCoderBlock *block = &mtc->blocks[wi];
@@ -412,7 +462,7 @@ static THREAD_FUNC_RET_TYPE THREAD_FUNC_CALL_TYPE ThreadFunc(void *pp)
       
       #ifndef MTCODER__USE_WRITE_THREAD
       {
-        unsigned numFinished = (unsigned)InterlockedIncrement(&mtc->numFinishedThreads);
+        unsigned numFinished = (unsigned)Interlocked_Increment(&mtc->numFinishedThreads);
         if (numFinished == mtc->numStartedThreads)
           if (Event_Set(&mtc->finishedEvent) != 0)
             return SZ_ERROR_THREAD;
@@ -443,6 +493,7 @@ void MtCoder_Construct(CMtCoder *p)
   p->mtCallbackObject = NULL;
 
   p->allocatedBufsSize = 0;
+  p->numStartedThreads = 0;
 
   Event_Construct(&p->readEvent);
   Semaphore_Construct(&p->blocksSemaphore);
@@ -454,6 +505,9 @@ void MtCoder_Construct(CMtCoder *p)
     t->index = i;
     t->inBuf = NULL;
     t->stop = False;
+    t->stat.numCodedBlocks = 0;
+    t->stat.numWrittenBlocks = 0;
+    t->stat.numWindowWaits = 0;
     Event_Construct(&t->startEvent);
     Thread_Construct(&t->thread);
   }
@@ -465,7 +519,6 @@ void MtCoder_Construct(CMtCoder *p)
     Event_Construct(&p->finishedEvent);
   #endif
 
-  CriticalSection_Init(&p->cs);
   CriticalSection_Init(&p->mtProgress.cs);
 }
 
@@ -500,8 +553,8 @@ static void MtCoder_Free(CMtCoder *p)
 void MtCoder_Destruct(CMtCoder *p)
 {
   MtCoder_Free(p);
+  MtCoder_FreeInBufs(p);
 
-  CriticalSection_Delete(&p->cs);
   CriticalSection_Delete(&p->mtProgress.cs);
 }
 
@@ -524,20 +577,22 @@ SRes MtCoder_Code(CMtCoder *p)
   if (numBlocksMax > MTCODER__BLOCKS_MAX)
     numBlocksMax = MTCODER__BLOCKS_MAX;
 
-  if (p->blockSize != p->allocatedBufsSize)
+  /* we reuse input buffers of previous call, if block size is not much smaller */
+  if (p->blockSize > p->allocatedBufsSize
+      || p->blockSize < p->allocatedBufsSize / 2)
   {
-    for (i = 0; i < MTCODER__THREADS_MAX; i++)
-    {
-      CMtCoderThread *t = &p->threads[i];
-      if (t->inBuf)
-      {
-        ISzAlloc_Free(p->allocBig, t->inBuf);
-        t->inBuf = NULL;
-      }
-    }
+    MtCoder_FreeInBufs(p);
     p->allocatedBufsSize = p->blockSize;
   }
 
+  for (i = 0; i < MTCODER__THREADS_MAX; i++)
+  {
+    CMtCoderThreadStat *stat = &p->threads[i].stat;
+    stat->numCodedBlocks = 0;
+    stat->numWrittenBlocks = 0;
+    stat->numWindowWaits = 0;
+  }
+
   p->readRes = SZ_OK;
 
   MtProgress_Init(&p->mtProgress, p->progress);
@@ -562,20 +617,23 @@ SRes MtCoder_Code(CMtCoder *p)
   }
 
   for (i = 0; i < MTCODER__BLOCKS_MAX - 1; i++)
-    p->freeBlockList[i] = i + 1;
-  p->freeBlockList[MTCODER__BLOCKS_MAX - 1] = (unsigned)(int)-1;
+    p->freeBlockList[i] = (Byte)(i + 1);
+  p->freeBlockList[MTCODER__BLOCKS_MAX - 1] = (Byte)FREE_BLOCK_INDEX_MASK;
   p->freeBlockHead = 0;
 
   p->readProcessed = 0;
   p->blockIndex = 0;
+  p->numReadBlocks = 0;
+  p->numReleasedBlocks = 0;
   p->numBlocksMax = numBlocksMax;
   p->stopReading = False;
 
   #ifndef MTCODER__USE_WRITE_THREAD
-    p->writeIndex = 0;
     p->writeRes = SZ_OK;
-    for (i = 0; i < MTCODER__BLOCKS_MAX; i++)
-      p->ReadyBlocks[i] = False;
+    /* the writer waits for first block */
+    p->blockStates[0] = BLOCK_STATE_WAITING;
+    for (i = 1; i < MTCODER__BLOCKS_MAX; i++)
+      p->blockStates[i] = BLOCK_STATE_EMPTY;
     p->numFinishedThreads = 0;
   #endif
 
@@ -617,14 +675,10 @@ SRes MtCoder_Code(CMtCoder *p)
               MtProgress_SetError(&p->mtProgress, res);
           }
           
-          CriticalSection_Enter(&p->cs);
-          {
-            p->freeBlockList[bufIndex] = p->freeBlockHead;
-            p->freeBlockHead = bufIndex;
-          }
-          CriticalSection_Leave(&p->cs);
+          FreeBlocks_Push(p, bufIndex);
         }
         
+        Interlocked_Increment(&p->numReleasedBlocks);
         RINOK_THREAD(Semaphore_Release1(&p->blocksSemaphore))
 
         if (finished)
@@ -654,3 +708,12 @@ SRes MtCoder_Code(CMtCoder *p)
     MtCoder_Free(p);
   return res;
 }
+
+
+Bool MtCoder_GetThreadStat(const CMtCoder *p, unsigned threadIndex, CMtCoderThreadStat *stat)
+{
+  if (threadIndex >= p->numStartedThreads)
+    return False;
+  *stat = p->threads[threadIndex].stat;
+  return True;
+}
@@ -14,8 +14,17 @@ EXTERN_C_BEGIN
 */
 /* #define MTCODER__USE_WRITE_THREAD */
 
+/*
+  The number of blocks is the size of reorder window.
+  If some block is coded slowly, another threads can code up to (numBlocks - 1) next blocks,
+  before they wait that slow block to be written.
+  Output buffers are reused in LIFO order, so only the buffers of blocks
+  that are really in progress are allocated.
+  MTCODER__BLOCKS_MAX must be smaller than 255 (the index of free block uses 8 bits).
+*/
+
 #ifndef _7ZIP_ST
-  #define MTCODER__GET_NUM_BLOCKS_FROM_THREADS(numThreads) ((numThreads) + (numThreads) / 8 + 1)
+  #define MTCODER__GET_NUM_BLOCKS_FROM_THREADS(numThreads) ((numThreads) + (numThreads) / 2 + 1)
   #define MTCODER__THREADS_MAX 64
   #define MTCODER__BLOCKS_MAX (MTCODER__GET_NUM_BLOCKS_FROM_THREADS(MTCODER__THREADS_MAX) + 3)
 #else
@@ -56,12 +65,24 @@ void MtProgressThunk_CreateVTable(CMtProgressThunk *p);
 struct _CMtCoder;
 
 
+/* the counters for last MtCoder_Code() call.
+   They can be used to tune the number of threads. */
+
+typedef struct
+{
+  UInt64 numCodedBlocks;    /* busy: the number of blocks coded by thread */
+  UInt64 numWrittenBlocks;  /* the number of blocks written by thread (if not MTCODER__USE_WRITE_THREAD) */
+  UInt64 numWindowWaits;    /* idle: the number of waits for free block, when all blocks of reorder window were busy */
+} CMtCoderThreadStat;
+
+
 typedef struct
 {
   struct _CMtCoder *mtCoder;
   unsigned index;
   int stop;
   Byte *inBuf;
+  CMtCoderThreadStat stat;
 
   CAutoResetEvent startEvent;
   CThread thread;
@@ -118,8 +139,7 @@ typedef struct _CMtCoder
   #else
     CAutoResetEvent finishedEvent;
     SRes writeRes;
-    unsigned writeIndex;
-    Byte ReadyBlocks[MTCODER__BLOCKS_MAX];
+    volatile LONG blockStates[MTCODER__BLOCKS_MAX];
     LONG numFinishedThreads;
   #endif
 
@@ -128,12 +148,15 @@ typedef struct _CMtCoder
 
   unsigned numBlocksMax;
   unsigned blockIndex;
+  UInt32 numReadBlocks;
+  volatile LONG numReleasedBlocks;
   UInt64 readProcessed;
 
-  CCriticalSection cs;
-
-  unsigned freeBlockHead;
-  unsigned freeBlockList[MTCODER__BLOCKS_MAX];
+  /* lock-free LIFO list of free output buffers:
+     (freeBlockHead) contains the index of first free buffer in low 8 bits
+     and the counter of changes in high bits to avoid ABA problem */
+  volatile LONG freeBlockHead;
+  Byte freeBlockList[MTCODER__BLOCKS_MAX];
 
   CMtProgress mtProgress;
   CMtCoderBlock blocks[MTCODER__BLOCKS_MAX];
@@ -145,6 +168,9 @@ void MtCoder_Construct(CMtCoder *p);
 void MtCoder_Destruct(CMtCoder *p);
 SRes MtCoder_Code(CMtCoder *p);
 
+/* it returns False, if thread (threadIndex) was not used in last MtCoder_Code() call */
+Bool MtCoder_GetThreadStat(const CMtCoder *p, unsigned threadIndex, CMtCoderThreadStat *stat);
+
 
 EXTERN_C_END
 
@@ -45,7 +45,7 @@ void Sha256_Init(CSha256 *p)
 #ifdef _SHA256_UNROLL2
 
 #define R(a,b,c,d,e,f,g,h, i) \
-    h += S1(e) + Ch(e,f,g) + K[(i)+(size_t)(j)] + (j ? blk2(i) : blk0(i)); \
+    h += S1(e) + Ch(e,f,g) + SHA256_K_ARRAY[(i)+(size_t)(j)] + (j ? blk2(i) : blk0(i)); \
     d += h; \
     h += S0(a) + Maj(a, b, c)
 
@@ -73,7 +73,7 @@ void Sha256_Init(CSha256 *p)
 #define h(i) T[(7-(i))&7]
 
 #define R(i) \
-    h(i) += S1(e(i)) + Ch(e(i),f(i),g(i)) + K[(i)+(size_t)(j)] + (j ? blk2(i) : blk0(i)); \
+    h(i) += S1(e(i)) + Ch(e(i),f(i),g(i)) + SHA256_K_ARRAY[(i)+(size_t)(j)] + (j ? blk2(i) : blk0(i)); \
     d(i) += h(i); \
     h(i) += S0(a(i)) + Maj(a(i), b(i), c(i)) \
 
@@ -90,7 +90,8 @@ void Sha256_Init(CSha256 *p)
 
 #endif
 
-static const UInt32 K[64] = {
+/* SHA256_K_ARRAY is shared with hardware code in Sha256Opt.c */
+const UInt32 SHA256_K_ARRAY[64] = {
   0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
   0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
   0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
@@ -109,11 +110,12 @@ static const UInt32 K[64] = {
   0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
 };
 
-static void Sha256_WriteByteBlock(CSha256 *p)
+void MY_FAST_CALL Sha256_UpdateBlocks(UInt32 state[8], const Byte *data, size_t numBlocks);
+
+void MY_FAST_CALL Sha256_UpdateBlocks(UInt32 state[8], const Byte *data, size_t numBlocks)
 {
   UInt32 W[16];
   unsigned j;
-  UInt32 *state;
 
   #ifdef _SHA256_UNROLL2
   UInt32 a,b,c,d,e,f,g,h;
@@ -121,49 +123,50 @@ static void Sha256_WriteByteBlock(CSha256 *p)
   UInt32 T[8];
   #endif
 
-  for (j = 0; j < 16; j += 4)
+  for (; numBlocks != 0; numBlocks--, data += SHA256_BLOCK_SIZE)
   {
-    const Byte *ccc = p->buffer + j * 4;
-    W[j    ] = GetBe32(ccc);
-    W[j + 1] = GetBe32(ccc + 4);
-    W[j + 2] = GetBe32(ccc + 8);
-    W[j + 3] = GetBe32(ccc + 12);
-  }
-
-  state = p->state;
+    for (j = 0; j < 16; j += 4)
+    {
+      const Byte *ccc = data + j * 4;
+      W[j    ] = GetBe32(ccc);
+      W[j + 1] = GetBe32(ccc + 4);
+      W[j + 2] = GetBe32(ccc + 8);
+      W[j + 3] = GetBe32(ccc + 12);
+    }
 
-  #ifdef _SHA256_UNROLL2
-  a = state[0];
-  b = state[1];
-  c = state[2];
-  d = state[3];
-  e = state[4];
-  f = state[5];
-  g = state[6];
-  h = state[7];
-  #else
-  for (j = 0; j < 8; j++)
-    T[j] = state[j];
-  #endif
+    #ifdef _SHA256_UNROLL2
+    a = state[0];
+    b = state[1];
+    c = state[2];
+    d = state[3];
+    e = state[4];
+    f = state[5];
+    g = state[6];
+    h = state[7];
+    #else
+    for (j = 0; j < 8; j++)
+      T[j] = state[j];
+    #endif
+
+    for (j = 0; j < 64; j += 16)
+    {
+      RX_16
+    }
 
-  for (j = 0; j < 64; j += 16)
-  {
-    RX_16
+    #ifdef _SHA256_UNROLL2
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+    #else
+    for (j = 0; j < 8; j++)
+      state[j] += T[j];
+    #endif
   }
-
-  #ifdef _SHA256_UNROLL2
-  state[0] += a;
-  state[1] += b;
-  state[2] += c;
-  state[3] += d;
-  state[4] += e;
-  state[5] += f;
-  state[6] += g;
-  state[7] += h;
-  #else
-  for (j = 0; j < 8; j++)
-    state[j] += T[j];
-  #endif
   
   /* Wipe variables */
   /* memset(W, 0, sizeof(W)); */
@@ -175,6 +178,20 @@ static void Sha256_WriteByteBlock(CSha256 *p)
 #undef s0
 #undef s1
 
+void MY_FAST_CALL Sha256_UpdateBlocks_HW(UInt32 state[8], const Byte *data, size_t numBlocks);
+
+static SHA256_FUNC_UPDATE_BLOCKS g_Sha256_UpdateBlocks = Sha256_UpdateBlocks;
+
+void Sha256Prepare(void)
+{
+  SHA256_FUNC_UPDATE_BLOCKS f = Sha256_UpdateBlocks;
+  #if defined(MY_CPU_X86_OR_AMD64) || defined(MY_CPU_ARM64)
+  if (CPU_Is_Sha256_Supported())
+    f = Sha256_UpdateBlocks_HW;
+  #endif
+  g_Sha256_UpdateBlocks = f;
+}
+
 void Sha256_Update(CSha256 *p, const Byte *data, size_t size)
 {
   if (size == 0)
@@ -198,14 +215,17 @@ void Sha256_Update(CSha256 *p, const Byte *data, size_t size)
     data += num;
   }
 
-  for (;;)
+  g_Sha256_UpdateBlocks(p->state, p->buffer, 1);
+
   {
-    Sha256_WriteByteBlock(p);
-    if (size < 64)
-      break;
-    size -= 64;
-    memcpy(p->buffer, data, 64);
-    data += 64;
+    size_t numBlocks = size / SHA256_BLOCK_SIZE;
+    if (numBlocks != 0)
+    {
+      g_Sha256_UpdateBlocks(p->state, data, numBlocks);
+      numBlocks *= SHA256_BLOCK_SIZE;
+      data += numBlocks;
+      size -= numBlocks;
+    }
   }
 
   if (size != 0)
@@ -223,7 +243,7 @@ void Sha256_Final(CSha256 *p, Byte *digest)
   {
     pos &= 0x3F;
     if (pos == 0)
-      Sha256_WriteByteBlock(p);
+      g_Sha256_UpdateBlocks(p->state, p->buffer, 1);
     p->buffer[pos++] = 0;
   }
 
@@ -233,7 +253,7 @@ void Sha256_Final(CSha256 *p, Byte *digest)
     SetBe32(p->buffer + 64 - 4, (UInt32)(numBits));
   }
   
-  Sha256_WriteByteBlock(p);
+  g_Sha256_UpdateBlocks(p->state, p->buffer, 1);
 
   for (i = 0; i < 8; i += 2)
   {
@@ -9,6 +9,10 @@
 EXTERN_C_BEGIN
 
 #define SHA256_DIGEST_SIZE 32
+#define SHA256_BLOCK_SIZE 64
+
+/* processes (numBlocks) 64-byte blocks from (data) */
+typedef void (MY_FAST_CALL *SHA256_FUNC_UPDATE_BLOCKS)(UInt32 state[8], const Byte *data, size_t numBlocks);
 
 typedef struct
 {
@@ -21,6 +25,10 @@ void Sha256_Init(CSha256 *p);
 void Sha256_Update(CSha256 *p, const Byte *data, size_t size);
 void Sha256_Final(CSha256 *p, Byte *digest);
 
+/* Sha256Prepare() selects hardware SHA-256 code, if it's supported by CPU.
+   Call it one time before other Sha256 functions. Without it, portable code is used. */
+void Sha256Prepare(void);
+
 EXTERN_C_END
 
 #endif
@@ -0,0 +1,228 @@
+/* Sha256Opt.c -- SHA-256 code for hardware SHA instructions (x86 SHA extensions, ARMv8 Crypto)
+Public domain */
+
+#include "Precomp.h"
+
+#include "CpuArch.h"
+
+#ifdef MY_CPU_X86_OR_AMD64
+  #if defined(__clang__)
+    #if (__clang_major__ >= 8)
+      #define USE_HW_SHA
+      #define ATTRIB_SHA __attribute__((__target__("sha,ssse3,sse4.1")))
+    #endif
+  #elif defined(__GNUC__)
+    #if (__GNUC__ >= 8)
+      #define USE_HW_SHA
+      #define ATTRIB_SHA __attribute__((__target__("sha,ssse3,sse4.1")))
+    #endif
+  #elif defined(_MSC_VER)
+    #if (_MSC_VER >= 1900)
+      #define USE_HW_SHA
+    #endif
+  #endif
+#elif defined(MY_CPU_ARM64)
+  #if defined(__ARM_FEATURE_CRYPTO)
+    #define USE_HW_SHA
+  #elif defined(__clang__)
+    #if (__clang_major__ >= 8)
+      #define USE_HW_SHA
+      #define ATTRIB_SHA __attribute__((__target__("crypto")))
+    #endif
+  #elif defined(__GNUC__)
+    #if (__GNUC__ >= 8)
+      #define USE_HW_SHA
+      #define ATTRIB_SHA __attribute__((__target__("+crypto")))
+    #endif
+  #elif defined(_MSC_VER)
+    #if (_MSC_VER >= 1910)
+      #define USE_HW_SHA
+    #endif
+  #endif
+#endif
+
+#ifndef ATTRIB_SHA
+#define ATTRIB_SHA
+#endif
+
+#ifdef USE_HW_SHA
+
+extern const UInt32 SHA256_K_ARRAY[64];
+
+#define K SHA256_K_ARRAY
+
+#ifdef MY_CPU_X86_OR_AMD64
+
+#include <immintrin.h>
+
+/*
+  state0 holds (A,B,E,F) and state1 holds (C,D,G,H) words, as sha256rnds2 requires.
+  msg holds 4 message words (big-endian words loaded as little-endian and byte-swapped).
+*/
+
+#define LOAD_SHUFFLE(m, k) \
+    m = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(const void *)(data + (k) * 16)), mask);
+
+/* W[i] = sigma1(W[i-2]) + W[i-7] + sigma0(W[i-15]) + W[i-16] for (m0 = W[i-16 .. i-13]) */
+#define SM1(m0, m1) \
+    m0 = _mm_sha256msg1_epu32(m0, m1);
+
+#define SM2(m0, m2, m3) \
+    m0 = _mm_add_epi32(m0, _mm_alignr_epi8(m3, m2, 4)); \
+    m0 = _mm_sha256msg2_epu32(m0, m3);
+
+#define R4(k, m) \
+    msg = _mm_add_epi32(m, _mm_loadu_si128((const __m128i *)(const void *)&K[(k) * 4])); \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+    msg = _mm_shuffle_epi32(msg, 0x0E); \
+    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+#define R4_SCHED(k, m0, m1, m2, m3) \
+    SM1(m0, m1) \
+    SM2(m0, m2, m3) \
+    R4(k, m0)
+
+#define R16_SCHED(k) \
+    R4_SCHED((k) + 0, m0, m1, m2, m3) \
+    R4_SCHED((k) + 1, m1, m2, m3, m0) \
+    R4_SCHED((k) + 2, m2, m3, m0, m1) \
+    R4_SCHED((k) + 3, m3, m0, m1, m2)
+
+void MY_FAST_CALL Sha256_UpdateBlocks_HW(UInt32 state[8], const Byte *data, size_t numBlocks);
+
+ATTRIB_SHA
+void MY_FAST_CALL Sha256_UpdateBlocks_HW(UInt32 state[8], const Byte *data, size_t numBlocks)
+{
+  const __m128i mask = _mm_set_epi32(0x0c0d0e0f, 0x08090a0b, 0x04050607, 0x00010203);
+  __m128i tmp, state0, state1;
+
+  if (numBlocks == 0)
+    return;
+
+  tmp    = _mm_loadu_si128((const __m128i *)(const void *)&state[0]); /* DCBA */
+  state1 = _mm_loadu_si128((const __m128i *)(const void *)&state[4]); /* HGFE */
+  tmp    = _mm_shuffle_epi32(tmp, 0xB1);          /* CDAB */
+  state1 = _mm_shuffle_epi32(state1, 0x1B);       /* EFGH */
+  state0 = _mm_alignr_epi8(tmp, state1, 8);       /* ABEF */
+  state1 = _mm_blend_epi16(state1, tmp, 0xF0);    /* CDGH */
+
+  do
+  {
+    const __m128i state0_save = state0;
+    const __m128i state1_save = state1;
+    __m128i msg, m0, m1, m2, m3;
+
+    LOAD_SHUFFLE (m0, 0)
+    LOAD_SHUFFLE (m1, 1)
+    LOAD_SHUFFLE (m2, 2)
+    LOAD_SHUFFLE (m3, 3)
+
+    R4(0, m0)
+    R4(1, m1)
+    R4(2, m2)
+    R4(3, m3)
+
+    R16_SCHED(4)
+    R16_SCHED(8)
+    R16_SCHED(12)
+
+    state0 = _mm_add_epi32(state0, state0_save);
+    state1 = _mm_add_epi32(state1, state1_save);
+
+    data += 64;
+  }
+  while (--numBlocks);
+
+  tmp    = _mm_shuffle_epi32(state0, 0x1B);       /* FEBA */
+  state1 = _mm_shuffle_epi32(state1, 0xB1);       /* DCHG */
+  state0 = _mm_blend_epi16(tmp, state1, 0xF0);    /* DCBA */
+  state1 = _mm_alignr_epi8(state1, tmp, 8);       /* HGFE */
+
+  _mm_storeu_si128((__m128i *)(void *)&state[0], state0);
+  _mm_storeu_si128((__m128i *)(void *)&state[4], state1);
+}
+
+#else /* MY_CPU_ARM64 */
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <arm64_neon.h>
+#else
+#include <arm_neon.h>
+#endif
+
+#define LOAD_SHUFFLE(m, k) \
+    m = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + (k) * 16)));
+
+#define R4(k, m) \
+    msg = vaddq_u32(m, vld1q_u32(&K[(k) * 4])); \
+    tmp = state0; \
+    state0 = vsha256hq_u32(state0, state1, msg); \
+    state1 = vsha256h2q_u32(state1, tmp, msg);
+
+#define R4_SCHED(k, m0, m1, m2, m3) \
+    m0 = vsha256su1q_u32(vsha256su0q_u32(m0, m1), m2, m3); \
+    R4(k, m0)
+
+#define R16_SCHED(k) \
+    R4_SCHED((k) + 0, m0, m1, m2, m3) \
+    R4_SCHED((k) + 1, m1, m2, m3, m0) \
+    R4_SCHED((k) + 2, m2, m3, m0, m1) \
+    R4_SCHED((k) + 3, m3, m0, m1, m2)
+
+void MY_FAST_CALL Sha256_UpdateBlocks_HW(UInt32 state[8], const Byte *data, size_t numBlocks);
+
+ATTRIB_SHA
+void MY_FAST_CALL Sha256_UpdateBlocks_HW(UInt32 state[8], const Byte *data, size_t numBlocks)
+{
+  uint32x4_t state0, state1;
+
+  if (numBlocks == 0)
+    return;
+
+  state0 = vld1q_u32(&state[0]);
+  state1 = vld1q_u32(&state[4]);
+
+  do
+  {
+    const uint32x4_t state0_save = state0;
+    const uint32x4_t state1_save = state1;
+    uint32x4_t msg, tmp, m0, m1, m2, m3;
+
+    LOAD_SHUFFLE (m0, 0)
+    LOAD_SHUFFLE (m1, 1)
+    LOAD_SHUFFLE (m2, 2)
+    LOAD_SHUFFLE (m3, 3)
+
+    R4(0, m0)
+    R4(1, m1)
+    R4(2, m2)
+    R4(3, m3)
+
+    R16_SCHED(4)
+    R16_SCHED(8)
+    R16_SCHED(12)
+
+    state0 = vaddq_u32(state0, state0_save);
+    state1 = vaddq_u32(state1, state1_save);
+
+    data += 64;
+  }
+  while (--numBlocks);
+
+  vst1q_u32(&state[0], state0);
+  vst1q_u32(&state[4], state1);
+}
+
+#endif
+
+#else
+
+void MY_FAST_CALL Sha256_UpdateBlocks(UInt32 state[8], const Byte *data, size_t numBlocks);
+void MY_FAST_CALL Sha256_UpdateBlocks_HW(UInt32 state[8], const Byte *data, size_t numBlocks);
+
+void MY_FAST_CALL Sha256_UpdateBlocks_HW(UInt32 state[8], const Byte *data, size_t numBlocks)
+{
+  Sha256_UpdateBlocks(state, data, numBlocks);
+}
+
+#endif
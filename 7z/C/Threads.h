@@ -63,6 +63,19 @@ WRes CriticalSection_Init(CCriticalSection *p);
 #define CriticalSection_Enter(p) EnterCriticalSection(p)
 #define CriticalSection_Leave(p) LeaveCriticalSection(p)
 
+/* atomic operations for (volatile LONG) variables.
+   They return same values as Win32 functions:
+     Interlocked_CompareExchange() returns initial value of (*p)
+     Interlocked_Increment() returns new value of (*p) */
+
+#ifdef _WIN32
+#define Interlocked_CompareExchange(p, exchange, comparand) InterlockedCompareExchange(p, exchange, comparand)
+#define Interlocked_Increment(p) InterlockedIncrement(p)
+#else
+#define Interlocked_CompareExchange(p, exchange, comparand) __sync_val_compare_and_swap(p, comparand, exchange)
+#define Interlocked_Increment(p) __sync_add_and_fetch(p, 1)
+#endif
+
 EXTERN_C_END
 
 #endif
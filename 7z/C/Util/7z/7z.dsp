@@ -104,6 +104,10 @@ SOURCE=..\..\7zArcIn.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\7zArcMt.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\7zBuf.c
 # End Source File
 # Begin Source File
@@ -215,6 +219,14 @@ SOURCE=..\..\Ppmd7.h
 
 SOURCE=..\..\Ppmd7Dec.c
 # End Source File
+# Begin Source File
+
+SOURCE=..\..\Threads.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Threads.h
+# End Source File
 # End Group
 # Begin Group "Spec"
 
@@ -4,7 +4,9 @@
 #include "Precomp.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "../../CpuArch.h"
 
@@ -28,6 +30,8 @@
 
 #define kInputBufSize ((size_t)1 << 18)
 
+#define kBenchCacheSizeDefault ((size_t)1 << 28)
+
 static const ISzAlloc g_Alloc = { SzAlloc, SzFree };
 
 
@@ -224,6 +228,25 @@ static WRes MyCreateDir(const UInt16 *name)
   #endif
 }
 
+static WRes MyDeleteFile(const UInt16 *name)
+{
+  #ifdef USE_WINDOWS_FILE
+  
+  return DeleteFileW(name) ? 0 : GetLastError();
+  
+  #else
+
+  CBuf buf;
+  WRes res;
+  Buf_Init(&buf);
+  RINOK(Utf16_To_Char(&buf, name MY_FILE_CODE_PAGE_PARAM));
+  res = remove((const char *)buf.data) == 0 ? 0 : errno;
+  Buf_Free(&buf, &g_Alloc);
+  return res;
+  
+  #endif
+}
+
 static WRes OutFile_OpenUtf16(CSzFile *p, const UInt16 *name)
 {
   #ifdef USE_WINDOWS_FILE
@@ -370,12 +393,321 @@ static void GetAttribString(UInt32 wa, Bool isDir, char *s)
 }
 
 
+/* it creates parent directories (if fullPaths) and returns the name for output file */
+
+static const UInt16 *PrepareDestPath(UInt16 *name, int fullPaths)
+{
+  const UInt16 *destPath = (const UInt16 *)name;
+  size_t j;
+  for (j = 0; name[j] != 0; j++)
+    if (name[j] == '/')
+    {
+      if (fullPaths)
+      {
+        name[j] = 0;
+        MyCreateDir(name);
+        name[j] = CHAR_PATH_SEPARATOR;
+      }
+      else
+        destPath = name + j + 1;
+    }
+  return destPath;
+}
+
+static void SetFileAttrib(const CSzArEx *db, UInt32 i, const UInt16 *destPath)
+{
+  #ifdef USE_WINDOWS_FILE
+  if (SzBitWithVals_Check(&db->Attribs, i))
+  {
+    UInt32 attrib = db->Attribs.Vals[i];
+    /* p7zip stores posix attributes in high 16 bits and adds 0x8000 as marker.
+       We remove posix bits, if we detect posix mode field */
+    if ((attrib & 0xF0000000) != 0)
+      attrib &= 0x7FFF;
+    SetFileAttributesW(destPath, attrib);
+  }
+  #else
+  UNUSED_VAR(db);
+  UNUSED_VAR(i);
+  UNUSED_VAR(destPath);
+  #endif
+}
+
+
+static size_t NullOutStream_Write(const ISeqOutStream *p, const void *data, size_t size)
+{
+  UNUSED_VAR(p);
+  UNUSED_VAR(data);
+  return size;
+}
+
+
+static void PrintBenchResult(const char *name, clock_t startTime, UInt64 totalSize)
+{
+  char s[32];
+  UInt64 ms = (UInt64)(clock() - startTime) * 1000 / CLOCKS_PER_SEC;
+  Print(name);
+  UInt64ToStr(ms, s, 8);
+  Print(s);
+  Print(" ms");
+  if (ms != 0)
+  {
+    UInt64ToStr(totalSize / ms * 1000 >> 20, s, 8);
+    Print(s);
+    Print(" MB/s");
+  }
+  PrintLF();
+}
+
+
+/*
+  Bench_Shuffled tests all files in shuffled order:
+    1) with SzArEx_Extract() that caches one solid block
+    2) with SzArEx_ExtractCached() that caches several solid blocks (LRU)
+*/
+
+static SRes Bench_Shuffled(const CSzArEx *db, ILookInStream *inStream, size_t cacheSize,
+    ISzAllocPtr allocMain, ISzAllocPtr allocTemp)
+{
+  UInt32 *order;
+  UInt32 numFiles = 0;
+  UInt32 i;
+  UInt32 rnd = 1;
+  UInt64 totalSize = 0;
+  SRes res = SZ_OK;
+  clock_t startTime;
+  char s[32];
+
+  order = (UInt32 *)ISzAlloc_Alloc(allocMain, (db->NumFiles + 1) * sizeof(UInt32));
+  if (!order)
+    return SZ_ERROR_MEM;
+
+  for (i = 0; i < db->NumFiles; i++)
+    if (!SzArEx_IsDir(db, i))
+    {
+      order[numFiles++] = i;
+      totalSize += SzArEx_GetFileSize(db, i);
+    }
+
+  for (i = numFiles; i > 1; i--)
+  {
+    UInt32 j, temp;
+    rnd = rnd * 1103515245 + 12345;
+    j = (rnd >> 8) % i;
+    temp = order[i - 1];
+    order[i - 1] = order[j];
+    order[j] = temp;
+  }
+
+  UInt64ToStr(numFiles, s, 0);
+  Print("Files: ");
+  Print(s);
+  UInt64ToStr(db->db.NumFolders, s, 0);
+  Print("  Solid blocks: ");
+  Print(s);
+  UInt64ToStr(cacheSize >> 20, s, 0);
+  Print("  Cache: ");
+  Print(s);
+  Print(" MB\n\n");
+
+  {
+    UInt32 blockIndex = 0xFFFFFFFF;
+    Byte *outBuffer = NULL;
+    size_t outBufferSize = 0;
+    startTime = clock();
+    for (i = 0; i < numFiles && res == SZ_OK; i++)
+    {
+      size_t offset, outSizeProcessed;
+      res = SzArEx_Extract(db, inStream, order[i],
+          &blockIndex, &outBuffer, &outBufferSize,
+          &offset, &outSizeProcessed,
+          allocMain, allocTemp);
+    }
+    ISzAlloc_Free(allocMain, outBuffer);
+    if (res == SZ_OK)
+      PrintBenchResult("SzArEx_Extract       :", startTime, totalSize);
+  }
+
+  if (res == SZ_OK)
+  {
+    CSzFolderCache cache;
+    SzFolderCache_Init(&cache, cacheSize);
+    startTime = clock();
+    for (i = 0; i < numFiles && res == SZ_OK; i++)
+    {
+      const Byte *data;
+      size_t size;
+      res = SzArEx_ExtractCached(db, inStream, order[i], &cache,
+          &data, &size, allocMain, allocTemp);
+    }
+    SzFolderCache_Free(&cache, allocMain);
+    if (res == SZ_OK)
+      PrintBenchResult("SzArEx_ExtractCached :", startTime, totalSize);
+  }
+
+  ISzAlloc_Free(allocMain, order);
+  return res;
+}
+
+
+typedef struct
+{
+  ISzFileSink vt;
+  const CSzArEx *db;
+  int testCommand;
+  int fullPaths;
+  UInt16 *temp;
+  size_t tempSize;
+} CExtractSink;
+
+/* SzArEx_ExtractAllMt() serializes the calls, and it checks CRC before the call,
+   so we write whole file here and we never leave partial file on disk */
+
+static SRes ExtractSink_Write(const ISzFileSink *pp, UInt32 i, const Byte *data, size_t size)
+{
+  CExtractSink *p = CONTAINER_FROM_VTBL(pp, CExtractSink, vt);
+  const CSzArEx *db = p->db;
+  unsigned isDir = SzArEx_IsDir(db, i);
+  size_t len;
+
+  if (isDir && !p->fullPaths)
+    return SZ_OK;
+  
+  len = SzArEx_GetFileNameUtf16(db, i, NULL);
+  if (len > p->tempSize)
+  {
+    SzFree(NULL, p->temp);
+    p->tempSize = 0;
+    p->temp = (UInt16 *)SzAlloc(NULL, len * sizeof(p->temp[0]));
+    if (!p->temp)
+      return SZ_ERROR_MEM;
+    p->tempSize = len;
+  }
+  SzArEx_GetFileNameUtf16(db, i, p->temp);
+
+  Print(p->testCommand ?
+      "Testing    ":
+      "Extracting ");
+  RINOK(PrintString(p->temp));
+  if (isDir)
+    Print("/");
+  
+  if (!p->testCommand)
+  {
+    const UInt16 *destPath = PrepareDestPath(p->temp, p->fullPaths);
+    if (isDir)
+      MyCreateDir(destPath);
+    else
+    {
+      CSzFile outFile;
+      size_t processedSize = size;
+      if (OutFile_OpenUtf16(&outFile, destPath))
+      {
+        PrintError("can not open output file");
+        return SZ_ERROR_FAIL;
+      }
+      if (size != 0 && (File_Write(&outFile, data, &processedSize) != 0 || processedSize != size))
+      {
+        File_Close(&outFile);
+        MyDeleteFile(destPath);
+        PrintError("can not write output file");
+        return SZ_ERROR_FAIL;
+      }
+      if (File_Close(&outFile))
+      {
+        PrintError("can not close output file");
+        return SZ_ERROR_FAIL;
+      }
+      SetFileAttrib(db, i, destPath);
+    }
+  }
+  PrintLF();
+  return SZ_OK;
+}
+
+
+/*
+  ExtractAll_Mt opens additional stream for each additional thread.
+  If it can't open the stream or allocate the buffer, it uses fewer threads.
+*/
+
+static SRes ExtractAll_Mt(const CSzArEx *db, const char *archiveName, ILookInStream *lookStream,
+    unsigned numThreads, int testCommand, int fullPaths,
+    ISzAllocPtr allocMain, ISzAllocPtr allocTemp)
+{
+  CFileInStream archiveStreams[SZ_EXTRACT_MT_THREADS_MAX];
+  CLookToRead2 lookStreams[SZ_EXTRACT_MT_THREADS_MAX];
+  ILookInStream *inStreams[SZ_EXTRACT_MT_THREADS_MAX];
+  ISzAllocPtr allocTemps[SZ_EXTRACT_MT_THREADS_MAX];
+  CExtractSink sink;
+  unsigned i;
+  SRes res;
+
+  #ifdef UNDER_CE
+  UNUSED_VAR(archiveName);
+  #endif
+
+  if (numThreads > SZ_EXTRACT_MT_THREADS_MAX)
+    numThreads = SZ_EXTRACT_MT_THREADS_MAX;
+  
+  /* the stream of caller is used by first thread */
+  inStreams[0] = lookStream;
+  allocTemps[0] = allocTemp;
+  
+  for (i = 1; i < numThreads; i++)
+  {
+    CFileInStream *fs = &archiveStreams[i];
+    CLookToRead2 *ls = &lookStreams[i];
+    #ifdef UNDER_CE
+    if (InFile_OpenW(&fs->file, L"\test.7z"))
+    #else
+    if (InFile_Open(&fs->file, archiveName))
+    #endif
+      break;
+    FileInStream_CreateVTable(fs);
+    LookToRead2_CreateVTable(ls, False);
+    ls->buf = (Byte *)ISzAlloc_Alloc(allocMain, kInputBufSize);
+    if (!ls->buf)
+    {
+      File_Close(&fs->file);
+      break;
+    }
+    ls->bufSize = kInputBufSize;
+    ls->realStream = &fs->vt;
+    LookToRead2_Init(ls);
+    inStreams[i] = &ls->vt;
+    allocTemps[i] = allocTemp;
+  }
+  numThreads = i;
+
+  sink.vt.Write = ExtractSink_Write;
+  sink.db = db;
+  sink.testCommand = testCommand;
+  sink.fullPaths = fullPaths;
+  sink.temp = NULL;
+  sink.tempSize = 0;
+
+  res = SzArEx_ExtractAllMt(db, numThreads, inStreams, allocTemps, &sink.vt, allocMain);
+
+  SzFree(NULL, sink.temp);
+  
+  for (i = 1; i < numThreads; i++)
+  {
+    ISzAlloc_Free(allocMain, lookStreams[i].buf);
+    File_Close(&archiveStreams[i].file);
+  }
+  
+  return res;
+}
+
+
 // #define NUM_PARENTS_MAX 128
 
 int MY_CDECL main(int numargs, char *args[])
 {
   ISzAlloc allocImp;
   ISzAlloc allocTempImp;
+  CSzAllocArena allocDbImp;
 
   CFileInStream archiveStream;
   CLookToRead2 lookStream;
@@ -390,12 +722,15 @@ int MY_CDECL main(int numargs, char *args[])
   if (numargs == 1)
   {
     Print(
-      "Usage: 7zDec <command> <archive_name>\n\n"
+      "Usage: 7zDec <command> <archive_name> [cache_size_MB | -mt<N>]\n\n"
       "<Commands>\n"
+      "  b: Benchmark: test files in shuffled order with solid block cache\n"
       "  e: Extract files from archive (without using directory names)\n"
       "  l: List contents of archive\n"
       "  t: Test integrity of archive\n"
-      "  x: eXtract files with full paths\n");
+      "  x: eXtract files with full paths\n"
+      "<Switches>\n"
+      "  -mt<N>: decode solid blocks in N threads (for e, t, x commands)\n");
     return 0;
   }
 
@@ -412,6 +747,7 @@ int MY_CDECL main(int numargs, char *args[])
 
   allocImp = g_Alloc;
   allocTempImp = g_Alloc;
+  SzAllocArena_Init(&allocDbImp, &allocImp, 0);
 
   #ifdef UNDER_CE
   if (InFile_OpenW(&archiveStream.file, L"\test.7z"))
@@ -447,15 +783,31 @@ int MY_CDECL main(int numargs, char *args[])
     
   if (res == SZ_OK)
   {
-    res = SzArEx_Open(&db, &lookStream.vt, &allocImp, &allocTempImp);
+    res = SzArEx_Open(&db, &lookStream.vt, &allocDbImp.vt, &allocTempImp);
   }
   
   if (res == SZ_OK)
   {
     char *command = args[1];
     int listCommand = 0, testCommand = 0, fullPaths = 0;
+    unsigned numThreads = 0;
+
+    if (numargs > 3 && strncmp(args[3], "-mt", 3) == 0)
+    {
+      numThreads = (unsigned)atoi(args[3] + 3);
+      if (numThreads == 0)
+        numThreads = 1;
+    }
     
-    if (strcmp(command, "l") == 0) listCommand = 1;
+    if (strcmp(command, "b") == 0)
+    {
+      size_t cacheSize = kBenchCacheSizeDefault;
+      if (numargs > 3 && numThreads == 0)
+        cacheSize = (size_t)atoi(args[3]) << 20;
+      res = Bench_Shuffled(&db, &lookStream.vt, cacheSize, &allocImp, &allocTempImp);
+      listCommand = -1;
+    }
+    else if (strcmp(command, "l") == 0) listCommand = 1;
     else if (strcmp(command, "t") == 0) testCommand = 1;
     else if (strcmp(command, "e") == 0) { }
     else if (strcmp(command, "x") == 0) { fullPaths = 1; }
@@ -465,22 +817,29 @@ int MY_CDECL main(int numargs, char *args[])
       res = SZ_ERROR_FAIL;
     }
 
-    if (res == SZ_OK)
+    if (res == SZ_OK && listCommand == 0 && numThreads != 0)
+    {
+      res = ExtractAll_Mt(&db, args[2], &lookStream.vt, numThreads, testCommand, fullPaths,
+          &allocImp, &allocTempImp);
+      listCommand = -1;
+    }
+
+    if (res == SZ_OK && listCommand >= 0)
     {
       UInt32 i;
 
       /*
-      if you need cache, use these 3 variables.
-      if you use external function, you can make these variable as static.
+      streamCache keeps the decoder of current solid block between
+      SzArEx_ExtractToStream() calls, so solid block is decoded only once,
+      if we extract files in archive order.
       */
-      UInt32 blockIndex = 0xFFFFFFFF; /* it can have any value before first call (if outBuffer = 0) */
-      Byte *outBuffer = 0; /* it must be 0 before first call for each new archive. */
-      size_t outBufferSize = 0;  /* it can have any value before first call (if outBuffer = 0) */
+      CSzFolderStreamCache streamCache;
+      ISeqOutStream nullOutStream;
+      nullOutStream.Write = NullOutStream_Write;
+      SzFolderStreamCache_Init(&streamCache);
 
       for (i = 0; i < db.NumFiles; i++)
       {
-        size_t offset = 0;
-        size_t outSizeProcessed = 0;
         // const CSzFileItem *f = db.Files + i;
         size_t len;
         unsigned isDir = SzArEx_IsDir(&db, i);
@@ -554,36 +913,18 @@ int MY_CDECL main(int numargs, char *args[])
         
         if (isDir)
           Print("/");
-        else
+        else if (testCommand)
         {
-          res = SzArEx_Extract(&db, &lookStream.vt, i,
-              &blockIndex, &outBuffer, &outBufferSize,
-              &offset, &outSizeProcessed,
-              &allocImp, &allocTempImp);
+          res = SzArEx_ExtractToStream(&db, &lookStream.vt, i,
+              &streamCache, &nullOutStream, &allocTempImp);
           if (res != SZ_OK)
             break;
         }
         
         if (!testCommand)
         {
-          CSzFile outFile;
-          size_t processedSize;
-          size_t j;
-          UInt16 *name = (UInt16 *)temp;
-          const UInt16 *destPath = (const UInt16 *)name;
- 
-          for (j = 0; name[j] != 0; j++)
-            if (name[j] == '/')
-            {
-              if (fullPaths)
-              {
-                name[j] = 0;
-                MyCreateDir(name);
-                name[j] = CHAR_PATH_SEPARATOR;
-              }
-              else
-                destPath = name + j + 1;
-            }
+          CFileOutStream outStream;
+          const UInt16 *destPath = PrepareDestPath(temp, fullPaths);
     
           if (isDir)
           {
@@ -591,49 +932,49 @@ int MY_CDECL main(int numargs, char *args[])
             PrintLF();
             continue;
           }
-          else if (OutFile_OpenUtf16(&outFile, destPath))
+          else if (OutFile_OpenUtf16(&outStream.file, destPath))
           {
             PrintError("can not open output file");
             res = SZ_ERROR_FAIL;
             break;
           }
 
-          processedSize = outSizeProcessed;
+          FileOutStream_CreateVTable(&outStream);
           
-          if (File_Write(&outFile, outBuffer + offset, &processedSize) != 0 || processedSize != outSizeProcessed)
+          res = SzArEx_ExtractToStream(&db, &lookStream.vt, i,
+              &streamCache, &outStream.vt, &allocTempImp);
+          if (res != SZ_OK)
           {
-            PrintError("can not write output file");
-            res = SZ_ERROR_FAIL;
+            /* the file was written while decoding, so we don't leave
+               partial output of broken file on disk */
+            File_Close(&outStream.file);
+            MyDeleteFile(destPath);
+            if (res == SZ_ERROR_WRITE)
+            {
+              PrintError("can not write output file");
+              res = SZ_ERROR_FAIL;
+            }
             break;
           }
           
-          if (File_Close(&outFile))
+          if (File_Close(&outStream.file))
           {
             PrintError("can not close output file");
             res = SZ_ERROR_FAIL;
             break;
           }
           
-          #ifdef USE_WINDOWS_FILE
-          if (SzBitWithVals_Check(&db.Attribs, i))
-          {
-            UInt32 attrib = db.Attribs.Vals[i];
-            /* p7zip stores posix attributes in high 16 bits and adds 0x8000 as marker.
-               We remove posix bits, if we detect posix mode field */
-            if ((attrib & 0xF0000000) != 0)
-              attrib &= 0x7FFF;
-            SetFileAttributesW(destPath, attrib);
-          }
-          #endif
+          SetFileAttrib(&db, i, destPath);
         }
         PrintLF();
       }
-      ISzAlloc_Free(&allocImp, outBuffer);
+      SzFolderStreamCache_Free(&streamCache, &allocTempImp);
     }
   }
 
   SzFree(NULL, temp);
-  SzArEx_Free(&db, &allocImp);
+  SzArEx_Free(&db, &allocDbImp.vt);
+  SzAllocArena_Free(&allocDbImp);
   ISzAlloc_Free(&allocImp, lookStream.buf);
 
   File_Close(&archiveStream.file);
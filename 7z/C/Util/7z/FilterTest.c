@@ -0,0 +1,350 @@
+/* FilterTest.c -- compares optimized filters with simple byte code
+Public domain */
+
+#include "Precomp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../Bra.h"
+#include "../../Delta.h"
+
+static unsigned g_NumErrors = 0;
+
+/* (param) is chunk size for x86 and distance for Delta */
+
+static void Error(const char *name, const char *s, size_t size, size_t param)
+{
+  printf("\nERROR: %s : %s : size = %u, param = %u\n",
+      name, s, (unsigned)size, (unsigned)param);
+  g_NumErrors++;
+}
+
+static UInt32 g_Rnd = 1;
+
+static unsigned GetRnd(void)
+{
+  g_Rnd = g_Rnd * 1103515245 + 12345;
+  return (unsigned)(g_Rnd >> 16) & 0x7FFF;
+}
+
+/* (mode) selects the density of special bytes in data */
+
+static void GenerateData(Byte *data, size_t size, unsigned mode, const Byte *specials, unsigned numSpecials)
+{
+  size_t i;
+  for (i = 0; i < size; i++)
+  {
+    unsigned r = GetRnd();
+    Byte b = (Byte)r;
+    switch (mode)
+    {
+      case 0: break;
+      case 1: if ((r >> 8) % 5 == 0) b = specials[(r >> 12) % numSpecials]; break;
+      case 2: if ((r >> 8) % 97 == 0) b = specials[(r >> 12) % numSpecials]; else b = 0; break;
+      default: b = specials[(r >> 8) % numSpecials]; break;
+    }
+    data[i] = b;
+  }
+}
+
+#define NUM_MODES 4
+
+
+/* ---------- x86 (BCJ) ---------- */
+
+#define Test86MSByte(b) ((((b) + 1) & 0xFE) == 0)
+
+/* the byte loop version of x86_Convert() from Bra86.c */
+
+static SizeT x86_Convert_Ref(Byte *data, SizeT size, UInt32 ip, UInt32 *state, int encoding)
+{
+  SizeT pos = 0;
+  UInt32 mask = *state & 7;
+  if (size < 5)
+    return 0;
+  size -= 4;
+  ip += 5;
+
+  for (;;)
+  {
+    Byte *p = data + pos;
+    const Byte *limit = data + size;
+    for (; p < limit; p++)
+      if ((*p & 0xFE) == 0xE8)
+        break;
+
+    {
+      SizeT d = (SizeT)(p - data - pos);
+      pos = (SizeT)(p - data);
+      if (p >= limit)
+      {
+        *state = (d > 2 ? 0 : mask >> (unsigned)d);
+        return pos;
+      }
+      if (d > 2)
+        mask = 0;
+      else
+      {
+        mask >>= (unsigned)d;
+        if (mask != 0 && (mask > 4 || mask == 3 || Test86MSByte(p[(size_t)(mask >> 1) + 1])))
+        {
+          mask = (mask >> 1) | 4;
+          pos++;
+          continue;
+        }
+      }
+    }
+
+    if (Test86MSByte(p[4]))
+    {
+      UInt32 v = ((UInt32)p[4] << 24) | ((UInt32)p[3] << 16) | ((UInt32)p[2] << 8) | ((UInt32)p[1]);
+      UInt32 cur = ip + (UInt32)pos;
+      pos += 5;
+      if (encoding)
+        v += cur;
+      else
+        v -= cur;
+      if (mask != 0)
+      {
+        unsigned sh = (mask & 6) << 2;
+        if (Test86MSByte((Byte)(v >> sh)))
+        {
+          v ^= (((UInt32)0x100 << sh) - 1);
+          if (encoding)
+            v += cur;
+          else
+            v -= cur;
+        }
+        mask = 0;
+      }
+      p[1] = (Byte)v;
+      p[2] = (Byte)(v >> 8);
+      p[3] = (Byte)(v >> 16);
+      p[4] = (Byte)(0 - ((v >> 24) & 1));
+    }
+    else
+    {
+      mask = (mask >> 1) | 4;
+      pos++;
+    }
+  }
+}
+
+/*
+  It calls both converters for same chunks of data, as the filter does for stream:
+  the unprocessed tail of chunk is passed again with next chunk.
+  The results and the state must be same after each call.
+*/
+
+static void x86_TestChunks(Byte *a, Byte *b, size_t size, size_t chunk, int encoding)
+{
+  UInt32 stateA, stateB;
+  size_t pos = 0;
+  size_t lim = chunk;
+  x86_Convert_Init(stateA);
+  x86_Convert_Init(stateB);
+  while (pos < size)
+  {
+    size_t end = (lim < size ? lim : size);
+    SizeT na = x86_Convert_Ref(a + pos, end - pos, (UInt32)pos, &stateA, encoding);
+    SizeT nb = x86_Convert(b + pos, end - pos, (UInt32)pos, &stateB, encoding);
+    if (na != nb || stateA != stateB || memcmp(a + pos, b + pos, end - pos) != 0)
+    {
+      Error("x86_Convert", encoding ? "encode" : "decode", size, chunk);
+      return;
+    }
+    pos += na;
+    if (na == 0)
+    {
+      if (end == size)
+        break;
+      lim = end + chunk;
+    }
+    else
+      lim = pos + chunk;
+  }
+}
+
+static void x86_Test(Byte *buf, size_t bufSize)
+{
+  static const Byte kSpecials[] = { 0xE8, 0xE9, 0x00, 0xFF, 0x0F, 0x80 };
+  static const size_t kChunks[] = { 5, 7, 16, 33, 100, 4099, 1 << 16 };
+  Byte *a = buf;
+  Byte *b = buf + bufSize;
+  Byte *src = buf + bufSize * 2;
+  unsigned mode;
+
+  for (mode = 0; mode < NUM_MODES; mode++)
+  {
+    size_t size;
+    for (size = 0; size <= bufSize; size = (size < 80 ? size + 1 : size * 3 + GetRnd() % 64))
+    {
+      unsigned k;
+      if (size > bufSize)
+        size = bufSize;
+      GenerateData(src, size, mode, kSpecials, sizeof(kSpecials));
+      for (k = 0; k < sizeof(kChunks) / sizeof(kChunks[0]); k++)
+      {
+        /* (offset) changes the alignment of data for vector loads */
+        const size_t offset = GetRnd() % 32;
+        Byte *a2 = a + offset;
+        Byte *b2 = b + offset;
+        if (size + offset > bufSize)
+          continue;
+        memcpy(a2, src, size);
+        memcpy(b2, src, size);
+        x86_TestChunks(a2, b2, size, kChunks[k], 1);
+        x86_TestChunks(a2, b2, size, kChunks[k], 0);
+        if (memcmp(b2, src, size) != 0)
+          Error("x86_Convert", "decode(encode(data)) != data", size, kChunks[k]);
+      }
+      if (size == bufSize)
+        break;
+    }
+  }
+}
+
+
+/* ---------- Delta ---------- */
+
+/* the byte loop versions of Delta_Encode() and Delta_Decode() from Delta.c */
+
+static void Delta_Encode_Ref(Byte *state, unsigned delta, Byte *data, SizeT size)
+{
+  Byte buf[DELTA_STATE_SIZE];
+  unsigned j = 0;
+  memcpy(buf, state, delta);
+  {
+    SizeT i;
+    for (i = 0; i < size;)
+    {
+      for (j = 0; j < delta && i < size; i++, j++)
+      {
+        Byte b = data[i];
+        data[i] = (Byte)(b - buf[j]);
+        buf[j] = b;
+      }
+    }
+  }
+  if (j == delta)
+    j = 0;
+  memcpy(state, buf + j, delta - j);
+  memcpy(state + delta - j, buf, j);
+}
+
+static void Delta_Decode_Ref(Byte *state, unsigned delta, Byte *data, SizeT size)
+{
+  Byte buf[DELTA_STATE_SIZE];
+  unsigned j = 0;
+  memcpy(buf, state, delta);
+  {
+    SizeT i;
+    for (i = 0; i < size;)
+    {
+      for (j = 0; j < delta && i < size; i++, j++)
+      {
+        buf[j] = data[i] = (Byte)(buf[j] + data[i]);
+      }
+    }
+  }
+  if (j == delta)
+    j = 0;
+  memcpy(state, buf + j, delta - j);
+  memcpy(state + delta - j, buf, j);
+}
+
+/* it splits data to random blocks and compares the data and the state after each block */
+
+static void Delta_TestBlocks(Byte *a, Byte *b, size_t size, unsigned delta, int encoding)
+{
+  Byte stateA[DELTA_STATE_SIZE];
+  Byte stateB[DELTA_STATE_SIZE];
+  size_t pos = 0;
+  Delta_Init(stateA);
+  Delta_Init(stateB);
+  while (pos < size)
+  {
+    size_t cur = size - pos;
+    switch (GetRnd() % 4)
+    {
+      case 0: cur = GetRnd() % (delta + 17); break;
+      case 1: cur = GetRnd() % (delta * 4 + 100); break;
+      case 2: cur = GetRnd() * 8; break;
+    }
+    if (cur > size - pos)
+      cur = size - pos;
+    if (encoding)
+    {
+      Delta_Encode_Ref(stateA, delta, a + pos, cur);
+      Delta_Encode(stateB, delta, b + pos, cur);
+    }
+    else
+    {
+      Delta_Decode_Ref(stateA, delta, a + pos, cur);
+      Delta_Decode(stateB, delta, b + pos, cur);
+    }
+    if (memcmp(a + pos, b + pos, cur) != 0 || memcmp(stateA, stateB, delta) != 0)
+    {
+      Error("Delta", encoding ? "encode" : "decode", size, delta);
+      return;
+    }
+    pos += cur;
+  }
+}
+
+static void Delta_Test(Byte *buf, size_t bufSize)
+{
+  static const Byte kSpecials[] = { 0x00, 0x01, 0x7F, 0x80, 0xFF };
+  Byte *a = buf;
+  Byte *b = buf + bufSize;
+  Byte *src = buf + bufSize * 2;
+  unsigned delta;
+
+  /* small distances have special SIMD code, so we test them more */
+  for (delta = 1; delta <= DELTA_STATE_SIZE; delta++)
+  {
+    unsigned pass;
+    for (pass = 0; pass < (delta <= 16 ? 8u : 1u); pass++)
+    {
+      const size_t size = (GetRnd() % 8 == 0) ? bufSize : GetRnd() % (delta * 8 + 1000);
+      /* (offset) changes the alignment of data for vector loads */
+      const size_t offset = (size == bufSize) ? 0 : GetRnd() % 32;
+      Byte *a2 = a + offset;
+      Byte *b2 = b + offset;
+      GenerateData(src, size, (delta + pass) % NUM_MODES, kSpecials, sizeof(kSpecials));
+      memcpy(a2, src, size);
+      memcpy(b2, src, size);
+      Delta_TestBlocks(a2, b2, size, delta, 1);
+      Delta_TestBlocks(a2, b2, size, delta, 0);
+      if (memcmp(b2, src, size) != 0)
+        Error("Delta", "decode(encode(data)) != data", size, delta);
+    }
+  }
+}
+
+
+int MY_CDECL main(void)
+{
+  const size_t kBufSize = (size_t)1 << 20;
+  Byte *buf = (Byte *)malloc(kBufSize * 3);
+  if (!buf)
+  {
+    printf("\nERROR: can not allocate memory\n");
+    return 1;
+  }
+
+  x86_Test(buf, kBufSize);
+  Delta_Test(buf, kBufSize);
+
+  free(buf);
+
+  if (g_NumErrors != 0)
+  {
+    printf("\nErrors: %u\n", g_NumErrors);
+    return 1;
+  }
+  printf("Filters: OK\n");
+  return 0;
+}
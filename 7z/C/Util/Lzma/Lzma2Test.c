@@ -0,0 +1,136 @@
+/* Lzma2Test.c -- round trip test for Lzma2CompressMt / Lzma2UncompressMt
+Public domain */
+
+#include "../../Precomp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../LzmaLib.h"
+
+static unsigned g_NumErrors = 0;
+
+static void Error(const char *s, size_t size, size_t blockSize, int numThreads)
+{
+  printf("\nERROR: %s : size = %u, blockSize = %u, threads = %d\n",
+      s, (unsigned)size, (unsigned)blockSize, numThreads);
+  g_NumErrors++;
+}
+
+/* the data has random parts and repeated parts, so it's compressed to different chunk types */
+
+static void GenerateData(Byte *data, size_t size, UInt32 seed)
+{
+  size_t i;
+  for (i = 0; i < size;)
+  {
+    size_t len, k;
+    seed = seed * 1103515245 + 12345;
+    len = ((seed >> 8) & 0x3FFF) + 1;
+    if (len > size - i)
+      len = size - i;
+    if ((seed >> 24) & 1)
+      for (k = 0; k < len; k++)
+      {
+        seed = seed * 1103515245 + 12345;
+        data[i + k] = (Byte)(seed >> 16);
+      }
+    else
+      for (k = 0; k < len; k++)
+        data[i + k] = (Byte)(i >= 1000 ? data[i + k - 1000] : k);
+    i += len;
+  }
+}
+
+static void Test(const Byte *src, size_t size, size_t blockSize, int numThreads)
+{
+  size_t packBufSize = Lzma2CompressBound(size);
+  Byte *pack = (Byte *)malloc(packBufSize);
+  Byte *dest = (Byte *)malloc(size + 1);
+  size_t packSize = packBufSize;
+  size_t destLen;
+  SizeT srcLen;
+  Byte prop;
+  int t;
+
+  if (!pack || !dest)
+  {
+    Error("can not allocate memory", size, blockSize, numThreads);
+    free(pack);
+    free(dest);
+    return;
+  }
+
+  if (Lzma2CompressMt(pack, &packSize, src, size, &prop, 5, 1 << 20, blockSize, numThreads) != SZ_OK)
+  {
+    Error("Lzma2CompressMt", size, blockSize, numThreads);
+    free(pack);
+    free(dest);
+    return;
+  }
+
+  for (t = 1; t <= 4; t += 3)
+  {
+    destLen = size;
+    srcLen = packSize;
+    if (Lzma2UncompressMt(dest, &destLen, pack, &srcLen, prop, t) != SZ_OK
+        || destLen != size
+        || srcLen != packSize
+        || memcmp(dest, src, size) != 0)
+      Error("Lzma2UncompressMt", size, blockSize, t);
+
+    /* the stream without end marker */
+    if (packSize > 1)
+    {
+      destLen = size;
+      srcLen = packSize - 1;
+      if (Lzma2UncompressMt(dest, &destLen, pack, &srcLen, prop, t) != SZ_ERROR_INPUT_EOF)
+        Error("truncated stream was not detected", size, blockSize, t);
+    }
+
+    /* the output buffer is smaller than data */
+    if (size != 0)
+    {
+      destLen = size - 1;
+      srcLen = packSize;
+      if (Lzma2UncompressMt(dest, &destLen, pack, &srcLen, prop, t) != SZ_ERROR_OUTPUT_EOF)
+        Error("small output buffer was not detected", size, blockSize, t);
+    }
+  }
+
+  free(pack);
+  free(dest);
+}
+
+int MY_CDECL main(void)
+{
+  static const size_t kSizes[] = { 0, 1, 1000, (1 << 16) + 1, 300000, (3 << 20) + 12345 };
+  static const size_t kBlockSizes[] = { 0, 1 << 16, 1 << 18 };
+  const size_t kMaxSize = (3 << 20) + 12345;
+  Byte *data = (Byte *)malloc(kMaxSize);
+  unsigned i, k;
+  int numThreads;
+
+  if (!data)
+  {
+    printf("\nERROR: can not allocate memory\n");
+    return 1;
+  }
+  GenerateData(data, kMaxSize, 1);
+
+  for (i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); i++)
+    for (k = 0; k < sizeof(kBlockSizes) / sizeof(kBlockSizes[0]); k++)
+      for (numThreads = 1; numThreads <= 4; numThreads *= 2)
+        Test(data, kSizes[i], kBlockSizes[k], numThreads);
+
+  free(data);
+
+  if (g_NumErrors != 0)
+  {
+    printf("\nErrors: %u\n", g_NumErrors);
+    return 1;
+  }
+  printf("Lzma2CompressMt / Lzma2UncompressMt: OK\n");
+  return 0;
+}
@@ -116,6 +116,14 @@ SOURCE=..\..\Alloc.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\CpuArch.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\CpuArch.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\IStream.h
 # End Source File
 # Begin Source File
@@ -140,6 +148,22 @@ SOURCE=..\..\LzHash.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\Lzma2Dec.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Lzma2Dec.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Lzma2Enc.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Lzma2Enc.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\LzmaDec.c
 # End Source File
 # Begin Source File
@@ -164,6 +188,14 @@ SOURCE=..\..\LzmaLib.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\MtCoder.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\MtCoder.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\resource.rc
 # End Source File
 # Begin Source File
@@ -938,6 +938,7 @@ typedef struct
   unsigned checkType;
   ISeqOutStream *outStream;
   Bool mtCoder_WasConstructed;
+  Bool mtCoder_WasUsed;
   CMtCoder mtCoder;
   CXzEncBlockInfo EncBlocks[MTCODER__BLOCKS_MAX];
   #endif
@@ -956,6 +957,7 @@ static void XzEnc_Construct(CXzEnc *p)
 
   #ifndef _7ZIP_ST
   p->mtCoder_WasConstructed = False;
+  p->mtCoder_WasUsed = False;
   {
     for (i = 0; i < MTCODER__BLOCKS_MAX; i++)
       p->outBufs[i] = NULL;
@@ -1150,6 +1152,7 @@ SRes XzEnc_Encode(CXzEncHandle pp, ISeqOutStream *outStream, ISeqInStream *inStr
 
 
   #ifndef _7ZIP_ST
+  p->mtCoder_WasUsed = False;
   if (props->numBlockThreads_Reduced > 1)
   {
     IMtCoderCallback2 vt;
@@ -1195,6 +1198,7 @@ SRes XzEnc_Encode(CXzEncHandle pp, ISeqOutStream *outStream, ISeqInStream *inStr
 
     p->mtCoder.numThreadsMax = props->numBlockThreads_Max;
     p->mtCoder.expectedDataSize = p->expectedDataSize;
+    p->mtCoder_WasUsed = True;
     
     RINOK(MtCoder_Code(&p->mtCoder));
   }
@@ -1294,6 +1298,28 @@ SRes XzEnc_Encode(CXzEncHandle pp, ISeqOutStream *outStream, ISeqInStream *inStr
 }
 
 
+Bool XzEnc_GetThreadStat(CXzEncHandle pp, unsigned threadIndex, UInt64 *numCodedBlocks, UInt64 *numWindowWaits)
+{
+  #ifndef _7ZIP_ST
+  CXzEnc *p = (CXzEnc *)pp;
+  CMtCoderThreadStat stat;
+  if (p->mtCoder_WasConstructed && p->mtCoder_WasUsed
+      && MtCoder_GetThreadStat(&p->mtCoder, threadIndex, &stat))
+  {
+    *numCodedBlocks = stat.numCodedBlocks;
+    *numWindowWaits = stat.numWindowWaits;
+    return True;
+  }
+  #else
+  UNUSED_VAR(pp);
+  UNUSED_VAR(threadIndex);
+  #endif
+  *numCodedBlocks = 0;
+  *numWindowWaits = 0;
+  return False;
+}
+
+
 #include "Alloc.h"
 
 SRes Xz_Encode(ISeqOutStream *outStream, ISeqInStream *inStream,
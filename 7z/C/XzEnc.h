@@ -50,6 +50,10 @@ SRes XzEnc_SetProps(CXzEncHandle p, const CXzProps *props);
 void XzEnc_SetDataSize(CXzEncHandle p, UInt64 expectedDataSiize);
 SRes XzEnc_Encode(CXzEncHandle p, ISeqOutStream *outStream, ISeqInStream *inStream, ICompressProgress *progress);
 
+/* XzEnc_GetThreadStat() returns the counters of thread (threadIndex) for last XzEnc_Encode() call.
+   See Lzma2Enc_GetThreadStat() */
+Bool XzEnc_GetThreadStat(CXzEncHandle p, unsigned threadIndex, UInt64 *numCodedBlocks, UInt64 *numWindowWaits);
+
 SRes Xz_Encode(ISeqOutStream *outStream, ISeqInStream *inStream,
     const CXzProps *props, ICompressProgress *progress);
 
@@ -52,6 +52,7 @@ struct CCompressionMethodMode
   #ifndef _7ZIP_ST
   UInt32 NumThreads;
   bool MultiThreadMixer;
+  UInt32 BinderRingSize; // for CMixerMT::BinderRingSize, (-1) means default
   #endif
   
   bool PasswordIsDefined;
@@ -65,6 +66,7 @@ struct CCompressionMethodMode
       #ifndef _7ZIP_ST
       , NumThreads(1)
       , MultiThreadMixer(true)
+      , BinderRingSize((UInt32)(Int32)-1)
       #endif
   {}
 };
@@ -111,7 +111,8 @@ static bool AreBindInfoExEqual(const CBindInfoEx &a1, const CBindInfoEx &a2)
 
 CDecoder::CDecoder(bool useMixerMT):
     _bindInfoPrev_Defined(false),
-    _useMixerMT(useMixerMT)
+    _useMixerMT(useMixerMT),
+    BinderRingSize((UInt32)(Int32)-1)
 {}
 
 
@@ -276,6 +277,8 @@ HRESULT CDecoder::Decode(
   
   if (!_bindInfoPrev_Defined || !AreBindInfoExEqual(bindInfo, _bindInfoPrev))
   {
+    // if the creation of coders fails, the mixer is incomplete. So we reset _bindInfoPrev_Defined
+    _bindInfoPrev_Defined = false;
     _mixerRef.Release();
 
     #ifdef USE_MIXER_MT
@@ -284,6 +287,7 @@ HRESULT CDecoder::Decode(
     #endif
     {
       _mixerMT = new NCoderMixer2::CMixerMT(false);
+      _mixerMT->BinderRingSize = BinderRingSize;
       _mixerRef = _mixerMT;
       _mixer = _mixerMT;
     }
@@ -40,6 +40,7 @@ class CDecoder
   CMyComPtr<IUnknown> _mixerRef;
 
 public:
+  UInt32 BinderRingSize; // for CMixerMT::BinderRingSize, (-1) means default
 
   CDecoder(bool useMixerMT);
   
@@ -131,6 +131,7 @@ HRESULT CEncoder::CreateMixerCoder(
   #endif
   {
     _mixerMT = new NCoderMixer2::CMixerMT(true);
+    _mixerMT->BinderRingSize = _options.BinderRingSize;
     _mixerRef = _mixerMT;
     _mixer = _mixerMT;
   }
@@ -319,7 +320,7 @@ HRESULT CEncoder::Encode(
   for (i = 1; i < _bindInfo.PackStreams.Size(); i++)
   {
     CInOutTempBuffer &iotb = inOutTempBuffers.AddNew();
-    iotb.Create();
+    iotb.Create(_tempBufferMemSize / (_bindInfo.PackStreams.Size() - 1));
     iotb.InitWriting();
   }
   
@@ -478,7 +479,8 @@ HRESULT CEncoder::Encode(
 
 
 CEncoder::CEncoder(const CCompressionMethodMode &options):
-    _constructed(false)
+    _constructed(false),
+    _tempBufferMemSize(kInOutTempBuffer_MaxMemSize_Default)
 {
   if (options.IsEmpty())
     throw 1;
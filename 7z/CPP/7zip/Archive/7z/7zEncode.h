@@ -69,10 +69,13 @@ class CEncoder
       const UInt64 *inSizeForReduce);
 
   bool _constructed;
+  UInt64 _tempBufferMemSize;
 public:
 
   CEncoder(const CCompressionMethodMode &options);
   ~CEncoder();
+  // the memory limit for all temp buffers of additional pack streams (BCJ2) in one Encode() call
+  void SetTempBufferMemSize(UInt64 size) { _tempBufferMemSize = size; }
   HRESULT EncoderConstr();
   HRESULT Encode(
       DECL_EXTERNAL_CODECS_LOC_VARS
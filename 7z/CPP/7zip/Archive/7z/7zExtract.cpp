@@ -269,6 +269,10 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     #endif
     );
 
+  #ifdef __7Z_SET_PROPERTIES
+  decoder.BinderRingSize = _binderRingSize;
+  #endif
+
   UInt64 curPacked, curUnpacked;
 
   CMyComPtr<IArchiveExtractCallbackMessage> callbackMessage;
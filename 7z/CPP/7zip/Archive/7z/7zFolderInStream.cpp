@@ -2,11 +2,183 @@
 
 #include "StdAfx.h"
 
+#ifndef _7ZIP_ST
+#include "../../../../C/Alloc.h"
+
+#include "../../Common/StreamUtils.h"
+#endif
+
 #include "7zFolderInStream.h"
 
 namespace NArchive {
 namespace N7z {
 
+#ifndef _7ZIP_ST
+
+static const UInt32 kPrefetchBlockSize = (UInt32)1 << 19;
+
+CFolderInStreamPrefetcher::~CFolderInStreamPrefetcher()
+{
+  if (_started)
+  {
+    // the thread can wait free block, or it can be in GetStream() or Read() call
+    _stop = true;
+    _freeSemaphore.Release();
+  }
+  CPooledVirtThread::WaitThreadFinish();
+  for (unsigned i = 0; i < kNumPrefetchBlocks; i++)
+    MidFree(_blocks[i].Data);
+}
+
+WRes CFolderInStreamPrefetcher::StartPrefetch(IArchiveUpdateCallback *updateCallback,
+    const UInt32 *indexes, unsigned numFiles,
+    NWindows::NSynchronization::CCriticalSection *callbackCS)
+{
+  _updateCallback = updateCallback;
+  _callbackCS = callbackCS;
+  _indexes = indexes;
+  _numFiles = numFiles;
+  _readIndex = 0;
+  _writeIndex = 0;
+  _stop = false;
+  // (+ 1) is for release in destructor
+  RINOK(_freeSemaphore.Create(kNumPrefetchBlocks, kNumPrefetchBlocks + 1));
+  RINOK(_filledSemaphore.Create(0, kNumPrefetchBlocks));
+  RINOK(Create());
+  Start();
+  return 0;
+}
+
+CPrefetchBlock *CFolderInStreamPrefetcher::WaitFreeBlock()
+{
+  _freeSemaphore.Lock();
+  if (_stop)
+    return NULL;
+  CPrefetchBlock *b = &_blocks[_writeIndex];
+  b->Size = 0;
+  b->Result = S_OK;
+  b->FileStart = false;
+  b->FileEnd = false;
+  return b;
+}
+
+void CFolderInStreamPrefetcher::PutBlock()
+{
+  if (++_writeIndex == kNumPrefetchBlocks)
+    _writeIndex = 0;
+  _filledSemaphore.Release();
+}
+
+CPrefetchBlock *CFolderInStreamPrefetcher::GetBlock()
+{
+  _filledSemaphore.Lock();
+  return &_blocks[_readIndex];
+}
+
+void CFolderInStreamPrefetcher::FreeBlock()
+{
+  if (++_readIndex == kNumPrefetchBlocks)
+    _readIndex = 0;
+  _freeSemaphore.Release();
+}
+
+void CFolderInStreamPrefetcher::Execute()
+{
+  // (stream) is released under lock also, if we exit with error or by stop request
+  CMyComPtr<ISequentialInStream> stream;
+  Prefetch(stream);
+  CCallbackLock lock(_callbackCS);
+  stream.Release();
+}
+
+void CFolderInStreamPrefetcher::Prefetch(CMyComPtr<ISequentialInStream> &stream)
+{
+  for (unsigned i = 0; i < _numFiles; i++)
+  {
+    CPrefetchBlock *b = WaitFreeBlock();
+    if (!b)
+      return;
+    
+    HRESULT result;
+    {
+      CCallbackLock lock(_callbackCS);
+      result = _updateCallback->GetStream(_indexes[i], &stream);
+    }
+    if (result != S_OK && result != S_FALSE)
+    {
+      b->Result = result;
+      PutBlock();
+      return;
+    }
+    
+    b->FileStart = true;
+    b->Processed = (stream || result == S_OK);
+    b->SizeDefined = false;
+    b->FileSize = 0;
+    
+    if (stream)
+    {
+      CCallbackLock lock(_callbackCS);
+      CMyComPtr<IStreamGetSize> streamGetSize;
+      stream.QueryInterface(IID_IStreamGetSize, &streamGetSize);
+      if (streamGetSize)
+      {
+        if (streamGetSize->GetSize(&b->FileSize) == S_OK)
+          b->SizeDefined = true;
+      }
+    }
+
+    UInt32 crc = CRC_INIT_VAL;
+
+    for (;;)
+    {
+      if (stream)
+      {
+        if (!b->Data)
+        {
+          b->Data = (Byte *)MidAlloc(kPrefetchBlockSize);
+          if (!b->Data)
+          {
+            b->Result = E_OUTOFMEMORY;
+            PutBlock();
+            return;
+          }
+        }
+        size_t size = kPrefetchBlockSize;
+        {
+          CCallbackLock lock(_callbackCS);
+          result = ReadStream(stream, b->Data, &size);
+        }
+        if (result != S_OK)
+        {
+          b->Result = result;
+          PutBlock();
+          return;
+        }
+        b->Size = (UInt32)size;
+        crc = CrcUpdate(crc, b->Data, size);
+        if (size == kPrefetchBlockSize)
+        {
+          PutBlock();
+          b = WaitFreeBlock();
+          if (!b)
+            return;
+          continue;
+        }
+        // we close the file before the coder reaches it
+        CCallbackLock lock(_callbackCS);
+        stream.Release();
+      }
+      b->FileEnd = true;
+      b->Crc = crc;
+      PutBlock();
+      break;
+    }
+  }
+}
+
+#endif
+
 void CFolderInStream::Init(IArchiveUpdateCallback *updateCallback,
     const UInt32 *indexes, unsigned numFiles)
 {
@@ -25,8 +197,92 @@ void CFolderInStream::Init(IArchiveUpdateCallback *updateCallback,
   _size = 0;
 
   _stream.Release();
+
+  #ifndef _7ZIP_ST
+  _callbackCS = NULL;
+  _prefetcher = NULL;
+  _block = NULL;
+  #endif
 }
 
+#ifndef _7ZIP_ST
+
+void CFolderInStream::Init(IArchiveUpdateCallback *updateCallback,
+    const UInt32 *indexes, unsigned numFiles,
+    CFolderInStreamPrefetcher *prefetcher,
+    NWindows::NSynchronization::CCriticalSection *callbackCS)
+{
+  Init(updateCallback, indexes, numFiles);
+  _prefetcher = prefetcher;
+  _callbackCS = callbackCS;
+}
+
+#define CALLBACK_LOCK CCallbackLock callbackLock(_callbackCS);
+
+HRESULT CFolderInStream::ReadPrefetched(void *data, UInt32 size, UInt32 *processedSize)
+{
+  while (size != 0)
+  {
+    if (_block)
+    {
+      UInt32 rem = _block->Size - _blockPos;
+      if (rem != 0)
+      {
+        if (size > rem)
+          size = rem;
+        memcpy(data, _block->Data + _blockPos, size);
+        _blockPos += size;
+        _pos += size;
+        if (processedSize)
+          *processedSize = size;
+        return S_OK;
+      }
+      
+      const bool fileEnd = _block->FileEnd;
+      if (fileEnd)
+        _crc = _block->Crc;
+      _block = NULL;
+      _prefetcher->FreeBlock();
+      
+      if (fileEnd)
+      {
+        _index++;
+        AddFileInfo(_processed);
+        
+        _pos = 0;
+        _crc = CRC_INIT_VAL;
+        _size_Defined = false;
+        _size = 0;
+        
+        CALLBACK_LOCK
+        RINOK(_updateCallback->SetOperationResult(NArchive::NUpdate::NOperationResult::kOK));
+      }
+    }
+    
+    if (_index >= _numFiles)
+      break;
+    
+    CPrefetchBlock *b = _prefetcher->GetBlock();
+    // we don't free error block, so prefetch thread will not continue
+    RINOK(b->Result);
+    _block = b;
+    _blockPos = 0;
+    if (b->FileStart)
+    {
+      _processed = b->Processed;
+      _size_Defined = b->SizeDefined;
+      _size = b->FileSize;
+    }
+  }
+  return S_OK;
+}
+
+#else
+
+#define CALLBACK_LOCK
+
+#endif
+
 HRESULT CFolderInStream::OpenStream()
 {
   _pos = 0;
@@ -37,7 +293,11 @@ HRESULT CFolderInStream::OpenStream()
   while (_index < _numFiles)
   {
     CMyComPtr<ISequentialInStream> stream;
-    HRESULT result = _updateCallback->GetStream(_indexes[_index], &stream);
+    HRESULT result;
+    {
+      CALLBACK_LOCK
+      result = _updateCallback->GetStream(_indexes[_index], &stream);
+    }
     if (result != S_OK)
     {
       if (result != S_FALSE)
@@ -59,7 +319,10 @@ HRESULT CFolderInStream::OpenStream()
     }
     
     _index++;
-    RINOK(_updateCallback->SetOperationResult(NArchive::NUpdate::NOperationResult::kOK));
+    {
+      CALLBACK_LOCK
+      RINOK(_updateCallback->SetOperationResult(NArchive::NUpdate::NOperationResult::kOK));
+    }
     AddFileInfo(result == S_OK);
   }
   return S_OK;
@@ -76,6 +339,10 @@ STDMETHODIMP CFolderInStream::Read(void *data, UInt32 size, UInt32 *processedSiz
 {
   if (processedSize)
     *processedSize = 0;
+  #ifndef _7ZIP_ST
+  if (_prefetcher)
+    return ReadPrefetched(data, size, processedSize);
+  #endif
   while (size != 0)
   {
     if (_stream)
@@ -84,7 +351,10 @@ STDMETHODIMP CFolderInStream::Read(void *data, UInt32 size, UInt32 *processedSiz
       const UInt32 kMax = (UInt32)1 << 20;
       if (cur > kMax)
         cur = kMax;
-      RINOK(_stream->Read(data, cur, &cur));
+      {
+        CALLBACK_LOCK
+        RINOK(_stream->Read(data, cur, &cur));
+      }
       if (cur != 0)
       {
         _crc = CrcUpdate(_crc, data, cur);
@@ -103,6 +373,7 @@ STDMETHODIMP CFolderInStream::Read(void *data, UInt32 size, UInt32 *processedSiz
       _size_Defined = false;
       _size = 0;
 
+      CALLBACK_LOCK
       RINOK(_updateCallback->SetOperationResult(NArchive::NUpdate::NOperationResult::kOK));
     }
     
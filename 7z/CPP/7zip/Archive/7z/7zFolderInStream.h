@@ -11,9 +11,84 @@
 #include "../../ICoder.h"
 #include "../IArchive.h"
 
+#ifndef _7ZIP_ST
+#include "../../Common/VirtThread.h"
+#endif
+
 namespace NArchive {
 namespace N7z {
 
+#ifndef _7ZIP_ST
+
+/* IArchiveUpdateCallback is not thread-safe. If another thread can call it
+   at same time (progress of parallel folder encoders), each call is made
+   under CCallbackLock. (cs == NULL) means that there is no such thread. */
+
+class CCallbackLock
+{
+  NWindows::NSynchronization::CCriticalSection *_cs;
+public:
+  CCallbackLock(NWindows::NSynchronization::CCriticalSection *cs): _cs(cs) { if (cs) cs->Enter(); }
+  ~CCallbackLock() { if (_cs) _cs->Leave(); }
+};
+
+/*
+  CFolderInStreamPrefetcher opens the files of update group with GetStream()
+  and reads them to blocks of bounded memory pool in separate thread,
+  while the coder compresses previous files.
+  CFolderInStream objects for solid blocks of that group read data from these
+  blocks in same order. Each block contains the data of one file only.
+  The thread keeps only one file open: it releases the stream at EOF.
+  The calls of updateCallback and of its streams are made under (callbackCS).
+*/
+
+const unsigned kNumPrefetchBlocks = 32;
+
+struct CPrefetchBlock
+{
+  Byte *Data;
+  UInt32 Size;
+  HRESULT Result;   // if (Result != S_OK), it's last block and it contains no data
+  bool FileStart;   // Processed, SizeDefined and FileSize are defined for first block of file
+  bool FileEnd;     // Crc is defined for last block of file
+  bool Processed;
+  bool SizeDefined;
+  UInt64 FileSize;
+  UInt32 Crc;
+
+  CPrefetchBlock(): Data(NULL) {}
+};
+
+class CFolderInStreamPrefetcher: public CPooledVirtThread
+{
+  CMyComPtr<IArchiveUpdateCallback> _updateCallback;
+  NWindows::NSynchronization::CCriticalSection *_callbackCS;
+  const UInt32 *_indexes;
+  unsigned _numFiles;
+  unsigned _readIndex;
+  unsigned _writeIndex;
+  bool _stop;
+  NWindows::NSynchronization::CSemaphore _freeSemaphore;
+  NWindows::NSynchronization::CSemaphore _filledSemaphore;
+  CPrefetchBlock _blocks[kNumPrefetchBlocks];
+
+  CPrefetchBlock *WaitFreeBlock();
+  void PutBlock();
+  void Prefetch(CMyComPtr<ISequentialInStream> &stream);
+public:
+  CFolderInStreamPrefetcher(): _stop(false) {}
+  ~CFolderInStreamPrefetcher();
+  WRes StartPrefetch(IArchiveUpdateCallback *updateCallback, const UInt32 *indexes, unsigned numFiles,
+      NWindows::NSynchronization::CCriticalSection *callbackCS);
+  virtual void Execute();
+
+  // these functions are called by CFolderInStream
+  CPrefetchBlock *GetBlock();
+  void FreeBlock();
+};
+
+#endif
+
 class CFolderInStream:
   public ISequentialInStream,
   public ICompressGetSubStreamSize,
@@ -31,6 +106,15 @@ class CFolderInStream:
 
   CMyComPtr<IArchiveUpdateCallback> _updateCallback;
 
+  #ifndef _7ZIP_ST
+  NWindows::NSynchronization::CCriticalSection *_callbackCS;
+  CFolderInStreamPrefetcher *_prefetcher;
+  CPrefetchBlock *_block;
+  UInt32 _blockPos;
+  bool _processed;
+  HRESULT ReadPrefetched(void *data, UInt32 size, UInt32 *processedSize);
+  #endif
+
   HRESULT OpenStream();
   void AddFileInfo(bool isProcessed);
 
@@ -44,6 +128,12 @@ public:
   STDMETHOD(GetSubStreamSize)(UInt64 subStream, UInt64 *value);
 
   void Init(IArchiveUpdateCallback *updateCallback, const UInt32 *indexes, unsigned numFiles);
+  #ifndef _7ZIP_ST
+  // (prefetcher) must be started for sequence of files that begins from (indexes)
+  void Init(IArchiveUpdateCallback *updateCallback, const UInt32 *indexes, unsigned numFiles,
+      CFolderInStreamPrefetcher *prefetcher,
+      NWindows::NSynchronization::CCriticalSection *callbackCS = NULL);
+  #endif
 
   bool WasFinished() const { return _index == _numFiles; }
 
@@ -22,6 +22,15 @@
 #endif
 #endif
 
+#ifdef __7Z_HEADER_INDEX
+#ifdef _WIN32
+#include "../../../Windows/FileIO.h"
+#include "../../../Windows/FileMapping.h"
+#else
+#include "../../../Common/C_FileIO.h"
+#endif
+#endif
+
 using namespace NWindows;
 using namespace NCOM;
 
@@ -42,6 +51,8 @@ CHandler::CHandler()
   #ifdef __7Z_SET_PROPERTIES
   _numThreads = NSystem::GetNumberOfProcessors();
   _useMultiThreadMixer = true;
+  _binderRingSize = (UInt32)(Int32)-1;
+  _useHeaderIndex = false;
   #endif
   
   #endif
@@ -636,6 +647,118 @@ STDMETHODIMP CHandler::GetProperty(UInt32 index, PROPID propID, PROPVARIANT *val
   // COM_TRY_END
 }
 
+#ifdef __7Z_HEADER_INDEX
+
+/*
+  Header index is optional file (archive path + ".7zi") that contains
+  parsed database of archive. It's used instead of reading and decoding
+  of archive header, if the key (archive size, mtime and start header) matches.
+*/
+
+#define kHeaderIndexExtension ".7zi"
+
+static HRESULT GetHeaderIndexParams(IArchiveOpenCallback *openCallback, FString &path, UInt64 &mTime)
+{
+  if (!openCallback)
+    return S_FALSE;
+  CMyComPtr<IArchiveOpenVolumeCallback> volumeCallback;
+  openCallback->QueryInterface(IID_IArchiveOpenVolumeCallback, (void **)&volumeCallback);
+  if (!volumeCallback)
+    return S_FALSE;
+  {
+    NCOM::CPropVariant prop;
+    RINOK(volumeCallback->GetProperty(kpidPath, &prop));
+    if (prop.vt != VT_BSTR)
+      return S_FALSE;
+    path = us2fs(prop.bstrVal);
+  }
+  {
+    NCOM::CPropVariant prop;
+    RINOK(volumeCallback->GetProperty(kpidMTime, &prop));
+    if (prop.vt != VT_FILETIME)
+      return S_FALSE;
+    mTime = prop.filetime.dwLowDateTime | ((UInt64)prop.filetime.dwHighDateTime << 32);
+  }
+  if (path.IsEmpty())
+    return S_FALSE;
+  path += kHeaderIndexExtension;
+  return S_OK;
+}
+
+static bool ReadHeaderIndex(CFSTR path, const Byte *key, CDbEx &db)
+{
+  #ifdef _WIN32
+  
+  NFile::NIO::CInFile file;
+  if (!file.Open(path))
+    return false;
+  UInt64 size;
+  if (!file.GetLength(size) || size == 0 || size != (SIZE_T)size)
+    return false;
+  CFileMapping map;
+  map.Create(file.GetHandle(), PAGE_READONLY, 0, NULL);
+  if (!map.IsCreated())
+    return false;
+  const Byte *view = (const Byte *)map.Map(FILE_MAP_READ, 0, (SIZE_T)size);
+  if (!view)
+    return false;
+  CFileUnmapper unmapper(view);
+  return db.ReadIndex(key, view, (size_t)size);
+  
+  #else
+  
+  NC::NFile::NIO::CInFile file;
+  if (!file.Open(path))
+    return false;
+  UInt64 size;
+  if (!file.GetLength(size) || size == 0 || size != (size_t)size)
+    return false;
+  CByteBuffer buf;
+  buf.Alloc((size_t)size);
+  size_t pos = 0;
+  while (pos != size)
+  {
+    ssize_t res = file.Read(buf + pos, (size_t)size - pos);
+    if (res <= 0)
+      return false;
+    pos += (size_t)res;
+  }
+  return db.ReadIndex(key, buf, (size_t)size);
+  
+  #endif
+}
+
+static bool WriteHeaderIndex(CFSTR path, const CByteBuffer &image)
+{
+  #ifdef _WIN32
+  NFile::NIO::COutFile file;
+  #else
+  NC::NFile::NIO::COutFile file;
+  #endif
+  if (!file.Create(path, true))
+    return false;
+  const Byte *data = image;
+  size_t rem = image.Size();
+  while (rem != 0)
+  {
+    UInt32 cur = (rem < ((UInt32)1 << 30) ? (UInt32)rem : ((UInt32)1 << 30));
+    #ifdef _WIN32
+    UInt32 processed;
+    if (!file.Write(data, cur, processed) || processed == 0)
+      return false;
+    #else
+    ssize_t processed = file.Write(data, cur);
+    if (processed <= 0)
+      return false;
+    #endif
+    data += processed;
+    rem -= processed;
+  }
+  return file.Close();
+}
+
+#endif
+
 STDMETHODIMP CHandler::Open(IInStream *stream,
     const UInt64 *maxCheckStartPosition,
     IArchiveOpenCallback *openArchiveCallback)
@@ -667,14 +790,54 @@ STDMETHODIMP CHandler::Open(IInStream *stream,
     RINOK(archive.Open(stream, maxCheckStartPosition));
     _db.IsArc = true;
     
-    HRESULT result = archive.ReadDatabase(
-        EXTERNAL_CODECS_VARS
-        _db
-        #ifndef _NO_CRYPTO
-          , getTextPassword, _isEncrypted, _passwordIsDefined, _password
-        #endif
-        );
-    RINOK(result);
+    #ifdef __7Z_HEADER_INDEX
+    FString indexPath;
+    Byte indexKey[kIndexKeySize];
+    bool useIndex = false;
+    if (_useHeaderIndex)
+    {
+      UInt64 mTime = 0;
+      if (GetHeaderIndexParams(openArchiveCallback, indexPath, mTime) == S_OK)
+      {
+        archive.GetIndexKey(mTime, indexKey);
+        useIndex = true;
+      }
+    }
+    if (useIndex && ReadHeaderIndex(indexPath, indexKey, _db))
+    {
+      // the database was loaded from index, so we don't read the header
+    }
+    else
+    #endif
+    {
+      HRESULT result = archive.ReadDatabase(
+          EXTERNAL_CODECS_VARS
+          _db
+          #ifndef _NO_CRYPTO
+            , getTextPassword, _isEncrypted, _passwordIsDefined, _password
+          #endif
+          );
+      RINOK(result);
+      
+      #ifdef __7Z_HEADER_INDEX
+      // we don't store the index for encrypted header and for archive with errors
+      if (useIndex
+          #ifndef _NO_CRYPTO
+          && !_isEncrypted
+          #endif
+          && _db.IsArc
+          && !_db.ThereIsHeaderError
+          && !_db.UnexpectedEnd
+          && !_db.StartHeaderWasRecovered
+          && !_db.UnsupportedFeatureWarning
+          && !_db.UnsupportedFeatureError)
+      {
+        CByteBuffer image;
+        _db.WriteIndex(indexKey, image);
+        WriteHeaderIndex(indexPath, image);
+      }
+      #endif
+    }
     
     _inStream = stream;
   }
@@ -717,6 +880,8 @@ STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVAR
   const UInt32 numProcessors = NSystem::GetNumberOfProcessors();
   _numThreads = numProcessors;
   _useMultiThreadMixer = true;
+  _binderRingSize = (UInt32)(Int32)-1;
+  _useHeaderIndex = false;
 
   for (UInt32 i = 0; i < numProps; i++)
   {
@@ -734,6 +899,16 @@ STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVAR
         RINOK(PROPVARIANT_to_bool(value, _useMultiThreadMixer));
         continue;
       }
+      if (name.IsEqualTo("mtb"))
+      {
+        RINOK(PROPVARIANT_to_Size32(value, _binderRingSize));
+        continue;
+      }
+      if (name.IsEqualTo("hi"))
+      {
+        RINOK(PROPVARIANT_to_bool(value, _useHeaderIndex));
+        continue;
+      }
       if (name.IsPrefixedBy_Ascii_NoCase("mt"))
       {
         RINOK(ParseMtProp(name.Ptr(2), value, numProcessors, _numThreads));
@@ -30,6 +30,10 @@ namespace N7z {
 
 #endif
 
+#if defined(__7Z_SET_PROPERTIES) && !defined(_SFX)
+  #define __7Z_HEADER_INDEX
+#endif
+
 
 #ifndef EXTRACT_ONLY
 
@@ -45,6 +49,7 @@ public:
   bool _numSolidBytesDefined;
   bool _solidExtension;
   bool _useTypeSorting;
+  bool _useSimilaritySorting;
 
   bool _compressHeaders;
   bool _encryptHeadersSpecified;
@@ -57,6 +62,8 @@ public:
   CBoolPair Write_Attrib;
 
   bool _useMultiThreadMixer;
+  UInt32 _binderRingSize; // (-1) means default
+  bool _useHeaderIndex;
 
   // bool _volumeMode;
 
@@ -137,6 +144,8 @@ private:
   #ifdef __7Z_SET_PROPERTIES
   UInt32 _numThreads;
   bool _useMultiThreadMixer;
+  UInt32 _binderRingSize;
+  bool _useHeaderIndex;
   #endif
 
   UInt32 _crcSize;
@@ -150,8 +159,13 @@ private:
   HRESULT SetMainMethod(CCompressionMethodMode &method
       #ifndef _7ZIP_ST
       , UInt32 numThreads
+      , UInt64 newDataSize, UInt64 maxFileSize, UInt32 &numFolderThreads
       #endif
       );
+  #ifndef _7ZIP_ST
+  UInt32 GetNumFolderThreads(const CCompressionMethodMode &method, UInt32 numThreads,
+      UInt64 newDataSize, UInt64 maxFileSize) const;
+  #endif
 
 
   #endif
@@ -65,10 +65,121 @@ HRESULT CHandler::SetHeaderMethod(CCompressionMethodMode &headerMethod)
   return PropsMethod_To_FullMethod(methodFull, m);
 }
 
+#ifndef _7ZIP_ST
+
+/* If coders can't use several threads for one folder, Update() encodes
+   several folders in parallel. Each folder thread keeps whole folder and
+   packed data in memory, so the number of threads is limited by _memUsage.
+   The estimate also includes the ring buffers of CMixerMT binders and
+   the budget of temp buffers for additional pack streams (BCJ2). */
+
+UInt32 CHandler::GetNumFolderThreads(const CCompressionMethodMode &methodMode, UInt32 numThreads,
+    UInt64 newDataSize, UInt64 maxFileSize) const
+{
+  if (numThreads <= 1)
+    return 1;
+  
+  UInt64 folderSize = _numSolidBytes;
+  if (_numSolidFiles == 1)
+    folderSize = maxFileSize;
+  else if (folderSize >= newDataSize)
+    return 1; // there is only one folder
+  if (folderSize > newDataSize)
+    folderSize = newDataSize;
+  
+  UInt64 coderMem = 0;
+  bool mainCoderWasFound = false;
+  
+  FOR_VECTOR (i, methodMode.Methods)
+  {
+    const CMethodFull &m = methodMode.Methods[i];
+    if (IsFilterMethod(m.Id) || m.Id == k_AES)
+      continue;
+    switch (m.Id)
+    {
+      case k_PPMD:
+        coderMem += m.Get_Ppmd_MemSize();
+        break;
+      case k_LZMA2:
+        // LZMA2 encoder uses threads for blocks in big folder
+        if (folderSize > m.Get_Xz_BlockSize())
+          return 1;
+        // fall through
+      case k_LZMA:
+        coderMem += (UInt64)m.Get_Lzma_DicSize() * 23 / 2;
+        break;
+      case k_Deflate:
+        coderMem += (UInt64)1 << 22;
+        break;
+      default:
+        // Copy and BZip2 (it's multithreaded), or external codec
+        return 1;
+    }
+    mainCoderWasFound = true;
+  }
+  
+  if (!mainCoderWasFound)
+    return 1;
+  
+  unsigned numBonds = methodMode.Bonds.IsEmpty() ?
+      methodMode.Methods.Size() - 1 :
+      methodMode.Bonds.Size();
+  bool bcj2 = false;
+  if (methodMode.Filter_was_Inserted)
+    bcj2 = (methodMode.Methods[0].Id == k_BCJ2);
+  else if (GetLevel() != 0 && _autoFilter)
+  {
+    // Update() can insert filter for files of some types
+    numBonds++;
+    bcj2 = (GetLevel() >= 8);
+  }
+  
+  if (bcj2)
+  {
+    // two LZMA coders for BCJ2 streams (see AddBcj2Methods() in 7zUpdate.cpp)
+    numBonds += 2;
+    coderMem += ((UInt64)1 << 20) * 23;
+  }
+  else
+  {
+    // BCJ2 with bonds from user
+    FOR_VECTOR (i, methodMode.Methods)
+      if (!methodMode.Methods[i].IsSimpleCoder())
+        bcj2 = true;
+  }
+  
+  UInt64 memUsage = _memUsage;
+  if (bcj2)
+  {
+    // temp buffers of additional pack streams (see TempBufferMemSize in UpdateItems())
+    const UInt64 tempMem = _memUsage / 8;
+    if (memUsage <= tempMem)
+      return 1;
+    memUsage -= tempMem;
+  }
+  
+  if (_useMultiThreadMixer)
+  {
+    // see kBinderRingSize_Default in CoderMixer2.h
+    const UInt32 ringSize = (_binderRingSize == (UInt32)(Int32)-1) ? ((UInt32)1 << 22) : _binderRingSize;
+    coderMem += (UInt64)ringSize * numBonds;
+  }
+  
+  // unpacked data, packed data, and buffers of coders and streams
+  const UInt64 memPerFolder = folderSize * 2 + coderMem + ((UInt64)1 << 23);
+  UInt64 num = memUsage / memPerFolder;
+  if (num > numThreads)
+    num = numThreads;
+  return (num < 2) ? 1 : (UInt32)num;
+}
+
+#endif
+
 HRESULT CHandler::SetMainMethod(
     CCompressionMethodMode &methodMode
     #ifndef _7ZIP_ST
     , UInt32 numThreads
+    , UInt64 newDataSize, UInt64 maxFileSize, UInt32 &numFolderThreads
     #endif
     )
 {
@@ -108,6 +219,11 @@ HRESULT CHandler::SetMainMethod(
 
   const UInt64 kSolidBytes_Min = (1 << 24);
   const UInt64 kSolidBytes_Max = ((UInt64)1 << 32) - 1;
+  #ifndef _7ZIP_ST
+  const UInt64 kSolidBytes_FolderMt_Max = (1 << 28);
+  // smaller solid block for parallel encoding of folders. (0) means not used
+  UInt64 numSolidBytes_FolderMt = 0;
+  #endif
 
   bool needSolid = false;
   
@@ -116,9 +232,6 @@ HRESULT CHandler::SetMainMethod(
     COneMethodInfo &oneMethodInfo = methods[i];
 
     SetGlobalLevelTo(oneMethodInfo);
-    #ifndef _7ZIP_ST
-    CMultiMethodProps::SetMethodThreadsTo(oneMethodInfo, numThreads);
-    #endif
 
     CMethodFull &methodFull = methodMode.Methods.AddNew();
     RINOK(PropsMethod_To_FullMethod(methodFull, oneMethodInfo));
@@ -141,6 +254,15 @@ HRESULT CHandler::SetMainMethod(
     }
     
     _numSolidBytes = (UInt64)dicSize << 7;
+    #ifndef _7ZIP_ST
+    if ((methodFull.Id == k_PPMD || methodFull.Id == k_LZMA) && numThreads > 1)
+    {
+      UInt64 v = (UInt64)dicSize << 3;
+      if (v > kSolidBytes_FolderMt_Max) v = kSolidBytes_FolderMt_Max;
+      if (v < kSolidBytes_Min) v = kSolidBytes_Min;
+      numSolidBytes_FolderMt = v;
+    }
+    #endif
     if (_numSolidBytes < kSolidBytes_Min) _numSolidBytes = kSolidBytes_Min;
     if (_numSolidBytes > kSolidBytes_Max) _numSolidBytes = kSolidBytes_Max;
     _numSolidBytesDefined = true;
@@ -152,6 +274,31 @@ HRESULT CHandler::SetMainMethod(
     else
       _numSolidBytes = 0;
   _numSolidBytesDefined = true;
+
+  #ifndef _7ZIP_ST
+  numFolderThreads = 1;
+  if (numSolidBytes_FolderMt != 0)
+  {
+    /* PPMd and LZMA encoders can't use many threads. So we try smaller solid blocks,
+       and Update() encodes these independent folders in parallel.
+       If there is only one folder, or there is no memory for parallel folders,
+       we keep big solid block. */
+    const UInt64 numSolidBytes = _numSolidBytes;
+    _numSolidBytes = numSolidBytes_FolderMt;
+    numFolderThreads = GetNumFolderThreads(methodMode, numThreads, newDataSize, maxFileSize);
+    if (numFolderThreads <= 1)
+      _numSolidBytes = numSolidBytes;
+  }
+  if (numFolderThreads <= 1)
+    numFolderThreads = GetNumFolderThreads(methodMode, numThreads, newDataSize, maxFileSize);
+  {
+    // each coder uses one thread, if we encode folders in parallel
+    const UInt32 numCoderThreads = (numFolderThreads > 1 ? 1 : numThreads);
+    FOR_VECTOR (i, methodMode.Methods)
+      CMultiMethodProps::SetMethodThreadsTo(methodMode.Methods[i], numCoderThreads);
+  }
+  #endif
+
   return S_OK;
 }
 
@@ -543,9 +690,26 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
 
   CCompressionMethodMode methodMode, headerMethod;
 
+  #ifndef _7ZIP_ST
+  UInt64 newDataSize = 0;
+  UInt64 maxFileSize = 0;
+  FOR_VECTOR (k, updateItems)
+  {
+    const CUpdateItem &ui = updateItems[k];
+    if (ui.NewData && !ui.IsDir)
+    {
+      newDataSize += ui.Size;
+      if (maxFileSize < ui.Size)
+        maxFileSize = ui.Size;
+    }
+  }
+  UInt32 numFolderThreads = 1;
+  #endif
+
   HRESULT res = SetMainMethod(methodMode
     #ifndef _7ZIP_ST
     , _numThreads
+    , newDataSize, maxFileSize, numFolderThreads
     #endif
     );
   RINOK(res);
@@ -555,6 +719,7 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
   #ifndef _7ZIP_ST
   methodMode.NumThreads = _numThreads;
   methodMode.MultiThreadMixer = _useMultiThreadMixer;
+  methodMode.BinderRingSize = _binderRingSize;
   headerMethod.NumThreads = 1;
   headerMethod.MultiThreadMixer = _useMultiThreadMixer;
   #endif
@@ -627,11 +792,20 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
   options.NumSolidBytes = _numSolidBytes;
   options.SolidExtension = _solidExtension;
   options.UseTypeSorting = _useTypeSorting;
+  options.UseSimilaritySorting = _useSimilaritySorting;
 
   options.RemoveSfxBlock = _removeSfxBlock;
   // options.VolumeMode = _volumeMode;
 
   options.MultiThreadMixer = _useMultiThreadMixer;
+  options.BinderRingSize = _binderRingSize;
+
+  #ifndef _7ZIP_ST
+  options.NumFolderThreads = numFolderThreads;
+  /* the temp buffers for additional pack streams (BCJ2) keep data in memory
+     up to this part of "memuse" limit */
+  options.TempBufferMemSize = _memUsage / 8;
+  #endif
 
   COutArchive archive;
   CArchiveDatabaseOut newDatabase;
@@ -715,11 +889,14 @@ void COutHandler::InitProps()
   Write_Attrib.Init();
 
   _useMultiThreadMixer = true;
+  _binderRingSize = (UInt32)(Int32)-1;
+  _useHeaderIndex = false;
 
   // _volumeMode = false;
 
   InitSolid();
   _useTypeSorting = false;
+  _useSimilaritySorting = false;
 }
 
 HRESULT COutHandler::SetSolidFromString(const UString &s)
@@ -841,8 +1018,11 @@ HRESULT COutHandler::SetProperty(const wchar_t *nameSpec, const PROPVARIANT &val
     if (name.IsEqualTo("tr")) return PROPVARIANT_to_BoolPair(value, Write_Attrib);
     
     if (name.IsEqualTo("mtf")) return PROPVARIANT_to_bool(value, _useMultiThreadMixer);
+    if (name.IsEqualTo("mtb")) return PROPVARIANT_to_Size32(value, _binderRingSize);
+    if (name.IsEqualTo("hi")) return PROPVARIANT_to_bool(value, _useHeaderIndex);
 
     if (name.IsEqualTo("qs")) return PROPVARIANT_to_bool(value, _useTypeSorting);
+    if (name.IsEqualTo("qsim")) return PROPVARIANT_to_bool(value, _useSimilaritySorting);
 
     // if (name.IsEqualTo("v"))  return PROPVARIANT_to_bool(value, _volumeMode);
   }
@@ -1485,6 +1485,544 @@ void CDbEx::FillLinks()
 }
 
 
+#ifndef _SFX
+
+/*
+  Header index image:
+    signature (8 bytes)
+    key (kIndexKeySize bytes)
+    UInt64 : size of data
+    UInt32 : CRC of data
+    data   : arrays of CDbEx (without links that are recalculated with FillLinks())
+  Each array is stored as UInt32 (the number of items) and items in little-endian.
+  (kIndexNullArray) is used for unallocated CObjArray.
+*/
+
+static const Byte kIndexSignature[8] = { '7', 'z', 'I', 'd', 'x', 0x1A, 0, 1 };
+static const unsigned kIndexHeaderSize = 8 + kIndexKeySize + 8 + 4;
+static const UInt32 kIndexNullArray = (UInt32)0 - 1;
+
+void CInArchive::GetIndexKey(UInt64 mTime, Byte *key) const
+{
+  SetUi64(key, _fileEndPosition);
+  SetUi64(key + 8, _arhiveBeginStreamPosition);
+  SetUi64(key + 16, mTime);
+  memcpy(key + 24, _header, kHeaderSize);
+}
+
+// if (_buf == NULL), it only counts the size of data
+
+class CIndexWriter
+{
+  Byte *_buf;
+  size_t _pos;
+public:
+  CIndexWriter(Byte *buf): _buf(buf), _pos(0) {}
+  size_t GetPos() const { return _pos; }
+
+  void WriteBytes(const void *data, size_t size)
+  {
+    if (_buf && size != 0)
+      memcpy(_buf + _pos, data, size);
+    _pos += size;
+  }
+  void WriteByte(Byte b)
+  {
+    if (_buf)
+      _buf[_pos] = b;
+    _pos++;
+  }
+  void WriteUInt32(UInt32 v)
+  {
+    if (_buf)
+      SetUi32(_buf + _pos, v);
+    _pos += 4;
+  }
+  void WriteUInt64(UInt64 v)
+  {
+    if (_buf)
+      SetUi64(_buf + _pos, v);
+    _pos += 8;
+  }
+
+  void WriteNum(const void *p, size_t num)
+  {
+    WriteUInt32(p ? (UInt32)num : kIndexNullArray);
+  }
+  void WriteArray(const UInt32 *p, size_t num)
+  {
+    WriteNum(p, num);
+    if (p)
+      for (size_t i = 0; i < num; i++)
+        WriteUInt32(p[i]);
+  }
+  void WriteArray(const UInt64 *p, size_t num)
+  {
+    WriteNum(p, num);
+    if (p)
+      for (size_t i = 0; i < num; i++)
+        WriteUInt64(p[i]);
+  }
+  void WriteArray(const size_t *p, size_t num)
+  {
+    WriteNum(p, num);
+    if (p)
+      for (size_t i = 0; i < num; i++)
+        WriteUInt64(p[i]);
+  }
+  void WriteArray(const Byte *p, size_t num)
+  {
+    WriteNum(p, num);
+    if (p)
+      WriteBytes(p, num);
+  }
+  void WriteVector(const CBoolVector &v)
+  {
+    WriteUInt32(v.Size());
+    FOR_VECTOR (i, v)
+      WriteByte(v[i] ? 1 : 0);
+  }
+  void WriteVector(const CRecordVector<UInt32> &v)
+  {
+    WriteUInt32(v.Size());
+    FOR_VECTOR (i, v)
+      WriteUInt32(v[i]);
+  }
+  void WriteVector(const CRecordVector<UInt64> &v)
+  {
+    WriteUInt32(v.Size());
+    FOR_VECTOR (i, v)
+      WriteUInt64(v[i]);
+  }
+  void WriteDefVector(const CUInt32DefVector &v)
+  {
+    WriteVector(v.Defs);
+    WriteVector(v.Vals);
+  }
+  void WriteDefVector(const CUInt64DefVector &v)
+  {
+    WriteVector(v.Defs);
+    WriteVector(v.Vals);
+  }
+
+  void WriteDb(const CDbEx &db);
+};
+
+void CIndexWriter::WriteDb(const CDbEx &db)
+{
+  const CNum numFolders = db.NumFolders;
+  const unsigned numFiles = db.Files.Size();
+
+  WriteUInt32(db.NumPackStreams);
+  WriteUInt32(numFolders);
+  WriteArray(db.PackPositions, db.NumPackStreams + 1);
+  WriteDefVector(db.FolderCRCs);
+  WriteArray(db.NumUnpackStreamsVector, numFolders);
+  WriteArray(db.CoderUnpackSizes, db.FoToCoderUnpackSizes ? db.FoToCoderUnpackSizes[numFolders] : 0);
+  WriteArray(db.FoToCoderUnpackSizes, numFolders + 1);
+  WriteArray(db.FoStartPackStreamIndex, numFolders + 1);
+  WriteArray(db.FoToMainUnpackSizeIndex, numFolders);
+  WriteArray(db.FoCodersDataOffset, numFolders + 1);
+  WriteArray(db.CodersData, db.CodersData.Size());
+  WriteByte(db.ParsedMethods.Lzma2Prop);
+  WriteUInt32(db.ParsedMethods.LzmaDic);
+  WriteVector(db.ParsedMethods.IDs);
+
+  WriteUInt32(numFiles);
+  for (unsigned i = 0; i < numFiles; i++)
+  {
+    const CFileItem &file = db.Files[i];
+    WriteUInt64(file.Size);
+    WriteUInt32(file.Crc);
+    WriteByte((Byte)((file.HasStream ? 1 : 0) | (file.IsDir ? 2 : 0) | (file.CrcDefined ? 4 : 0)));
+  }
+  WriteDefVector(db.CTime);
+  WriteDefVector(db.ATime);
+  WriteDefVector(db.MTime);
+  WriteDefVector(db.StartPos);
+  WriteDefVector(db.Attrib);
+  WriteVector(db.IsAnti);
+  WriteArray(db.NamesBuf, db.NamesBuf.Size());
+  WriteArray(db.NameOffsets, numFiles + 1);
+
+  WriteByte(db.ArcInfo.Version.Major);
+  WriteByte(db.ArcInfo.Version.Minor);
+  WriteUInt64(db.ArcInfo.StartPosition);
+  WriteUInt64(db.ArcInfo.StartPositionAfterHeader);
+  WriteUInt64(db.ArcInfo.DataStartPosition);
+  WriteUInt64(db.ArcInfo.DataStartPosition2);
+  WriteVector(db.ArcInfo.FileInfoPopIDs);
+
+  WriteUInt64(db.HeadersSize);
+  WriteUInt64(db.PhySize);
+  WriteByte((Byte)((db.IsArc ? 1 : 0) | (db.PhySizeWasConfirmed ? 2 : 0)));
+}
+
+void CDbEx::WriteIndex(const Byte *key, CByteBuffer &image) const
+{
+  CIndexWriter counter(NULL);
+  counter.WriteDb(*this);
+  const size_t size = counter.GetPos();
+  
+  image.Alloc(kIndexHeaderSize + size);
+  Byte *p = image;
+  CIndexWriter writer(p + kIndexHeaderSize);
+  writer.WriteDb(*this);
+  
+  memcpy(p, kIndexSignature, 8);
+  memcpy(p + 8, key, kIndexKeySize);
+  SetUi64(p + 8 + kIndexKeySize, size);
+  SetUi32(p + 8 + kIndexKeySize + 8, CrcCalc(p + kIndexHeaderSize, size));
+}
+
+// CIndexReader throws CInArchiveException for incorrect data
+
+class CIndexReader: public CInByte2
+{
+  UInt32 ReadNum(size_t itemSize)
+  {
+    UInt32 num = ReadUInt32();
+    if (num != kIndexNullArray && num > GetRem() / itemSize)
+      ThrowIncorrect();
+    return num;
+  }
+public:
+  void ReadArray(CObjArray<UInt32> &a, size_t num)
+  {
+    UInt32 n = ReadNum(4);
+    if (n == kIndexNullArray)
+      return;
+    if (n != num)
+      ThrowIncorrect();
+    a.Alloc(num);
+    for (size_t i = 0; i < num; i++)
+      a[i] = ReadUInt32();
+  }
+  void ReadArray(CObjArray<UInt64> &a, size_t num)
+  {
+    UInt32 n = ReadNum(8);
+    if (n == kIndexNullArray)
+      return;
+    if (n != num)
+      ThrowIncorrect();
+    a.Alloc(num);
+    for (size_t i = 0; i < num; i++)
+      a[i] = ReadUInt64();
+  }
+  void ReadArray(CObjArray<size_t> &a, size_t num)
+  {
+    UInt32 n = ReadNum(8);
+    if (n == kIndexNullArray)
+      return;
+    if (n != num)
+      ThrowIncorrect();
+    a.Alloc(num);
+    for (size_t i = 0; i < num; i++)
+    {
+      UInt64 v = ReadUInt64();
+      if (v != (size_t)v)
+        ThrowIncorrect();
+      a[i] = (size_t)v;
+    }
+  }
+  void ReadArray(CObjArray<Byte> &a, size_t num)
+  {
+    UInt32 n = ReadNum(1);
+    if (n == kIndexNullArray)
+      return;
+    if (n != num)
+      ThrowIncorrect();
+    a.Alloc(num);
+    ReadBytes(a, num);
+  }
+  void ReadBuffer(CByteBuffer &buf)
+  {
+    UInt32 n = ReadNum(1);
+    if (n == kIndexNullArray)
+      return;
+    buf.Alloc(n);
+    ReadBytes(buf, n);
+  }
+  void ReadVector(CBoolVector &v)
+  {
+    UInt32 n = ReadNum(1);
+    if (n == kIndexNullArray)
+      ThrowIncorrect();
+    v.ClearAndSetSize(n);
+    for (unsigned i = 0; i < n; i++)
+      v[i] = (ReadByte() != 0);
+  }
+  void ReadVector(CRecordVector<UInt32> &v)
+  {
+    UInt32 n = ReadNum(4);
+    if (n == kIndexNullArray)
+      ThrowIncorrect();
+    v.ClearAndSetSize(n);
+    for (unsigned i = 0; i < n; i++)
+      v[i] = ReadUInt32();
+  }
+  void ReadVector(CRecordVector<UInt64> &v)
+  {
+    UInt32 n = ReadNum(8);
+    if (n == kIndexNullArray)
+      ThrowIncorrect();
+    v.ClearAndSetSize(n);
+    for (unsigned i = 0; i < n; i++)
+      v[i] = ReadUInt64();
+  }
+  void ReadDefVector(CUInt32DefVector &v)
+  {
+    ReadVector(v.Defs);
+    ReadVector(v.Vals);
+  }
+  void ReadDefVector(CUInt64DefVector &v)
+  {
+    ReadVector(v.Defs);
+    ReadVector(v.Vals);
+  }
+
+  void ReadDb(CDbEx &db);
+};
+
+void CIndexReader::ReadDb(CDbEx &db)
+{
+  db.NumPackStreams = ReadUInt32();
+  const CNum numFolders = ReadUInt32();
+  if (db.NumPackStreams >= kNumMax || numFolders >= kNumMax)
+    ThrowIncorrect();
+  db.NumFolders = numFolders;
+  ReadArray(db.PackPositions, (size_t)db.NumPackStreams + 1);
+  ReadDefVector(db.FolderCRCs);
+  ReadArray(db.NumUnpackStreamsVector, numFolders);
+  {
+    // CoderUnpackSizes is stored before FoToCoderUnpackSizes
+    UInt32 n = ReadUInt32();
+    if (n != kIndexNullArray)
+    {
+      if (n > GetRem() / 8)
+        ThrowIncorrect();
+      db.CoderUnpackSizes.Alloc(n);
+      for (UInt32 i = 0; i < n; i++)
+        db.CoderUnpackSizes[i] = ReadUInt64();
+    }
+    ReadArray(db.FoToCoderUnpackSizes, (size_t)numFolders + 1);
+    if (db.FoToCoderUnpackSizes
+        && (n == kIndexNullArray || db.FoToCoderUnpackSizes[numFolders] != n))
+      ThrowIncorrect();
+  }
+  ReadArray(db.FoStartPackStreamIndex, (size_t)numFolders + 1);
+  ReadArray(db.FoToMainUnpackSizeIndex, numFolders);
+  ReadArray(db.FoCodersDataOffset, (size_t)numFolders + 1);
+  ReadBuffer(db.CodersData);
+  db.ParsedMethods.Lzma2Prop = ReadByte();
+  db.ParsedMethods.LzmaDic = ReadUInt32();
+  ReadVector(db.ParsedMethods.IDs);
+
+  const UInt32 numFiles = ReadUInt32();
+  if (numFiles >= kNumMax || numFiles > GetRem() / 13)
+    ThrowIncorrect();
+  db.Files.ClearAndSetSize(numFiles);
+  for (unsigned i = 0; i < numFiles; i++)
+  {
+    CFileItem &file = db.Files[i];
+    file.Size = ReadUInt64();
+    file.Crc = ReadUInt32();
+    Byte flags = ReadByte();
+    file.HasStream = ((flags & 1) != 0);
+    file.IsDir = ((flags & 2) != 0);
+    file.CrcDefined = ((flags & 4) != 0);
+  }
+  ReadDefVector(db.CTime);
+  ReadDefVector(db.ATime);
+  ReadDefVector(db.MTime);
+  ReadDefVector(db.StartPos);
+  ReadDefVector(db.Attrib);
+  ReadVector(db.IsAnti);
+  ReadBuffer(db.NamesBuf);
+  ReadArray(db.NameOffsets, (size_t)numFiles + 1);
+
+  db.ArcInfo.Version.Major = ReadByte();
+  db.ArcInfo.Version.Minor = ReadByte();
+  db.ArcInfo.StartPosition = ReadUInt64();
+  db.ArcInfo.StartPositionAfterHeader = ReadUInt64();
+  db.ArcInfo.DataStartPosition = ReadUInt64();
+  db.ArcInfo.DataStartPosition2 = ReadUInt64();
+  ReadVector(db.ArcInfo.FileInfoPopIDs);
+
+  db.HeadersSize = ReadUInt64();
+  db.PhySize = ReadUInt64();
+  Byte flags = ReadByte();
+  db.IsArc = ((flags & 1) != 0);
+  db.PhySizeWasConfirmed = ((flags & 2) != 0);
+
+  if (GetRem() != 0)
+    ThrowIncorrect();
+}
+
+static void CheckDefVector(const CUInt32DefVector &v)
+{
+  if (v.Defs.Size() != v.Vals.Size())
+    ThrowIncorrect();
+}
+
+static void CheckDefVector(const CUInt64DefVector &v)
+{
+  if (v.Defs.Size() != v.Vals.Size())
+    ThrowIncorrect();
+}
+
+// it checks the folder in same way as ReadUnpackInfo()
+
+static void CheckIndexedFolder(const CFolder &folder, unsigned mainCoder)
+{
+  const unsigned numCoders = folder.Coders.Size();
+  if (numCoders > k_Scan_NumCoders_MAX)
+    ThrowUnsupported();
+  unsigned numInStreams = 0;
+  unsigned i;
+  for (i = 0; i < numCoders; i++)
+  {
+    if (folder.Coders[i].NumStreams > k_Scan_NumCodersStreams_in_Folder_MAX)
+      ThrowUnsupported();
+    numInStreams += folder.Coders[i].NumStreams;
+  }
+  if (numInStreams > k_Scan_NumCodersStreams_in_Folder_MAX)
+    ThrowUnsupported();
+  
+  CBoolVector streamUsed;
+  CBoolVector coderUsed;
+  BoolVector_Fill_False(streamUsed, numInStreams);
+  BoolVector_Fill_False(coderUsed, numCoders);
+  
+  FOR_VECTOR (k, folder.Bonds)
+  {
+    const CBond &bond = folder.Bonds[k];
+    if (bond.PackIndex >= numInStreams || streamUsed[bond.PackIndex]
+        || bond.UnpackIndex >= numCoders || coderUsed[bond.UnpackIndex])
+      ThrowUnsupported();
+    streamUsed[bond.PackIndex] = true;
+    coderUsed[bond.UnpackIndex] = true;
+  }
+  FOR_VECTOR (k, folder.PackStreams)
+  {
+    const UInt32 index = folder.PackStreams[k];
+    if (index >= numInStreams || streamUsed[index])
+      ThrowUnsupported();
+    streamUsed[index] = true;
+  }
+  
+  for (i = 0; i < numCoders; i++)
+    if (!coderUsed[i])
+      break;
+  if (i != mainCoder)
+    ThrowIncorrect();
+}
+
+static void CheckIndexedDb(const CDbEx &db)
+{
+  const CNum numFolders = db.NumFolders;
+  const unsigned numFiles = db.Files.Size();
+  
+  CheckDefVector(db.FolderCRCs);
+  CheckDefVector(db.CTime);
+  CheckDefVector(db.ATime);
+  CheckDefVector(db.MTime);
+  CheckDefVector(db.StartPos);
+  CheckDefVector(db.Attrib);
+  
+  if (numFolders != 0)
+  {
+    if (!db.PackPositions
+        || !db.NumUnpackStreamsVector
+        || !db.CoderUnpackSizes
+        || !db.FoToCoderUnpackSizes
+        || !db.FoStartPackStreamIndex
+        || !db.FoToMainUnpackSizeIndex
+        || !db.FoCodersDataOffset)
+      ThrowIncorrect();
+    if (db.FoStartPackStreamIndex[0] != 0
+        || db.FoToCoderUnpackSizes[0] != 0
+        || db.FoCodersDataOffset[0] != 0
+        || db.FoCodersDataOffset[numFolders] != db.CodersData.Size())
+      ThrowIncorrect();
+    
+    CFolder folder;
+    for (CNum i = 0; i < numFolders; i++)
+    {
+      const CNum packStart = db.FoStartPackStreamIndex[i];
+      const CNum unpackStart = db.FoToCoderUnpackSizes[i];
+      if (db.FoStartPackStreamIndex[i + 1] < packStart
+          || db.FoStartPackStreamIndex[i + 1] > db.NumPackStreams
+          || db.FoToCoderUnpackSizes[i + 1] < unpackStart
+          || db.FoCodersDataOffset[i + 1] < db.FoCodersDataOffset[i])
+        ThrowIncorrect();
+      
+      // ParseFolderInfo() throws exception for incorrect data
+      db.ParseFolderInfo(i, folder);
+      if (folder.PackStreams.Size() != db.FoStartPackStreamIndex[i + 1] - packStart
+          || folder.Coders.Size() != db.FoToCoderUnpackSizes[i + 1] - unpackStart)
+        ThrowIncorrect();
+      CheckIndexedFolder(folder, db.FoToMainUnpackSizeIndex[i]);
+    }
+  }
+  
+  for (unsigned i = 0; i < numFiles; i++)
+  {
+    const CFileItem &file = db.Files[i];
+    if (file.HasStream ? file.IsDir : (file.Size != 0 || file.CrcDefined))
+      ThrowIncorrect();
+  }
+
+  if (db.NameOffsets)
+  {
+    if (db.NameOffsets[0] != 0)
+      ThrowIncorrect();
+    for (unsigned i = 0; i < numFiles; i++)
+    {
+      const size_t end = db.NameOffsets[i + 1];
+      if (end <= db.NameOffsets[i]
+          || end > db.NamesBuf.Size() / 2
+          || Get16(db.NamesBuf + (end - 1) * 2) != 0)
+        ThrowIncorrect();
+    }
+  }
+}
+
+bool CDbEx::ReadIndex(const Byte *key, const Byte *image, size_t size)
+{
+  Clear();
+  if (size < kIndexHeaderSize
+      || memcmp(image, kIndexSignature, 8) != 0
+      || memcmp(image + 8, key, kIndexKeySize) != 0)
+    return false;
+  const UInt64 dataSize = GetUi64(image + 8 + kIndexKeySize);
+  if (dataSize != size - kIndexHeaderSize)
+    return false;
+  const Byte *data = image + kIndexHeaderSize;
+  if (CrcCalc(data, (size_t)dataSize) != GetUi32(image + 8 + kIndexKeySize + 8))
+    return false;
+  
+  try
+  {
+    CIndexReader reader;
+    reader.Init(data, (size_t)dataSize);
+    reader.ReadDb(*this);
+    
+    // CRC doesn't protect from incorrect image that was written by another program.
+    // So we check the links that are used without checks in the handler.
+    CheckIndexedDb(*this);
+    FillLinks();
+  }
+  catch(...)
+  {
+    Clear();
+    return false;
+  }
+  return true;
+}
+
+#endif
+
 HRESULT CInArchive::ReadDatabase2(
     DECL_EXTERNAL_CODECS_LOC_VARS
     CDbEx &db
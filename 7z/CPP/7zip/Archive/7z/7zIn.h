@@ -258,6 +258,12 @@ struct CDbEx: public CDatabase
   }
 
   void FillLinks();
+
+  #ifndef _SFX
+  // header index: binary image of database that is stored in sidecar file
+  void WriteIndex(const Byte *key, CByteBuffer &image) const;
+  bool ReadIndex(const Byte *key, const Byte *image, size_t size);
+  #endif
   
   UInt64 GetFolderStreamPos(CNum folderIndex, unsigned indexInFolder) const
   {
@@ -324,6 +330,13 @@ class CStreamSwitch;
 
 const UInt32 kHeaderSize = 32;
 
+#ifndef _SFX
+/* the key of header index:
+     (archive size), (archive start position), (archive mtime), (start header).
+   start header contains offset, size and CRC of main header. */
+const unsigned kIndexKeySize = 8 + 8 + 8 + kHeaderSize;
+#endif
+
 class CInArchive
 {
   friend class CStreamSwitch;
@@ -423,6 +436,10 @@ public:
   HRESULT Open(IInStream *stream, const UInt64 *searchHeaderSizeLimit); // S_FALSE means is not archive
   void Close();
 
+  #ifndef _SFX
+  void GetIndexKey(UInt64 mTime, Byte *key) const;
+  #endif
+
   HRESULT ReadDatabase(
       DECL_EXTERNAL_CODECS_LOC_VARS
       CDbEx &db
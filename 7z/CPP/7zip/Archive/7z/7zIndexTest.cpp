@@ -0,0 +1,215 @@
+// 7zIndexTest.cpp -- test for header index (.7zi) of 7z archive
+
+#include "StdAfx.h"
+
+#include <stdio.h>
+
+#include "../../../../C/7zCrc.h"
+#include "../../../../C/CpuArch.h"
+
+#include "../../../Common/MyInitGuid.h"
+
+#include "../../Common/StreamObjects.h"
+
+#include "7zIn.h"
+
+using namespace NArchive;
+using namespace N7z;
+
+/* 7z archive: "a.txt" and "dir/b.txt" in two LZMA folders, "empty.txt" and compressed header */
+
+static const Byte kArc[] =
+{
+  0x37, 0x7A, 0xBC, 0xAF, 0x27, 0x1C, 0x00, 0x04, 0x81, 0xBC, 0x50, 0xDD,
+  0x11, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x22, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x6D, 0x01, 0xF3, 0x17, 0x00, 0x1B, 0x9E, 0x80,
+  0x06, 0x9A, 0x12, 0x58, 0xAD, 0xA6, 0xB4, 0x10, 0x46, 0xE9, 0xB7, 0xE1,
+  0x46, 0x4B, 0x60, 0x99, 0xF7, 0x03, 0x05, 0x6D, 0x30, 0x20, 0xFA, 0xC1,
+  0x0D, 0x27, 0xF3, 0x7B, 0x6D, 0x38, 0x42, 0xE7, 0x64, 0x62, 0x7A, 0x11,
+  0x52, 0x65, 0x87, 0xA9, 0xC1, 0x65, 0xA1, 0xC4, 0x6F, 0x3A, 0x59, 0xEF,
+  0xAD, 0x0B, 0xA6, 0x96, 0x36, 0xF1, 0x10, 0x3A, 0x0C, 0x19, 0x89, 0xD2,
+  0x8E, 0x50, 0xEA, 0xDA, 0x76, 0xA6, 0x28, 0x9B, 0x94, 0x63, 0xCD, 0x1B,
+  0xD0, 0x00, 0x39, 0x99, 0x48, 0x91, 0xB1, 0x69, 0x96, 0x07, 0xC3, 0x18,
+  0x59, 0xA6, 0xE9, 0x0A, 0x07, 0x75, 0x47, 0x1A, 0xFF, 0xF4, 0x92, 0x0E,
+  0xAB, 0x07, 0x59, 0x7A, 0x83, 0xF5, 0x06, 0x41, 0x60, 0x69, 0x71, 0xCA,
+  0x5B, 0x98, 0x94, 0xB2, 0xB4, 0x40, 0x5F, 0xBA, 0x0F, 0x27, 0x4E, 0xF0,
+  0x1B, 0x5A, 0x45, 0x32, 0x69, 0x4D, 0x0E, 0x67, 0x10, 0x22, 0xE8, 0xAE,
+  0xFE, 0x6E, 0x54, 0x12, 0xF5, 0x90, 0x4F, 0x95, 0x72, 0xF5, 0x92, 0x71,
+  0x16, 0x4B, 0xC0, 0xD4, 0x00, 0x00, 0x81, 0x33, 0x07, 0xAE, 0x31, 0x9C,
+  0x94, 0x3A, 0x77, 0xD8, 0x85, 0x43, 0xE1, 0x31, 0xFA, 0x2D, 0xA2, 0x3E,
+  0x65, 0x68, 0xED, 0xA7, 0x19, 0x04, 0x42, 0xD7, 0xBB, 0x6B, 0xE3, 0x0F,
+  0xC6, 0x93, 0x54, 0x16, 0xBE, 0x1A, 0x12, 0xB7, 0x5F, 0x7B, 0xDA, 0x64,
+  0x99, 0xC8, 0x2D, 0xE2, 0x1F, 0x75, 0x6F, 0x1D, 0xC1, 0x97, 0x21, 0xF3,
+  0x82, 0x2A, 0x9D, 0xE9, 0x36, 0x87, 0xBB, 0x1A, 0x09, 0x57, 0x1F, 0x52,
+  0x93, 0x84, 0x33, 0xF2, 0xA4, 0x92, 0x9C, 0x7A, 0x50, 0x0C, 0x8C, 0x5E,
+  0x3F, 0xCA, 0x16, 0x03, 0x87, 0xF7, 0xDE, 0x21, 0xD1, 0xF4, 0x50, 0x4E,
+  0x53, 0xF0, 0x2A, 0x84, 0x8F, 0xCF, 0x0E, 0x6C, 0xB5, 0x60, 0x30, 0x5F,
+  0x42, 0x19, 0x23, 0x82, 0x34, 0xCA, 0x35, 0x74, 0x66, 0x9F, 0xBA, 0x8D,
+  0x48, 0xFC, 0xB8, 0x88, 0x00, 0x17, 0x06, 0x80, 0x98, 0x01, 0x09, 0x79,
+  0x00, 0x07, 0x0B, 0x01, 0x00, 0x01, 0x23, 0x03, 0x01, 0x01, 0x05, 0x5D,
+  0x00, 0x10, 0x00, 0x00, 0x0C, 0x80, 0xB2, 0x0A, 0x01, 0xFB, 0x36, 0xAA,
+  0x79, 0x00, 0x00
+};
+
+// see CDbEx::WriteIndex(): signature, key, data size, data CRC
+static const size_t kIndexHeaderSize = 8 + kIndexKeySize + 8 + 4;
+
+static unsigned g_NumErrors = 0;
+
+static void Error(const char *s)
+{
+  printf("\nERROR: %s\n", s);
+  g_NumErrors++;
+}
+
+static bool AreEqual(const CByteBuffer &a, const CByteBuffer &b)
+{
+  return a.Size() == b.Size() && memcmp(a, b, a.Size()) == 0;
+}
+
+// ReadIndex() must reject the image, and it must leave empty database
+
+static void TestReject(CDbEx &db, const Byte *key, const CByteBuffer &image, const char *s)
+{
+  if (db.ReadIndex(key, image, image.Size()) || db.Files.Size() != 0 || db.NumFolders != 0)
+    Error(s);
+}
+
+static HRESULT OpenArchive(CInArchive &archive, CDbEx &db)
+{
+  CBufInStream *streamSpec = new CBufInStream;
+  CMyComPtr<IInStream> stream = streamSpec;
+  streamSpec->Init(kArc, sizeof(kArc));
+  RINOK(archive.Open(stream, NULL));
+  #ifndef _NO_CRYPTO
+  bool isEncrypted = false;
+  bool passwordIsDefined = false;
+  UString password;
+  #endif
+  return archive.ReadDatabase(
+      EXTERNAL_CODECS_LOC_VARS
+      db
+      #ifndef _NO_CRYPTO
+        , NULL, isEncrypted, passwordIsDefined, password
+      #endif
+      );
+}
+
+int MY_CDECL main()
+{
+  CInArchive archive(false);
+  CDbEx db;
+  if (OpenArchive(archive, db) != S_OK || db.Files.Size() != 3 || db.NumFolders != 2)
+  {
+    printf("\nERROR: can't open test archive\n");
+    return 1;
+  }
+
+  const UInt64 mTime = 0x01D0000012345678;
+  Byte key[kIndexKeySize];
+  archive.GetIndexKey(mTime, key);
+
+  CByteBuffer image;
+  db.WriteIndex(key, image);
+
+  CDbEx db2;
+
+  // the image is accepted with same key, and it contains same database
+  {
+    if (!db2.ReadIndex(key, image, image.Size()))
+      Error("correct index was rejected");
+    else
+    {
+      CByteBuffer image2;
+      db2.WriteIndex(key, image2);
+      if (!AreEqual(image, image2))
+        Error("database from index differs");
+      UString path;
+      db2.GetPath(2, path);
+      if (db2.Files.Size() != 3
+          || path != L"dir/b.txt"
+          || db2.Files[2].Size != db.Files[2].Size
+          || db2.Files[0].HasStream
+          || db2.GetFolderUnpackSize(1) != db.GetFolderUnpackSize(1))
+        Error("incorrect database from index");
+    }
+  }
+
+  // the key of another archive state: mtime, archive size, start header
+  {
+    Byte key2[kIndexKeySize];
+    archive.GetIndexKey(mTime + 1, key2);
+    if (db2.ReadIndex(key2, image, image.Size()) || db2.Files.Size() != 0)
+      Error("index was accepted for another mtime");
+    for (unsigned i = 0; i < kIndexKeySize; i++)
+    {
+      memcpy(key2, key, kIndexKeySize);
+      key2[i] ^= 1;
+      if (db2.ReadIndex(key2, image, image.Size()))
+        Error("index was accepted for another key");
+    }
+  }
+
+  // any changed byte is rejected
+  for (size_t i = 0; i < image.Size(); i++)
+  {
+    CByteBuffer image2;
+    image2.CopyFrom(image, image.Size());
+    image2[i] ^= 0x40;
+    TestReject(db2, key, image2, i < kIndexHeaderSize ?
+        "index with changed header was accepted" :
+        "index with changed data was accepted");
+  }
+
+  // the size of image must match
+  {
+    CByteBuffer image2;
+    image2.CopyFrom(image, image.Size() - 1);
+    TestReject(db2, key, image2, "truncated index was accepted");
+    image2.CopyFrom(image, kIndexHeaderSize - 1);
+    TestReject(db2, key, image2, "truncated index header was accepted");
+    image2.Alloc(image.Size() + 1);
+    memcpy(image2, image, image.Size());
+    image2[image.Size()] = 0;
+    TestReject(db2, key, image2, "index with additional byte was accepted");
+  }
+
+  /* the image with correct CRC can be written by another program.
+     ReadIndex() must not crash for such image, and if it accepts the image,
+     the database must be consistent */
+  {
+    unsigned numAccepted = 0;
+    for (size_t i = kIndexHeaderSize; i < image.Size(); i++)
+    {
+      static const Byte kVals[] = { 0, 1, 0x7F, 0x80, 0xFF };
+      for (unsigned k = 0; k < sizeof(kVals); k++)
+      {
+        CByteBuffer image2;
+        image2.CopyFrom(image, image.Size());
+        if (image2[i] == kVals[k])
+          continue;
+        image2[i] = kVals[k];
+        SetUi32(image2 + kIndexHeaderSize - 4, CrcCalc(image2 + kIndexHeaderSize, image2.Size() - kIndexHeaderSize));
+        if (db2.ReadIndex(key, image2, image2.Size()))
+        {
+          numAccepted++;
+          for (unsigned f = 0; f < db2.Files.Size(); f++)
+          {
+            UString path;
+            db2.GetPath(f, path);
+            db2.GetFilePackSize(f);
+          }
+        }
+      }
+    }
+    printf("Index images with changed data and correct CRC: %u were accepted\n", numAccepted);
+  }
+
+  if (g_NumErrors != 0)
+  {
+    printf("\nErrors: %u\n", g_NumErrors);
+    return 1;
+  }
+  printf("7z header index: OK\n");
+  return 0;
+}
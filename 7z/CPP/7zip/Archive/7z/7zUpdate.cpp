@@ -2,6 +2,7 @@
 
 #include "StdAfx.h"
 
+#include "../../../../C/7zCrc.h"
 #include "../../../../C/CpuArch.h"
 
 #include "../../../Common/Wildcard.h"
@@ -9,6 +10,8 @@
 #include "../../Common/CreateCoder.h"
 #include "../../Common/LimitedStreams.h"
 #include "../../Common/ProgressUtils.h"
+#include "../../Common/StreamObjects.h"
+#include "../../Common/StreamUtils.h"
 
 #include "../../Compress/CopyCoder.h"
 
@@ -796,26 +799,173 @@ static bool IsExeExt(const wchar_t *ext)
   return false;
 }
 
+/*
+  The sketch of file is MinHash over CRCs of chunks of file start.
+  Chunk boundaries are content defined (gear rolling hash), so the insertion
+  or removal of some bytes changes only nearby chunks.
+  The number of equal values in two sketches is the estimation of
+  similarity (Jaccard index) of chunk sets of two files.
+*/
+
+static const unsigned kSketchNumHashes = 16;
+static const unsigned kSketchBandSize = 4;
+static const UInt64 kSketchMinFileSize = 1 << 10;
+static const unsigned kSketchChunkBits = 8; // average chunk size is 256 bytes
+static const size_t kSketchChunkMinSize = 32;
+
+struct CSketch
+{
+  UInt32 Hashes[kSketchNumHashes];
+  bool Defined;
+};
+
+static inline UInt32 MixHash(UInt32 h)
+{
+  h ^= h >> 16; h *= 0x85EBCA6B;
+  h ^= h >> 13; h *= 0xC2B2AE35;
+  h ^= h >> 16;
+  return h;
+}
+
+static void CalcSketch(const Byte *data, size_t size, CSketch &sketch)
+{
+  unsigned k;
+  for (k = 0; k < kSketchNumHashes; k++)
+    sketch.Hashes[k] = 0xFFFFFFFF;
+  
+  size_t start = 0;
+  UInt32 h = 0;
+  
+  for (size_t i = 0; i < size; i++)
+  {
+    // CRC table is used as table of random values for gear hash
+    h = (h << 1) + g_CrcTable[data[i]];
+    size_t chunkSize = i + 1 - start;
+    if ((chunkSize >= kSketchChunkMinSize && (h >> (32 - kSketchChunkBits)) == 0) || i + 1 == size)
+    {
+      UInt32 crc = CrcCalc(data + start, chunkSize);
+      for (k = 0; k < kSketchNumHashes; k++)
+      {
+        UInt32 v = MixHash(crc + (UInt32)k * 0x9E3779B9);
+        if (sketch.Hashes[k] > v)
+          sketch.Hashes[k] = v;
+      }
+      start = i + 1;
+    }
+  }
+  
+  sketch.Defined = true;
+}
+
+static bool AreSketchesSimilar(const CSketch &s1, const CSketch &s2)
+{
+  unsigned num = 0;
+  for (unsigned k = 0; k < kSketchNumHashes; k++)
+    if (s1.Hashes[k] == s2.Hashes[k])
+      num++;
+  return num >= kSketchNumHashes / 2;
+}
+
 struct CAnalysis
 {
   CMyComPtr<IArchiveUpdateCallbackFile> Callback;
   CByteBuffer Buffer;
 
+  // Buffer contains start of file (BufIndex), if BufIsOk
+  int BufIndex;
+  size_t BufSize;
+  bool BufIsOk;
+
   bool ParseWav;
   bool ParseExe;
   bool ParseAll;
 
+  #ifndef _7ZIP_ST
+  // if there are several analysis threads, Callback->GetStream2() calls are serialized with CallbackCS
+  NWindows::NSynchronization::CCriticalSection *CallbackCS;
+  #endif
+
   CAnalysis():
+      BufIndex(-1),
+      BufSize(0),
+      BufIsOk(false),
       ParseWav(true),
       ParseExe(false),
       ParseAll(false)
+      #ifndef _7ZIP_ST
+      , CallbackCS(NULL)
+      #endif
   {}
 
+  void CopyParams(const CAnalysis &a)
+  {
+    Callback = a.Callback;
+    ParseWav = a.ParseWav;
+    ParseExe = a.ParseExe;
+    ParseAll = a.ParseAll;
+  }
+
+  // it sets BufIsOk, if the start of file was read. It returns error code, if GetStream2() or Read() fails
+  HRESULT ReadFileStart(UInt32 index);
   HRESULT GetFilterGroup(UInt32 index, const CUpdateItem &ui, CFilterMode &filterMode);
+  HRESULT GetSketch(UInt32 index, const CUpdateItem &ui, CSketch &sketch);
 };
 
 static const size_t kAnalysisBufSize = 1 << 14;
 
+HRESULT CAnalysis::ReadFileStart(UInt32 index)
+{
+  if (BufIndex == (int)index)
+    return S_OK;
+  BufIndex = (int)index;
+  BufIsOk = false;
+  BufSize = 0;
+  
+  if (Buffer.Size() != kAnalysisBufSize)
+  {
+    Buffer.Alloc(kAnalysisBufSize);
+  }
+  CMyComPtr<ISequentialInStream> stream;
+  HRESULT result;
+  {
+    #ifndef _7ZIP_ST
+    if (CallbackCS)
+      CallbackCS->Enter();
+    #endif
+    result = Callback->GetStream2(index, &stream, NUpdateNotifyOp::kAnalyze);
+    #ifndef _7ZIP_ST
+    if (CallbackCS)
+      CallbackCS->Leave();
+    #endif
+  }
+  // S_FALSE means that file can't be opened. The encoding stage will report it
+  if (result == S_FALSE)
+    return S_OK;
+  RINOK(result);
+  if (stream)
+  {
+    size_t size = kAnalysisBufSize;
+    result = ReadStream(stream, Buffer, &size);
+    stream.Release();
+    // RINOK(Callback->SetOperationResult2(index, NUpdate::NOperationResult::kOK));
+    RINOK(result);
+    BufSize = size;
+    BufIsOk = true;
+  }
+  return S_OK;
+}
+
+HRESULT CAnalysis::GetSketch(UInt32 index, const CUpdateItem &ui, CSketch &sketch)
+{
+  sketch.Defined = false;
+  if (!Callback || ui.Size < kSketchMinFileSize)
+    return S_OK;
+  RINOK(ReadFileStart(index));
+  if (BufIsOk && BufSize >= kSketchMinFileSize)
+    CalcSketch(Buffer, BufSize, sketch);
+  return S_OK;
+}
+
 HRESULT CAnalysis::GetFilterGroup(UInt32 index, const CUpdateItem &ui, CFilterMode &filterMode)
 {
   filterMode.Id = 0;
@@ -879,40 +1029,26 @@ HRESULT CAnalysis::GetFilterGroup(UInt32 index, const CUpdateItem &ui, CFilterMo
 
     if (needReadFile && Callback)
     {
-      if (Buffer.Size() != kAnalysisBufSize)
-      {
-        Buffer.Alloc(kAnalysisBufSize);
-      }
+      RINOK(ReadFileStart(index));
+      if (BufIsOk)
       {
-        CMyComPtr<ISequentialInStream> stream;
-        HRESULT result = Callback->GetStream2(index, &stream, NUpdateNotifyOp::kAnalyze);
-        if (result == S_OK && stream)
+        Bool parseRes = ParseFile(Buffer, BufSize, &filterModeTemp);
+        if (parseRes && filterModeTemp.Delta == 0)
         {
-          size_t size = kAnalysisBufSize;
-          result = ReadStream(stream, Buffer, &size);
-          stream.Release();
-          // RINOK(Callback->SetOperationResult2(index, NUpdate::NOperationResult::kOK));
-          if (result == S_OK)
+          filterModeTemp.SetDelta();
+          if (filterModeTemp.Delta != 0 && filterModeTemp.Id != k_Delta)
           {
-            Bool parseRes = ParseFile(Buffer, size, &filterModeTemp);
-            if (parseRes && filterModeTemp.Delta == 0)
+            if (ui.Size % filterModeTemp.Delta != 0)
             {
-              filterModeTemp.SetDelta();
-              if (filterModeTemp.Delta != 0 && filterModeTemp.Id != k_Delta)
-              {
-                if (ui.Size % filterModeTemp.Delta != 0)
-                {
-                  parseRes = false;
-                }
-              }
-            }
-            if (!parseRes)
-            {
-              filterModeTemp.Id = 0;
-              filterModeTemp.Delta = 0;
+              parseRes = false;
             }
           }
         }
+        if (!parseRes)
+        {
+          filterModeTemp.Id = 0;
+          filterModeTemp.Delta = 0;
+        }
       }
     }
     else if ((needReadFile && !Callback) || probablyIsSameIsa)
@@ -928,6 +1064,213 @@ HRESULT CAnalysis::GetFilterGroup(UInt32 index, const CUpdateItem &ui, CFilterMo
   return S_OK;
 }
 
+static int CompareKeys(const UInt64 *p1, const UInt64 *p2, void * /* param */)
+{
+  return MyCompare(*p1, *p2);
+}
+
+/*
+  CAnalysisQueue calculates filter modes and sketches for all new files before
+  the files are split to groups. The results are same as in sequential analysis.
+  In multithreaded version several threads take next files from queue,
+  so the reading of file starts from slow (network) storage is overlapped,
+  and the number of outstanding reads is limited by the number of threads.
+*/
+
+struct CAnalysisQueue
+{
+  const CObjectVector<CUpdateItem> *UpdateItems;
+  const UInt32 *Indexes;
+  unsigned NumIndexes;
+  CFilterMode *FilterModes; // it's NULL, if filters are not used
+  CSketch *Sketches;        // it's NULL, if similarity sorting is not used
+
+  #ifndef _7ZIP_ST
+  unsigned NextIndex;
+  NWindows::NSynchronization::CCriticalSection CS;
+  NWindows::NSynchronization::CCriticalSection *CallbackCS;
+  #endif
+
+  HRESULT ProcessItem(CAnalysis &analysis, UInt32 index)
+  {
+    const CUpdateItem &ui = (*UpdateItems)[index];
+    if (FilterModes)
+    {
+      RINOK(analysis.GetFilterGroup(index, ui, FilterModes[index]));
+    }
+    // GetSketch() doesn't read the file again, if GetFilterGroup() has read it
+    if (Sketches)
+    {
+      RINOK(analysis.GetSketch(index, ui, Sketches[index]));
+    }
+    return S_OK;
+  }
+
+  #ifndef _7ZIP_ST
+  HRESULT Process(CAnalysis &analysis);
+  #endif
+};
+
+#ifndef _7ZIP_ST
+
+static const unsigned kNumAnalysisThreadsMax = 8;
+
+HRESULT CAnalysisQueue::Process(CAnalysis &analysis)
+{
+  for (;;)
+  {
+    UInt32 index;
+    {
+      NWindows::NSynchronization::CCriticalSectionLock lock(CS);
+      if (NextIndex == NumIndexes)
+        return S_OK;
+      index = Indexes[NextIndex++];
+    }
+    HRESULT res = ProcessItem(analysis, index);
+    if (res != S_OK)
+    {
+      // other threads will not take new items
+      NWindows::NSynchronization::CCriticalSectionLock lock(CS);
+      NextIndex = NumIndexes;
+      return res;
+    }
+  }
+}
+
+class CAnalysisThread: public CPooledVirtThread
+{
+public:
+  CAnalysisQueue *Queue;
+  CAnalysis Analysis;
+  HRESULT Result;
+
+  ~CAnalysisThread() { CPooledVirtThread::WaitThreadFinish(); }
+  virtual void Execute() { Result = Queue->Process(Analysis); }
+};
+
+#endif
+
+static HRESULT RunAnalysis(CAnalysis &analysis, CAnalysisQueue &queue, UInt32 numThreads)
+{
+  #ifndef _7ZIP_ST
+  
+  if (numThreads > kNumAnalysisThreadsMax)
+    numThreads = kNumAnalysisThreadsMax;
+  if (numThreads > queue.NumIndexes)
+    numThreads = queue.NumIndexes;
+  if (numThreads > 1 && analysis.Callback && queue.CallbackCS)
+  {
+    queue.NextIndex = 0;
+    analysis.CallbackCS = queue.CallbackCS;
+    
+    // main thread is also analysis thread
+    CObjArray<CAnalysisThread> threads(numThreads - 1);
+    unsigned numStarted;
+    for (numStarted = 0; numStarted < numThreads - 1; numStarted++)
+    {
+      CAnalysisThread &t = threads[numStarted];
+      t.Queue = &queue;
+      t.Analysis.CopyParams(analysis);
+      t.Analysis.CallbackCS = queue.CallbackCS;
+      if (t.Create() != 0)
+        break;
+      t.Start();
+    }
+    
+    HRESULT res = queue.Process(analysis);
+    
+    for (unsigned i = 0; i < numStarted; i++)
+    {
+      CAnalysisThread &t = threads[i];
+      t.WaitExecuteFinish();
+      if (res == S_OK)
+        res = t.Result;
+    }
+    analysis.CallbackCS = NULL;
+    return res;
+  }
+  
+  #endif
+  
+  for (unsigned i = 0; i < queue.NumIndexes; i++)
+  {
+    RINOK(queue.ProcessItem(analysis, queue.Indexes[i]));
+  }
+  return S_OK;
+}
+
+static unsigned FindClusterRoot(CRecordVector<unsigned> &parents, unsigned i)
+{
+  while (parents[i] != i)
+  {
+    parents[i] = parents[parents[i]];
+    i = parents[i];
+  }
+  return i;
+}
+
+/*
+  SortBySimilarity() moves files with similar sketches to the position of
+  first file of cluster. Other files keep the order of CompareUpdateItems().
+  Candidate pairs are files with equal band (kSketchBandSize hashes) of sketch.
+*/
+
+static void SortBySimilarity(CRecordVector<CRefItem> &refItems, const CRecordVector<CSketch> &sketches)
+{
+  const unsigned numItems = refItems.Size();
+  CRecordVector<unsigned> parents;
+  parents.ClearAndSetSize(numItems);
+  unsigned i;
+  for (i = 0; i < numItems; i++)
+    parents[i] = i;
+
+  CRecordVector<UInt64> keys;
+  keys.ClearAndReserve(numItems);
+  bool wasJoined = false;
+
+  for (unsigned b = 0; b < kSketchNumHashes; b += kSketchBandSize)
+  {
+    keys.Clear();
+    for (i = 0; i < numItems; i++)
+    {
+      const CSketch &sketch = sketches[refItems[i].Index];
+      if (sketch.Defined)
+        keys.AddInReserved(((UInt64)CrcCalc(sketch.Hashes + b, kSketchBandSize * 4) << 32) | i);
+    }
+    keys.Sort(CompareKeys, NULL);
+    
+    for (i = 1; i < keys.Size(); i++)
+    {
+      if ((keys[i] >> 32) != (keys[i - 1] >> 32))
+        continue;
+      unsigned i0 = (unsigned)keys[i - 1];
+      unsigned i1 = (unsigned)keys[i];
+      if (!AreSketchesSimilar(sketches[refItems[i0].Index], sketches[refItems[i1].Index]))
+        continue;
+      unsigned r0 = FindClusterRoot(parents, i0);
+      unsigned r1 = FindClusterRoot(parents, i1);
+      // the root of cluster is the first file of cluster
+      if (r0 < r1)
+        parents[r1] = r0;
+      else
+        parents[r0] = r1;
+      wasJoined = true;
+    }
+  }
+
+  if (!wasJoined)
+    return;
+
+  keys.Clear();
+  for (i = 0; i < numItems; i++)
+    keys.AddInReserved(((UInt64)FindClusterRoot(parents, i) << 32) | i);
+  keys.Sort(CompareKeys, NULL);
+  
+  CRecordVector<CRefItem> temp = refItems;
+  for (i = 0; i < numItems; i++)
+    refItems[i] = temp[(unsigned)keys[i]];
+}
+
 static inline void GetMethodFull(UInt64 methodID, UInt32 numStreams, CMethodFull &m)
 {
   m.Id = methodID;
@@ -1524,6 +1867,182 @@ void CThreadDecoder::Execute()
   FosSpec->_stream.Release();
 }
 
+
+// CLockedProgress serializes the progress calls of coder with other users of updateCallback
+
+class CLockedProgress:
+  public ICompressProgressInfo,
+  public CMyUnknownImp
+{
+  CMyComPtr<ICompressProgressInfo> _progress;
+  NWindows::NSynchronization::CCriticalSection *_cs;
+public:
+  CLockedProgress(ICompressProgressInfo *progress, NWindows::NSynchronization::CCriticalSection *cs):
+      _progress(progress), _cs(cs) {}
+
+  MY_UNKNOWN_IMP1(ICompressProgressInfo)
+  STDMETHOD(SetRatioInfo)(const UInt64 *inSize, const UInt64 *outSize)
+  {
+    NWindows::NSynchronization::CCriticalSectionLock lock(*_cs);
+    return _progress->SetRatioInfo(inSize, outSize);
+  }
+};
+
+
+/* CMtEncProgress serializes the progress calls of encoder threads and main thread.
+   The sizes from encoder threads are ignored: the progress is the size of data
+   that was read to folder buffers. The first error (E_ABORT from Cancel) is
+   returned for all later calls, so all encoder threads break. */
+
+class CMtEncProgress:
+  public ICompressProgressInfo,
+  public CMyUnknownImp
+{
+  NWindows::NSynchronization::CCriticalSection *_cs;
+  CLocalProgress *_lps;
+  HRESULT _result;
+  UInt64 _readSize;  // size of folders that were read to buffers, but were not written yet
+  UInt64 _curSize;   // size of data that was read to buffer of current folder
+
+  HRESULT SetCur_NoLock();
+public:
+  CMtEncProgress(CLocalProgress *lps, NWindows::NSynchronization::CCriticalSection *cs):
+      _cs(cs), _lps(lps), _result(S_OK), _readSize(0), _curSize(0) {}
+
+  MY_UNKNOWN_IMP1(ICompressProgressInfo)
+  STDMETHOD(SetRatioInfo)(const UInt64 *inSize, const UInt64 *outSize);
+
+  HRESULT SetCurSize(UInt64 size);
+  void FolderWasRead();
+  HRESULT FolderWasWritten(UInt64 unpackSize, const CRecordVector<UInt64> &packSizes);
+  void Break();
+};
+
+HRESULT CMtEncProgress::SetCur_NoLock()
+{
+  if (_result == S_OK)
+  {
+    const UInt64 size = _readSize + _curSize;
+    _result = _lps->SetRatioInfo(&size, NULL);
+  }
+  return _result;
+}
+
+STDMETHODIMP CMtEncProgress::SetRatioInfo(const UInt64 * /* inSize */, const UInt64 * /* outSize */)
+{
+  NWindows::NSynchronization::CCriticalSectionLock lock(*_cs);
+  return SetCur_NoLock();
+}
+
+HRESULT CMtEncProgress::SetCurSize(UInt64 size)
+{
+  NWindows::NSynchronization::CCriticalSectionLock lock(*_cs);
+  _curSize = size;
+  return SetCur_NoLock();
+}
+
+void CMtEncProgress::FolderWasRead()
+{
+  NWindows::NSynchronization::CCriticalSectionLock lock(*_cs);
+  _readSize += _curSize;
+  _curSize = 0;
+}
+
+HRESULT CMtEncProgress::FolderWasWritten(UInt64 unpackSize, const CRecordVector<UInt64> &packSizes)
+{
+  NWindows::NSynchronization::CCriticalSectionLock lock(*_cs);
+  FOR_VECTOR (i, packSizes)
+    _lps->OutSize += packSizes[i];
+  _lps->InSize += unpackSize;
+  _readSize -= unpackSize;
+  return SetCur_NoLock();
+}
+
+void CMtEncProgress::Break()
+{
+  NWindows::NSynchronization::CCriticalSectionLock lock(*_cs);
+  if (_result == S_OK)
+    _result = E_ABORT;
+}
+
+
+/* CEncoderThread encodes one new folder from memory buffer to memory buffer.
+   Update() reads the data of folders in main thread, and it writes
+   encoded folders to archive in original order. So the archive is same
+   as archive that is created by sequential encoding with same solid blocks. */
+
+class CEncoderThread: public CVirtThread
+{
+public:
+  CEncoder *Encoder;
+
+  CDynBufSeqOutStream *InBufSpec;
+  CMyComPtr<ISequentialOutStream> InBuf;
+  CDynBufSeqOutStream *OutBufSpec;
+  CMyComPtr<ISequentialOutStream> OutBuf;
+
+  CFolderInStream *FolderInStreamSpec;
+  CMyComPtr<ISequentialInStream> FolderInStream;
+  unsigned StartIndex;
+  unsigned NumSubFiles;
+
+  CFolder *Folder;
+  CRecordVector<UInt64> CoderUnpackSizes;
+  CRecordVector<UInt64> PackSizes;
+  UInt64 UnpackSize;
+  const UInt64 *InSizeForReduce;
+  CMtEncProgress *Progress;
+  HRESULT Result;
+  bool IsBusy;
+
+  DECL_EXTERNAL_CODECS_LOC_VARS2;
+
+  CEncoderThread(): Encoder(NULL), Folder(NULL), Progress(NULL), IsBusy(false)
+  {
+    InBufSpec = new CDynBufSeqOutStream;
+    InBuf = InBufSpec;
+    OutBufSpec = new CDynBufSeqOutStream;
+    OutBuf = OutBufSpec;
+  }
+  
+  ~CEncoderThread()
+  {
+    // busy thread at exit means that Update() failed. So we stop the encoding
+    if (IsBusy && Progress)
+      Progress->Break();
+    CVirtThread::WaitThreadFinish();
+    delete Encoder;
+  }
+  
+  virtual void Execute();
+};
+
+void CEncoderThread::Execute()
+{
+  try
+  {
+    CBufInStream *inStreamSpec = new CBufInStream;
+    CMyComPtr<ISequentialInStream> inStream = inStreamSpec;
+    inStreamSpec->Init(InBufSpec->GetBuffer(), InBufSpec->GetSize());
+    
+    OutBufSpec->Init();
+    CoderUnpackSizes.Clear();
+    PackSizes.Clear();
+    
+    Result = Encoder->Encode(
+        EXTERNAL_CODECS_LOC_VARS
+        inStream,
+        InSizeForReduce,
+        *Folder, CoderUnpackSizes, UnpackSize,
+        OutBuf, PackSizes,
+        Progress);
+  }
+  catch(...)
+  {
+    Result = E_FAIL;
+  }
+}
+
 #endif
 
 #ifndef _NO_CRYPTO
@@ -1559,6 +2078,141 @@ static void GetFile(const CDatabase &inDb, unsigned index, CFileItem &file, CFil
   // file2.IsAux = inDb.IsItemAux(index);
 }
 
+
+static HRESULT AddFolderFiles(
+    const CObjectVector<CUpdateItem> &updateItems,
+    const CDbEx *db,
+    const UInt32 *indices, unsigned numSubFiles,
+    const CFolderInStream &inStream,
+    CArchiveDatabaseOut &newDatabase,
+    IArchiveUpdateCallback *updateCallback,
+    UInt64 &complexity)
+{
+  CNum numUnpackStreams = 0;
+  UInt64 skippedSize = 0;
+  
+  for (unsigned subIndex = 0; subIndex < numSubFiles; subIndex++)
+  {
+    const CUpdateItem &ui = updateItems[indices[subIndex]];
+    CFileItem file;
+    CFileItem2 file2;
+    UString name;
+    if (ui.NewProps)
+    {
+      UpdateItem_To_FileItem(ui, file, file2);
+      name = ui.Name;
+    }
+    else
+    {
+      GetFile(*db, ui.IndexInArchive, file, file2);
+      db->GetPath(ui.IndexInArchive, name);
+    }
+    if (file2.IsAnti || file.IsDir)
+      return E_FAIL;
+    
+    /*
+    CFileItem &file = newDatabase.Files[
+          startFileIndexInDatabase + i + subIndex];
+    */
+    if (!inStream.Processed[subIndex])
+    {
+      skippedSize += ui.Size;
+      continue;
+      // file.Name += ".locked";
+    }
+
+    file.Crc = inStream.CRCs[subIndex];
+    file.Size = inStream.Sizes[subIndex];
+    
+    // if (file.Size >= 0) // test purposes
+    if (file.Size != 0)
+    {
+      file.CrcDefined = true;
+      file.HasStream = true;
+      numUnpackStreams++;
+    }
+    else
+    {
+      file.CrcDefined = false;
+      file.HasStream = false;
+    }
+
+    /*
+    file.Parent = ui.ParentFolderIndex;
+    if (ui.TreeFolderIndex >= 0)
+      treeFolderToArcIndex[ui.TreeFolderIndex] = newDatabase.Files.Size();
+    if (totalSecureDataSize != 0)
+      newDatabase.SecureIDs.Add(ui.SecureIndex);
+    */
+    newDatabase.AddFile(file, file2, name);
+  }
+
+  // numUnpackStreams = 0 is very bad case for locked files
+  // v3.13 doesn't understand it.
+  newDatabase.NumUnpackStreamsVector.Add(numUnpackStreams);
+
+  if (skippedSize != 0 && complexity >= skippedSize)
+  {
+    complexity -= skippedSize;
+    RINOK(updateCallback->SetTotal(complexity));
+  }
+
+  return S_OK;
+}
+
+
+#ifndef _7ZIP_ST
+
+static HRESULT WriteEncodedFolder(
+    CEncoderThread &et,
+    ISequentialOutStream *outStream,
+    const CObjectVector<CUpdateItem> &updateItems,
+    const CDbEx *db,
+    const UInt32 *indices,
+    CArchiveDatabaseOut &newDatabase,
+    NWindows::NSynchronization::CCriticalSection *callbackCS,
+    IArchiveUpdateCallback *updateCallback,
+    UInt64 &complexity)
+{
+  et.IsBusy = false;
+  et.WaitExecuteFinish();
+  RINOK(et.Result);
+  
+  RINOK(WriteStream(outStream, et.OutBufSpec->GetBuffer(), et.OutBufSpec->GetSize()));
+  
+  newDatabase.CoderUnpackSizes += et.CoderUnpackSizes;
+  newDatabase.PackSizes += et.PackSizes;
+  RINOK(et.Progress->FolderWasWritten(et.InBufSpec->GetSize(), et.PackSizes));
+
+  CCallbackLock lock(callbackCS);
+  return AddFolderFiles(updateItems, db, indices + et.StartIndex, et.NumSubFiles,
+      *et.FolderInStreamSpec, newDatabase, updateCallback, complexity);
+}
+
+
+static HRESULT ReadFolderToBuf(ISequentialInStream *inStream, CDynBufSeqOutStream *outBuf,
+    CMtEncProgress *progress)
+{
+  outBuf->Init();
+  const size_t kStep = (size_t)1 << 20;
+  for (;;)
+  {
+    Byte *buf = outBuf->GetBufPtrForWriting(kStep);
+    if (!buf)
+      return E_OUTOFMEMORY;
+    size_t size = kStep;
+    RINOK(ReadStream(inStream, buf, &size));
+    if (size == 0)
+      break;
+    outBuf->UpdateSize(size);
+    RINOK(progress->SetCurSize(outBuf->GetSize()));
+  }
+  progress->FolderWasRead();
+  return S_OK;
+}
+
+#endif
+
 HRESULT Update(
     DECL_EXTERNAL_CODECS_LOC_VARS
     IInStream *inStream,
@@ -1721,6 +2375,10 @@ HRESULT Update(
 
   #ifndef _7ZIP_ST
   
+  /* updateCallback is not thread-safe. The calls from analysis threads,
+     prefetcher thread and encoder threads are serialized with callbackCS. */
+  NWindows::NSynchronization::CCriticalSection callbackCS;
+
   CStreamBinder sb;
   if (options.MultiThreadMixer)
   {
@@ -1730,6 +2388,7 @@ HRESULT Update(
   #endif
 
   CThreadDecoder threadDecoder(options.MultiThreadMixer);
+  threadDecoder.Decoder.BinderRingSize = options.BinderRingSize;
   
   #ifndef _7ZIP_ST
   if (options.MultiThreadMixer && thereAreRepacks)
@@ -1741,6 +2400,11 @@ HRESULT Update(
   }
   #endif
 
+  const bool sortBySimilarity = (options.UseSimilaritySorting
+      && numSolidFiles > 1
+      && !options.SolidExtension);
+  CRecordVector<CSketch> sketches;
+
   {
     CAnalysis analysis;
     if (options.AnalysisLevel == 0)
@@ -1768,16 +2432,49 @@ HRESULT Update(
 
     const CCompressionMethodMode &method = *options.Method;
     
+    CRecordVector<UInt32> newIndexes;
     FOR_VECTOR (i, updateItems)
     {
       const CUpdateItem &ui = updateItems[i];
-      if (!ui.NewData || !ui.HasStream())
-        continue;
+      if (ui.NewData && ui.HasStream())
+        newIndexes.Add(i);
+    }
+
+    CRecordVector<CFilterMode> filterModes;
+    if (useFilters)
+      filterModes.ClearAndSetSize(updateItems.Size());
+    if (sortBySimilarity)
+    {
+      sketches.ClearAndSetSize(updateItems.Size());
+      FOR_VECTOR (i, updateItems)
+        sketches[i].Defined = false;
+    }
+
+    if ((useFilters || sortBySimilarity) && !newIndexes.IsEmpty())
+    {
+      CAnalysisQueue queue;
+      queue.UpdateItems = &updateItems;
+      queue.Indexes = &newIndexes.Front();
+      queue.NumIndexes = newIndexes.Size();
+      queue.FilterModes = useFilters ? &filterModes.Front() : NULL;
+      queue.Sketches = sortBySimilarity ? &sketches.Front() : NULL;
+      UInt32 numThreads = 1;
+      #ifndef _7ZIP_ST
+      numThreads = method.NumThreads;
+      queue.CallbackCS = &callbackCS;
+      #endif
+      RINOK(RunAnalysis(analysis, queue, numThreads));
+    }
+
+    FOR_VECTOR (k, newIndexes)
+    {
+      const unsigned i = newIndexes[k];
 
       CFilterMode2 fm;
       if (useFilters)
       {
-        RINOK(analysis.GetFilterGroup(i, ui, fm));
+        fm.Id = filterModes[i].Id;
+        fm.Delta = filterModes[i].Delta;
       }
       fm.Encrypted = method.PasswordIsDefined;
 
@@ -1967,6 +2664,8 @@ HRESULT Update(
     }
 
     CEncoder encoder(method);
+    if (options.TempBufferMemSize != (UInt64)(Int64)-1)
+      encoder.SetTempBufferMemSize(options.TempBufferMemSize);
 
     // ---------- Repack and copy old solid blocks ----------
 
@@ -2304,6 +3003,8 @@ HRESULT Update(
     // sortParam.TreeFolders = &treeFolders;
     sortParam.SortByType = sortByType;
     refItems.Sort(CompareUpdateItems, (void *)&sortParam);
+    if (sortBySimilarity)
+      SortBySimilarity(refItems, sketches);
     
     CObjArray<UInt32> indices(numFiles);
 
@@ -2324,6 +3025,53 @@ HRESULT Update(
       */
     }
     
+    CMyComPtr<ICompressProgressInfo> encodeProgress = progress;
+
+    #ifndef _7ZIP_ST
+    
+    /* the prefetcher opens and reads next files of group, while the coder
+       compresses current files. If we can't start thread, we read files in coder thread.
+       The prefetcher thread calls updateCallback, so the progress calls of coder
+       are serialized with callbackCS too. */
+    
+    CFolderInStreamPrefetcher prefetcher;
+    CFolderInStreamPrefetcher *prefetcherPtr = NULL;
+    if (method.NumThreads > 1
+        && prefetcher.StartPrefetch(updateCallback, indices, numFiles, &callbackCS) == 0)
+    {
+      prefetcherPtr = &prefetcher;
+      encodeProgress = new CLockedProgress(progress, &callbackCS);
+    }
+    
+    /* PPMd and LZMA encoders (and LZMA2 encoder for small folders) can't use
+       many threads. So we encode several new folders in parallel instead.
+       The handler selects NumFolderThreads from "mt" and "memuse" properties. */
+    
+    CMtEncProgress *mtProgressSpec = new CMtEncProgress(lps, &callbackCS);
+    CMyComPtr<ICompressProgressInfo> mtProgress = mtProgressSpec;
+    CObjectVector<CEncoderThread> encoderThreads;
+    unsigned threadIndex = 0;
+    {
+      UInt32 numThreads = options.NumFolderThreads;
+      if (numThreads > numFiles)
+        numThreads = numFiles;
+      if (numThreads > 1)
+        for (UInt32 t = 0; t < numThreads; t++)
+        {
+          CEncoderThread &et = encoderThreads.AddNew();
+          #ifdef EXTERNAL_CODECS
+          et.__externalCodecs = __externalCodecs;
+          #endif
+          et.Encoder = new CEncoder(method);
+          if (options.TempBufferMemSize != (UInt64)(Int64)-1)
+            et.Encoder->SetTempBufferMemSize(options.TempBufferMemSize / numThreads);
+          et.Progress = mtProgressSpec;
+          RINOK(et.Create());
+        }
+    }
+
+    #endif
+
     for (i = 0; i < numFiles;)
     {
       UInt64 totalSize = 0;
@@ -2352,11 +3100,50 @@ HRESULT Update(
       if (numSubFiles < 1)
         numSubFiles = 1;
 
-      RINOK(lps->SetCur());
+      #ifndef _7ZIP_ST
+      if (encoderThreads.Size() != 0)
+      {
+        CEncoderThread &et = encoderThreads[threadIndex];
+        if (++threadIndex == encoderThreads.Size())
+          threadIndex = 0;
+        
+        // busy thread contains the oldest folder that was not written yet
+        if (et.IsBusy)
+        {
+          RINOK(WriteEncodedFolder(et, archive.SeqStream, updateItems, db, indices,
+              newDatabase, &callbackCS, updateCallback, complexity));
+        }
+
+        et.FolderInStreamSpec = new CFolderInStream;
+        et.FolderInStream = et.FolderInStreamSpec;
+        et.FolderInStreamSpec->Init(updateCallback, &indices[i], numSubFiles, prefetcherPtr, &callbackCS);
+        RINOK(ReadFolderToBuf(et.FolderInStream, et.InBufSpec, mtProgressSpec));
+        if (!et.FolderInStreamSpec->WasFinished())
+          return E_FAIL;
+
+        et.StartIndex = i;
+        et.NumSubFiles = numSubFiles;
+        et.UnpackSize = totalSize;
+        et.InSizeForReduce = &inSizeForReduce;
+        et.Folder = &newDatabase.Folders.AddNew();
+        et.IsBusy = true;
+        et.Start();
+        
+        i += numSubFiles;
+        continue;
+      }
+      #endif
+
+      RINOK(encodeProgress->SetRatioInfo(NULL, NULL));
 
       CFolderInStream *inStreamSpec = new CFolderInStream;
       CMyComPtr<ISequentialInStream> solidInStream(inStreamSpec);
+      #ifndef _7ZIP_ST
+      inStreamSpec->Init(updateCallback, &indices[i], numSubFiles, prefetcherPtr,
+          prefetcherPtr ? &callbackCS : NULL);
+      #else
       inStreamSpec->Init(updateCallback, &indices[i], numSubFiles);
+      #endif
       
       unsigned startPackIndex = newDatabase.PackSizes.Size();
       UInt64 curFolderUnpackSize = totalSize;
@@ -2368,7 +3155,7 @@ HRESULT Update(
           // NULL,
           &inSizeForReduce,
           newDatabase.Folders.AddNew(), newDatabase.CoderUnpackSizes, curFolderUnpackSize,
-          archive.SeqStream, newDatabase.PackSizes, progress));
+          archive.SeqStream, newDatabase.PackSizes, encodeProgress));
 
       if (!inStreamSpec->WasFinished())
         return E_FAIL;
@@ -2381,76 +3168,29 @@ HRESULT Update(
       // newDatabase.PackCRCsDefined.Add(false);
       // newDatabase.PackCRCs.Add(0);
 
-      CNum numUnpackStreams = 0;
-      UInt64 skippedSize = 0;
-      
-      for (unsigned subIndex = 0; subIndex < numSubFiles; subIndex++)
       {
-        const CUpdateItem &ui = updateItems[indices[i + subIndex]];
-        CFileItem file;
-        CFileItem2 file2;
-        UString name;
-        if (ui.NewProps)
-        {
-          UpdateItem_To_FileItem(ui, file, file2);
-          name = ui.Name;
-        }
-        else
-        {
-          GetFile(*db, ui.IndexInArchive, file, file2);
-          db->GetPath(ui.IndexInArchive, name);
-        }
-        if (file2.IsAnti || file.IsDir)
-          return E_FAIL;
-        
-        /*
-        CFileItem &file = newDatabase.Files[
-              startFileIndexInDatabase + i + subIndex];
-        */
-        if (!inStreamSpec->Processed[subIndex])
-        {
-          skippedSize += ui.Size;
-          continue;
-          // file.Name += ".locked";
-        }
-
-        file.Crc = inStreamSpec->CRCs[subIndex];
-        file.Size = inStreamSpec->Sizes[subIndex];
-        
-        // if (file.Size >= 0) // test purposes
-        if (file.Size != 0)
-        {
-          file.CrcDefined = true;
-          file.HasStream = true;
-          numUnpackStreams++;
-        }
-        else
-        {
-          file.CrcDefined = false;
-          file.HasStream = false;
-        }
-
-        /*
-        file.Parent = ui.ParentFolderIndex;
-        if (ui.TreeFolderIndex >= 0)
-          treeFolderToArcIndex[ui.TreeFolderIndex] = newDatabase.Files.Size();
-        if (totalSecureDataSize != 0)
-          newDatabase.SecureIDs.Add(ui.SecureIndex);
-        */
-        newDatabase.AddFile(file, file2, name);
+        #ifndef _7ZIP_ST
+        CCallbackLock lock(prefetcherPtr ? &callbackCS : NULL);
+        #endif
+        RINOK(AddFolderFiles(updateItems, db, &indices[i], numSubFiles, *inStreamSpec,
+            newDatabase, updateCallback, complexity));
       }
-
-      // numUnpackStreams = 0 is very bad case for locked files
-      // v3.13 doesn't understand it.
-      newDatabase.NumUnpackStreamsVector.Add(numUnpackStreams);
       i += numSubFiles;
+    }
 
-      if (skippedSize != 0 && complexity >= skippedSize)
+    #ifndef _7ZIP_ST
+    FOR_VECTOR (k, encoderThreads)
+    {
+      CEncoderThread &et = encoderThreads[threadIndex];
+      if (++threadIndex == encoderThreads.Size())
+        threadIndex = 0;
+      if (et.IsBusy)
       {
-        complexity -= skippedSize;
-        RINOK(updateCallback->SetTotal(complexity));
+        RINOK(WriteEncodedFolder(et, archive.SeqStream, updateItems, db, indices,
+            newDatabase, &callbackCS, updateCallback, complexity));
       }
     }
+    #endif
   }
 
   RINOK(lps->SetCur());
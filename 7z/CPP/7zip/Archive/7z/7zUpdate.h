@@ -99,9 +99,13 @@ struct CUpdateOptions
   bool SolidExtension;
   
   bool UseTypeSorting;
+  bool UseSimilaritySorting; // place files with similar content (MinHash of file start) together
   
   bool RemoveSfxBlock;
   bool MultiThreadMixer;
+  UInt32 BinderRingSize; // for decoder of repacked folders, (-1) means default
+  UInt32 NumFolderThreads; // number of new folders that are encoded in parallel
+  UInt64 TempBufferMemSize; // the memory limit for temp buffers of all encoders, (-1) means default
 
   CUpdateOptions():
       Method(NULL),
@@ -113,8 +117,12 @@ struct CUpdateOptions
       NumSolidBytes((UInt64)(Int64)(-1)),
       SolidExtension(false),
       UseTypeSorting(true),
+      UseSimilaritySorting(false),
       RemoveSfxBlock(false),
-      MultiThreadMixer(true)
+      MultiThreadMixer(true),
+      BinderRingSize((UInt32)(Int32)-1),
+      NumFolderThreads(1),
+      TempBufferMemSize((UInt64)(Int64)-1)
     {}
 };
 
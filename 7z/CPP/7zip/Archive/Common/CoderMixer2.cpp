@@ -915,10 +915,20 @@ HRESULT CMixerMT::SetBindInfo(const CBindInfo &bindInfo)
 {
   CMixer::SetBindInfo(bindInfo);
   
+  UInt32 ringSize = BinderRingSize;
+  if (ringSize == kBinderRingSize_Default)
+    ringSize = EncodeMode ? ((UInt32)1 << 22) : ((UInt32)1 << 18);
+  else
+  {
+    // the ring size must be power of 2
+    while ((ringSize & (ringSize - 1)) != 0)
+      ringSize &= ringSize - 1;
+  }
+
   _streamBinders.Clear();
   FOR_VECTOR (i, _bi.Bonds)
   {
-    RINOK(_streamBinders.AddNew().CreateEvents());
+    RINOK(_streamBinders.AddNew().CreateEvents(ringSize));
   }
   return S_OK;
 }
@@ -367,7 +367,7 @@ public:
 
 #ifdef USE_MIXER_MT
 
-class CCoderMT: public CCoder, public CVirtThread
+class CCoderMT: public CCoder, public CPooledVirtThread
 {
   CLASS_NO_COPY(CCoderMT)
   CRecordVector<ISequentialInStream*> InStreamPointers;
@@ -402,12 +402,14 @@ public:
   };
 
   CCoderMT(): EncodeMode(false) {}
-  ~CCoderMT() { CVirtThread::WaitThreadFinish(); }
+  ~CCoderMT() { CPooledVirtThread::WaitThreadFinish(); }
   
   void Code(ICompressProgressInfo *progress);
 };
 
 
+const UInt32 kBinderRingSize_Default = (UInt32)(Int32)-1;
+
 class CMixerMT:
   public IUnknown,
   public CMixer,
@@ -421,6 +423,14 @@ class CMixerMT:
 public:
   CObjectVector<CCoderMT> _coders;
 
+  /* the size of ring buffer in each stream binder between coders.
+     (0) means direct handoff of Write() buffer to reader.
+     kBinderRingSize_Default : 4 MB for encoder, and 256 KB for decoder.
+     The decoder allocates the ring for each bond (4 bonds for BCJ2),
+     and small ring is enough for fast decoders.
+     It must be set before SetBindInfo() */
+  UInt32 BinderRingSize;
+
   MY_UNKNOWN_IMP
 
   virtual HRESULT SetBindInfo(const CBindInfo &bindInfo);
@@ -437,7 +447,7 @@ public:
       bool &dataAfterEnd_Error);
   virtual UInt64 GetBondStreamSize(unsigned bondIndex) const;
 
-  CMixerMT(bool encodeMode): CMixer(encodeMode) {}
+  CMixerMT(bool encodeMode): CMixer(encodeMode), BinderRingSize(kBinderRingSize_Default) {}
 };
 
 #endif
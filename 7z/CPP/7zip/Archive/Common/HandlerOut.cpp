@@ -3,6 +3,8 @@
 #include "StdAfx.h"
 
 #ifndef _7ZIP_ST
+#include "../../../Common/StringToInt.h"
+
 #include "../../../Windows/System.h"
 #endif
 
@@ -14,7 +16,7 @@ using namespace NWindows;
 
 namespace NArchive {
 
-static void SetMethodProp32(COneMethodInfo &m, PROPID propID, UInt32 value)
+static void SetMethodProp32(CMethodProps &m, PROPID propID, UInt32 value)
 {
   if (m.FindProp(propID) < 0)
     m.AddProp32(propID, value);
@@ -28,16 +30,84 @@ void CMultiMethodProps::SetGlobalLevelTo(COneMethodInfo &oneMethodInfo) const
 }
 
 #ifndef _7ZIP_ST
-void CMultiMethodProps::SetMethodThreadsTo(COneMethodInfo &oneMethodInfo, UInt32 numThreads)
+void CMultiMethodProps::SetMethodThreadsTo(CMethodProps &oneMethodInfo, UInt32 numThreads)
 {
   SetMethodProp32(oneMethodInfo, NCoderPropID::kNumThreads, numThreads);
 }
+
+static UInt64 GetDefaultMemUsage()
+{
+  UInt64 ramSize;
+  NSystem::GetRamSize(ramSize);
+  return ramSize / 2;
+}
+
+/* memuse property value:
+     N{b|k|m|g|t} : size in bytes, KB, MB, GB, TB
+     pN           : N percents of RAM size */
+
+static HRESULT ParseMemUsageProp(const PROPVARIANT &prop, UInt64 &res)
+{
+  if (prop.vt == VT_UI4)
+  {
+    res = prop.ulVal;
+    return S_OK;
+  }
+  if (prop.vt == VT_UI8)
+  {
+    res = prop.uhVal.QuadPart;
+    return S_OK;
+  }
+  if (prop.vt != VT_BSTR)
+    return E_INVALIDARG;
+  
+  const wchar_t *s = prop.bstrVal;
+  const bool percents = (MyCharLower_Ascii(*s) == 'p');
+  if (percents)
+    s++;
+  const wchar_t *end;
+  UInt64 v = ConvertStringToUInt64(s, &end);
+  if (s == end)
+    return E_INVALIDARG;
+  
+  if (percents)
+  {
+    if (*end != 0 || v > 100)
+      return E_INVALIDARG;
+    UInt64 ramSize;
+    NSystem::GetRamSize(ramSize);
+    res = ramSize / 100 * v;
+    return S_OK;
+  }
+  
+  unsigned numBits = 0;
+  if (*end != 0)
+  {
+    switch (MyCharLower_Ascii(*end++))
+    {
+      case 'b': numBits =  0; break;
+      case 'k': numBits = 10; break;
+      case 'm': numBits = 20; break;
+      case 'g': numBits = 30; break;
+      case 't': numBits = 40; break;
+      default: return E_INVALIDARG;
+    }
+    if (*end != 0)
+      return E_INVALIDARG;
+  }
+  if (numBits != 0 && (v >> (64 - numBits)) != 0)
+    return E_INVALIDARG;
+  res = v << numBits;
+  return S_OK;
+}
+
 #endif
 
 void CMultiMethodProps::Init()
 {
   #ifndef _7ZIP_ST
   _numProcessors = _numThreads = NSystem::GetNumberOfProcessors();
+  _memUsage = GetDefaultMemUsage();
   #endif
   
   _level = (UInt32)(Int32)-1;
@@ -79,6 +149,14 @@ HRESULT CMultiMethodProps::SetProperty(const wchar_t *nameSpec, const PROPVARIAN
     return ParsePropToUInt32(name, value, _crcSize);
   }
   
+  if (name.IsEqualTo("memuse"))
+  {
+    #ifndef _7ZIP_ST
+    RINOK(ParseMemUsageProp(value, _memUsage));
+    #endif
+    return S_OK;
+  }
+  
   UInt32 number;
   unsigned index = ParseStringToUInt32(name, number);
   UString realName = name.Ptr(index);
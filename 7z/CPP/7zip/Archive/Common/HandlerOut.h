@@ -15,6 +15,7 @@ public:
   #ifndef _7ZIP_ST
   UInt32 _numThreads;
   UInt32 _numProcessors;
+  UInt64 _memUsage; // the limit of memory usage for compression ("memuse" property)
   #endif
 
   UInt32 _crcSize;
@@ -26,7 +27,7 @@ public:
   void SetGlobalLevelTo(COneMethodInfo &oneMethodInfo) const;
 
   #ifndef _7ZIP_ST
-  static void SetMethodThreadsTo(COneMethodInfo &oneMethodInfo, UInt32 numThreads);
+  static void SetMethodThreadsTo(CMethodProps &oneMethodInfo, UInt32 numThreads);
   #endif
 
 
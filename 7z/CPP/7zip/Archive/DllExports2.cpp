@@ -19,6 +19,9 @@
 #include "../IPassword.h"
 
 #include "../Common/CreateCoder.h"
+#ifndef _7ZIP_ST
+#include "../Common/VirtThread.h"
+#endif
 
 #include "IArchive.h"
 
@@ -41,6 +44,11 @@ BOOL WINAPI DllMain(
     // OutputDebugStringA("7z.dll DLL_PROCESS_ATTACH");
     g_hInstance = (HINSTANCE)hInstance;
     NT_CHECK;
+    #ifndef _7ZIP_ST
+    /* idle threads can't be stopped in DLL_PROCESS_DETACH.
+       So we keep them only if the client calls SetThreadPoolSize(). */
+    VirtThreadPool_SetMaxThreads(0);
+    #endif
   }
   /*
   if (dwReason == DLL_PROCESS_DETACH)
@@ -92,6 +100,27 @@ STDAPI SetCaseSensitive(Int32 caseSensitive)
   return S_OK;
 }
 
+/* numIdleThreads : the number of idle threads that DLL keeps for next operations.
+   (numIdleThreads == 0) stops all idle threads.
+   The client that sets (numIdleThreads != 0) must call SetThreadPoolSize(0) before FreeLibrary(). */
+
+#ifndef _7ZIP_ST
+
+STDAPI SetThreadPoolSize(UInt32 numIdleThreads)
+{
+  VirtThreadPool_SetMaxThreads(numIdleThreads);
+  return S_OK;
+}
+
+#else
+
+STDAPI SetThreadPoolSize(UInt32)
+{
+  return S_OK;
+}
+
+#endif
+
 #ifdef EXTERNAL_CODECS
 
 CExternalCodecs g_ExternalCodecs;
@@ -309,6 +309,10 @@ SOURCE=..\..\Compress\PpmdDecoder.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\Compress\PpmdPool.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\Compress\PpmdRegister.cpp
 # End Source File
 # End Group
@@ -465,6 +469,10 @@ SOURCE=..\..\..\Common\NewHandler.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\..\Common\Sha256Prepare.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\..\Common\StdInStream.cpp
 # End Source File
 # Begin Source File
@@ -850,6 +858,11 @@ SOURCE=..\..\..\..\C\Sha256.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\..\..\C\Sha256Opt.c
+# SUBTRACT CPP /YX /Yc /Yu
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\..\..\C\Sha256.h
 # End Source File
 # Begin Source File
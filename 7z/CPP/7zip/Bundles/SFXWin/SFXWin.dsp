@@ -277,6 +277,10 @@ SOURCE=..\..\Compress\PpmdDecoder.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\Compress\PpmdPool.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\Compress\PpmdRegister.cpp
 # End Source File
 # End Group
@@ -693,6 +697,10 @@ SOURCE=..\..\..\Common\NewHandler.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\..\Common\Sha256Prepare.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\..\Common\StringConvert.cpp
 # End Source File
 # Begin Source File
@@ -934,6 +942,11 @@ SOURCE=..\..\..\..\C\Sha256.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\..\..\C\Sha256Opt.c
+# SUBTRACT CPP /YX /Yc /Yu
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\..\..\C\Threads.c
 # SUBTRACT CPP /YX /Yc /Yu
 # End Source File
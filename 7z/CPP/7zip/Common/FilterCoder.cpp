@@ -16,10 +16,20 @@
 
   Some filters (BCJ and others) don't process data at the end of stream in some cases.
   So the encoder and decoder write such last bytes without change.
+
+  Read() can work without _buf:
+  if there is no converted data in _buf, and the caller's buffer is big,
+  Read() reads new data directly to the caller's buffer and calls Filter() there.
+  Only small unconverted tail of data is copied to _buf for next Read() call.
+  So we don't copy data from _buf for AES decoding (before LZMA decoder)
+  and for BCJ / Delta encoding (before LZMA encoder).
+  Write() still copies data to _buf, because the caller's data is const
+  (it's the dictionary of LZMA decoder that must not be changed).
 */
 
 
 static const UInt32 kBufSize = 1 << 20;
+static const UInt32 kDirectSizeMin = 1 << 12;
 
 STDMETHODIMP CFilterCoder::SetInBufSize(UInt32 , UInt32 size) { _inBufSize = size; return S_OK; }
 STDMETHODIMP CFilterCoder::SetOutBufSize(UInt32 , UInt32 size) { _outBufSize = size; return S_OK; }
@@ -41,6 +51,17 @@ HRESULT CFilterCoder::Alloc()
       return E_OUTOFMEMORY;
     _bufSize = size;
   }
+
+  _directAlignMask = 0;
+  #ifndef _NO_CRYPTO
+  {
+    // AES filters need 16-bytes alignment
+    CMyComPtr<ICryptoProperties> cp;
+    Filter.QueryInterface(IID_ICryptoProperties, &cp);
+    if (cp)
+      _directAlignMask = 16 - 1;
+  }
+  #endif
   return S_OK;
 }
 
@@ -54,6 +75,7 @@ CFilterCoder::CFilterCoder(bool encodeMode):
     _bufSize(0),
     _inBufSize(kBufSize),
     _outBufSize(kBufSize),
+    _directAlignMask(0),
     _encodeMode(encodeMode),
     _outSizeIsDefined(false),
     _outSize(0),
@@ -339,6 +361,62 @@ STDMETHODIMP CFilterCoder::Read(void *data, UInt32 size, UInt32 *processedSize)
       _bufPos = num;
       _convPos = 0;
     }
+
+    if (size >= kDirectSizeMin
+        && _bufPos < kDirectSizeMin
+        && ((size_t)data & _directAlignMask) == 0)
+    {
+      if (_outSizeIsDefined)
+      {
+        UInt64 rem = _outSize - _nowPos64;
+        if (size > rem)
+          size = (UInt32)rem;
+      }
+      if (size >= kDirectSizeMin)
+      {
+        Byte *dest = (Byte *)data;
+        UInt32 pos = _bufPos;
+        if (pos != 0)
+          memcpy(dest, _buf, pos);
+        {
+          size_t readSize = size - pos;
+          HRESULT res = ReadStream(_inStream, dest + pos, &readSize);
+          pos += (UInt32)readSize;
+          if (res != S_OK)
+          {
+            _bufPos = 0;
+            return res;
+          }
+        }
+        if (pos == 0)
+        {
+          _bufPos = 0;
+          break;
+        }
+        
+        const UInt32 conv = Filter->Filter(dest, pos);
+        const UInt32 rem = pos - conv;
+        
+        /* if (conv == 0) or (conv > pos), the filter didn't change the data.
+           It's small block at the end of stream. We process it in _buf. */
+        if (rem > _bufSize)
+          return E_FAIL;
+        if (conv == 0 || conv > pos)
+        {
+          memcpy(_buf, dest, pos);
+          _bufPos = pos;
+        }
+        else
+        {
+          memcpy(_buf, dest + conv, rem);
+          _bufPos = rem;
+          _nowPos64 += conv;
+          if (processedSize)
+            *processedSize = conv;
+          break;
+        }
+      }
+    }
     
     {
       size_t readSize = _bufSize - _bufPos;
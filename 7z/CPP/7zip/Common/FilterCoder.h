@@ -90,6 +90,7 @@ class CFilterCoder:
   UInt32 _bufSize;
   UInt32 _inBufSize;
   UInt32 _outBufSize;
+  UInt32 _directAlignMask; // alignment of caller's buffer required for Read() without _buf
 
   bool _encodeMode;
   bool _outSizeIsDefined;
@@ -3,9 +3,12 @@
 #include "StdAfx.h"
 
 #include "../../../C/7zCrc.h"
+#include "../../../C/Alloc.h"
 
 #include "../../Common/Defs.h"
 
+#include "../../Windows/FileMapping.h"
+
 #include "InOutTempBuffer.h"
 #include "StreamUtils.h"
 
@@ -13,34 +16,96 @@ using namespace NWindows;
 using namespace NFile;
 using namespace NDir;
 
-static const size_t kTempBufSize = (1 << 20);
+static const unsigned kBlockSizeLog = 20;
+static const size_t kBlockSize = (size_t)1 << kBlockSizeLog;
+static const UInt32 kChunkSize = (UInt32)1 << 22;
+static const UInt32 kMapViewSize = (UInt32)1 << 24; // it must be multiple of allocation granularity (64 KB)
+
+static const unsigned kNumBlocksMax = (unsigned)1 << (31 - kBlockSizeLog);
 
 #define kTempFilePrefixString FTEXT("7zt")
 
-CInOutTempBuffer::CInOutTempBuffer(): _buf(NULL) { }
+#ifndef _7ZIP_ST
+
+void CInOutTempBufferSpiller::Execute()
+{
+  UInt32 processed;
+  Error = (!File->Write(Data, Size, processed) || processed != Size);
+}
+
+#endif
 
-void CInOutTempBuffer::Create()
+CInOutTempBuffer::CInOutTempBuffer():
+    _numBlocksMax(0),
+    _memSize(0),
+    _maxMemSize(0),
+    _chunkIndex(0),
+    _chunkPos(0),
+    _size(0),
+    _tempFileCreated(false)
 {
-  if (!_buf)
-    _buf = new Byte[kTempBufSize];
+  _chunks[0] = NULL;
+  _chunks[1] = NULL;
+}
+
+void CInOutTempBuffer::Create(UInt64 maxMemSize)
+{
+  maxMemSize >>= kBlockSizeLog;
+  _numBlocksMax = (maxMemSize < kNumBlocksMax ? (unsigned)maxMemSize : kNumBlocksMax);
+  if (_blocks.IsEmpty() && _numBlocksMax != 0)
+  {
+    // if there is no memory, Write() will write data to temp file
+    Byte *block = (Byte *)MidAlloc(kBlockSize);
+    if (block)
+      _blocks.Add(block);
+  }
 }
 
 CInOutTempBuffer::~CInOutTempBuffer()
 {
-  delete []_buf;
+  #ifndef _7ZIP_ST
+  _spiller.WaitThreadFinish();
+  #endif
+  FOR_VECTOR (i, _blocks)
+    MidFree(_blocks[i]);
+  MidFree(_chunks[0]);
+  MidFree(_chunks[1]);
 }
 
 void CInOutTempBuffer::InitWriting()
 {
-  _bufPos = 0;
+  _memSize = 0;
+  // the blocks that were allocated already are used without limit check
+  _maxMemSize = (size_t)0 - 1;
+  _chunkIndex = 0;
+  _chunkPos = 0;
   _tempFileCreated = false;
   _size = 0;
   _crc = CRC_INIT_VAL;
 }
 
-bool CInOutTempBuffer::WriteToFile(const void *data, UInt32 size)
+// it waits the end of background writing of previous chunk
+
+bool CInOutTempBuffer::WaitChunk()
 {
-  if (size == 0)
+  #ifndef _7ZIP_ST
+  if (_spiller._started)
+  {
+    _spiller.WaitExecuteFinish();
+    if (_spiller.Error)
+      return false;
+  }
+  #endif
+  return true;
+}
+
+// it writes current chunk to temp file, and it switches to another chunk
+
+bool CInOutTempBuffer::WriteChunk()
+{
+  if (!WaitChunk())
+    return false;
+  if (_chunkPos == 0)
     return true;
   if (!_tempFileCreated)
   {
@@ -48,11 +113,26 @@ bool CInOutTempBuffer::WriteToFile(const void *data, UInt32 size)
       return false;
     _tempFileCreated = true;
   }
+  const Byte *data = _chunks[_chunkIndex];
+  const UInt32 size = _chunkPos;
+  _chunkPos = 0;
+
+  #ifndef _7ZIP_ST
+  if (size == kChunkSize && _spiller.Create() == 0)
+  {
+    _spiller.File = &_outFile;
+    _spiller.Data = data;
+    _spiller.Size = size;
+    _spiller.Error = false;
+    _spiller.Start();
+    _chunkIndex ^= 1;
+    return true;
+  }
+  #endif
+
   UInt32 processed;
   if (!_outFile.Write(data, size, processed))
     return false;
-  _crc = CrcUpdate(_crc, data, processed);
-  _size += processed;
   return (processed == size);
 }
 
@@ -60,54 +140,141 @@ bool CInOutTempBuffer::Write(const void *data, UInt32 size)
 {
   if (size == 0)
     return true;
-  size_t cur = kTempBufSize - _bufPos;
-  if (cur != 0)
+  _crc = CrcUpdate(_crc, data, size);
+  _size += size;
+
+  while (size != 0)
   {
-    if (cur > size)
-      cur = size;
-    memcpy(_buf + _bufPos, data, cur);
-    _crc = CrcUpdate(_crc, data, cur);
-    _bufPos += cur;
-    _size += cur;
+    size_t cur;
+
+    if (_memSize < _maxMemSize)
+    {
+      const unsigned blockIndex = (unsigned)(_memSize >> kBlockSizeLog);
+      const size_t blockPos = _memSize & (kBlockSize - 1);
+      if (blockIndex == _blocks.Size())
+      {
+        Byte *block = NULL;
+        if (blockIndex < _numBlocksMax)
+          block = (Byte *)MidAlloc(kBlockSize);
+        if (!block)
+        {
+          // the limit is reached or there is no memory, so we write next data to temp file
+          _maxMemSize = _memSize;
+          continue;
+        }
+        _blocks.Add(block);
+      }
+      cur = MyMin(kBlockSize - blockPos, _maxMemSize - _memSize);
+      if (cur > size)
+        cur = size;
+      memcpy(_blocks[blockIndex] + blockPos, data, cur);
+      _memSize += cur;
+    }
+    else
+    {
+      Byte *chunk = _chunks[_chunkIndex];
+      if (!chunk)
+      {
+        chunk = (Byte *)MidAlloc(kChunkSize);
+        if (!chunk)
+          return false;
+        _chunks[_chunkIndex] = chunk;
+      }
+      cur = kChunkSize - _chunkPos;
+      if (cur > size)
+        cur = size;
+      memcpy(chunk + _chunkPos, data, cur);
+      _chunkPos += (UInt32)cur;
+      if (_chunkPos == kChunkSize)
+        if (!WriteChunk())
+          return false;
+    }
+
     size -= (UInt32)cur;
     data = ((const Byte *)data) + cur;
   }
-  return WriteToFile(data, size);
+
+  return true;
+}
+
+HRESULT CInOutTempBuffer::WriteFileToStream(ISequentialOutStream *stream, UInt64 &size, UInt32 &crc)
+{
+  NIO::CInFile inFile;
+  if (!inFile.Open(_tempFile.GetPath()))
+    return E_FAIL;
+
+  {
+    CFileMapping map;
+    map.Create(inFile.GetHandle(), PAGE_READONLY, 0, NULL);
+    if (map.IsCreated())
+    {
+      UInt64 pos = 0;
+      while (size < _size)
+      {
+        UInt64 rem = _size - size;
+        const UInt32 cur = (rem < kMapViewSize ? (UInt32)rem : kMapViewSize);
+        const Byte *view = (const Byte *)map.Map(FILE_MAP_READ, pos, cur);
+        if (!view)
+        {
+          if (pos == 0)
+            break;
+          return E_FAIL;
+        }
+        CFileUnmapper unmapper(view);
+        RINOK(WriteStream(stream, view, cur));
+        crc = CrcUpdate(crc, view, cur);
+        size += cur;
+        pos += cur;
+      }
+      if (size == _size)
+        return S_OK;
+    }
+  }
+
+  // the mapping is not supported for that file. So we read the file.
+
+  Byte *buf = _chunks[0];
+  if (!buf)
+    return E_FAIL;
+  while (size < _size)
+  {
+    UInt32 processed;
+    if (!inFile.ReadPart(buf, kChunkSize, processed))
+      return E_FAIL;
+    if (processed == 0)
+      break;
+    RINOK(WriteStream(stream, buf, processed));
+    crc = CrcUpdate(crc, buf, processed);
+    size += processed;
+  }
+  return S_OK;
 }
 
 HRESULT CInOutTempBuffer::WriteToStream(ISequentialOutStream *stream)
 {
+  if (!WriteChunk() || !WaitChunk())
+    return E_FAIL;
   if (!_outFile.Close())
     return E_FAIL;
 
   UInt64 size = 0;
   UInt32 crc = CRC_INIT_VAL;
 
-  if (_bufPos != 0)
+  FOR_VECTOR (i, _blocks)
   {
-    RINOK(WriteStream(stream, _buf, _bufPos));
-    crc = CrcUpdate(crc, _buf, _bufPos);
-    size += _bufPos;
+    if (size == _memSize)
+      break;
+    size_t cur = MyMin(kBlockSize, _memSize - (size_t)size);
+    RINOK(WriteStream(stream, _blocks[i], cur));
+    crc = CrcUpdate(crc, _blocks[i], cur);
+    size += cur;
   }
-  
+
   if (_tempFileCreated)
   {
-    NIO::CInFile inFile;
-    if (!inFile.Open(_tempFile.GetPath()))
-      return E_FAIL;
-    while (size < _size)
-    {
-      UInt32 processed;
-      if (!inFile.ReadPart(_buf, kTempBufSize, processed))
-        return E_FAIL;
-      if (processed == 0)
-        break;
-      RINOK(WriteStream(stream, _buf, processed));
-      crc = CrcUpdate(crc, _buf, processed);
-      size += processed;
-    }
+    RINOK(WriteFileToStream(stream, size, crc));
   }
-  
+
   return (_crc == crc && size == _size) ? S_OK : E_FAIL;
 }
 
@@ -4,25 +4,65 @@
 #define __IN_OUT_TEMP_BUFFER_H
 
 #include "../../Common/MyCom.h"
+#include "../../Common/MyVector.h"
 #include "../../Windows/FileDir.h"
 
+#ifndef _7ZIP_ST
+#include "VirtThread.h"
+#endif
+
 #include "../IStream.h"
 
+/*
+  CInOutTempBuffer keeps data in memory blocks up to (maxMemSize) limit of Create().
+  Next data is collected to big aligned chunks that are written to temp file.
+  In multithreaded version a full chunk is written by pooled thread,
+  while the caller fills another chunk.
+  WriteToStream() reads temp file back through file mapping.
+*/
+
+const UInt64 kInOutTempBuffer_MaxMemSize_Default = (UInt64)1 << 28;
+
+#ifndef _7ZIP_ST
+
+struct CInOutTempBufferSpiller: public CPooledVirtThread
+{
+  NWindows::NFile::NIO::COutFile *File;
+  const Byte *Data;
+  UInt32 Size;
+  bool Error;
+
+  ~CInOutTempBufferSpiller() { CPooledVirtThread::WaitThreadFinish(); }
+  virtual void Execute();
+};
+
+#endif
+
 class CInOutTempBuffer
 {
   NWindows::NFile::NDir::CTempFile _tempFile;
   NWindows::NFile::NIO::COutFile _outFile;
-  Byte *_buf;
-  size_t _bufPos;
+  CRecordVector<Byte *> _blocks;
+  unsigned _numBlocksMax;
+  size_t _memSize;
+  size_t _maxMemSize;
+  Byte *_chunks[2];
+  unsigned _chunkIndex;
+  UInt32 _chunkPos;
   UInt64 _size;
   UInt32 _crc;
   bool _tempFileCreated;
+  #ifndef _7ZIP_ST
+  CInOutTempBufferSpiller _spiller;
+  #endif
 
-  bool WriteToFile(const void *data, UInt32 size);
+  bool WaitChunk();
+  bool WriteChunk();
+  HRESULT WriteFileToStream(ISequentialOutStream *stream, UInt64 &size, UInt32 &crc);
 public:
   CInOutTempBuffer();
   ~CInOutTempBuffer();
-  void Create();
+  void Create(UInt64 maxMemSize = kInOutTempBuffer_MaxMemSize_Default);
 
   void InitWriting();
   bool Write(const void *data, UInt32 size);
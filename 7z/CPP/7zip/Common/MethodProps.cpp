@@ -160,6 +160,16 @@ static HRESULT PROPVARIANT_to_DictSize(const PROPVARIANT &prop, NCOM::CPropVaria
   return E_INVALIDARG;
 }
 
+HRESULT PROPVARIANT_to_Size32(const PROPVARIANT &prop, UInt32 &res)
+{
+  NCOM::CPropVariant v;
+  RINOK(PROPVARIANT_to_DictSize(prop, v));
+  if (v.vt != VT_UI4)
+    return E_INVALIDARG;
+  res = v.ulVal;
+  return S_OK;
+}
+
 
 void CProps::AddProp32(PROPID propid, UInt32 val)
 {
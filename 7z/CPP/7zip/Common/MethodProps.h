@@ -19,6 +19,9 @@ HRESULT ParsePropToUInt32(const UString &name, const PROPVARIANT &prop, UInt32 &
 
 HRESULT ParseMtProp(const UString &name, const PROPVARIANT &prop, UInt32 defaultNumThreads, UInt32 &numThreads);
 
+// the size in same format as dictionary size: N (2^N bytes) or N{b|k|m|g}. It must be less than 4 GB
+HRESULT PROPVARIANT_to_Size32(const PROPVARIANT &prop, UInt32 &res);
+
 struct CProp
 {
   PROPID Id;
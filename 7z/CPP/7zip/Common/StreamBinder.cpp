@@ -2,6 +2,8 @@
 
 #include "StdAfx.h"
 
+#include "../../../C/Alloc.h"
+
 #include "../../Common/MyCom.h"
 
 #include "StreamBinder.h"
@@ -38,8 +40,26 @@ STDMETHODIMP CBinderOutStream::Write(const void *data, UInt32 size, UInt32 *proc
 
 
 
-WRes CStreamBinder::CreateEvents()
+CStreamBinder::~CStreamBinder()
+{
+  ::MidFree(_ringBuf);
+}
+
+WRes CStreamBinder::CreateEvents(UInt32 ringSize)
 {
+  if (_ringSize != ringSize)
+  {
+    ::MidFree(_ringBuf);
+    _ringBuf = NULL;
+    _ringSize = 0;
+    if (ringSize != 0)
+    {
+      _ringBuf = (Byte *)::MidAlloc(ringSize);
+      if (!_ringBuf)
+        return ERROR_NOT_ENOUGH_MEMORY;
+      _ringSize = ringSize;
+    }
+  }
   RINOK(_canWrite_Event.Create());
   RINOK(_canRead_Event.Create());
   return _readingWasClosed_Event.Create();
@@ -59,6 +79,13 @@ void CStreamBinder::ReInit()
   _buf = NULL;
   ProcessedSize = 0;
   // WritingWasCut = false;
+
+  _ringWritePos = 0;
+  _ringReadPos = 0;
+  _ringWriteWaits = 0;
+  _ringReadWaits = 0;
+  _writingWasClosed = 0;
+  _readingWasClosed = 0;
 }
 
 
@@ -73,6 +100,13 @@ void CStreamBinder::CreateStreams(ISequentialInStream **inStream, ISequentialOut
   ProcessedSize = 0;
   // WritingWasCut = false;
 
+  _ringWritePos = 0;
+  _ringReadPos = 0;
+  _ringWriteWaits = 0;
+  _ringReadWaits = 0;
+  _writingWasClosed = 0;
+  _readingWasClosed = 0;
+
   CBinderInStream *inStreamSpec = new CBinderInStream(this);
   CMyComPtr<ISequentialInStream> inStreamLoc(inStreamSpec);
   *inStream = inStreamLoc.Detach();
@@ -88,6 +122,8 @@ HRESULT CStreamBinder::Read(void *data, UInt32 size, UInt32 *processedSize)
 {
   if (processedSize)
     *processedSize = 0;
+  if (_ringSize != 0)
+    return Ring_Read(data, size, processedSize);
   if (size != 0)
   {
     if (_waitWrite)
@@ -123,6 +159,9 @@ HRESULT CStreamBinder::Write(const void *data, UInt32 size, UInt32 *processedSiz
   if (size == 0)
     return S_OK;
 
+  if (_ringSize != 0)
+    return Ring_Write(data, size, processedSize);
+
   if (!_readingWasClosed2)
   {
     _buf = data;
@@ -154,3 +193,125 @@ HRESULT CStreamBinder::Write(const void *data, UInt32 size, UInt32 *processedSiz
   // WritingWasCut = true;
   return k_My_HRESULT_WritingWasCut;
 }
+
+
+
+// the number of checks of ring buffer before waiting for event
+static const unsigned kRingSpinCount = 1 << 8;
+
+#ifdef YieldProcessor
+  #define RING_SPIN_PAUSE YieldProcessor();
+#else
+  #define RING_SPIN_PAUSE
+#endif
+
+// it reads value with memory barrier
+#define RING_GET_POS(v) ((UInt32)InterlockedExchangeAdd(&(v), 0))
+
+HRESULT CStreamBinder::Ring_Read(void *data, UInt32 size, UInt32 *processedSize)
+{
+  if (size == 0)
+    return S_OK;
+  
+  const UInt32 readPos = (UInt32)_ringReadPos;
+  UInt32 avail;
+  
+  for (unsigned spin = 0;; spin++)
+  {
+    avail = RING_GET_POS(_ringWritePos) - readPos;
+    if (avail != 0)
+      break;
+    if (_writingWasClosed)
+    {
+      // writer could write data before closing
+      avail = RING_GET_POS(_ringWritePos) - readPos;
+      if (avail != 0)
+        break;
+      return S_OK;
+    }
+    if (spin < kRingSpinCount)
+    {
+      RING_SPIN_PAUSE
+      continue;
+    }
+    _canRead_Event.Reset();
+    InterlockedExchange(&_ringReadWaits, 1);
+    // writer could change the state before (_ringReadWaits = 1), so we check it again
+    if ((UInt32)RING_GET_POS(_ringWritePos) != readPos || _writingWasClosed)
+      continue;
+    RINOK(_canRead_Event.Lock());
+  }
+
+  if (size > avail)
+    size = avail;
+  {
+    const UInt32 mask = _ringSize - 1;
+    const UInt32 offset = readPos & mask;
+    UInt32 cur = _ringSize - offset;
+    if (cur > size)
+      cur = size;
+    memcpy(data, _ringBuf + offset, cur);
+    if (cur != size)
+      memcpy((Byte *)data + cur, _ringBuf, size - cur);
+  }
+  
+  InterlockedExchange(&_ringReadPos, (LONG)(readPos + size));
+  if (_ringWriteWaits != 0 && InterlockedExchange(&_ringWriteWaits, 0) != 0)
+    _canWrite_Event.Set();
+  
+  ProcessedSize += size;
+  if (processedSize)
+    *processedSize = size;
+  return S_OK;
+}
+
+
+HRESULT CStreamBinder::Ring_Write(const void *data, UInt32 size, UInt32 *processedSize)
+{
+  const UInt32 writePos = (UInt32)_ringWritePos;
+  UInt32 rem;
+  
+  for (unsigned spin = 0;; spin++)
+  {
+    if (_readingWasClosed)
+      return k_My_HRESULT_WritingWasCut;
+    rem = _ringSize - (writePos - RING_GET_POS(_ringReadPos));
+    if (rem != 0)
+      break;
+    if (spin < kRingSpinCount)
+    {
+      RING_SPIN_PAUSE
+      continue;
+    }
+    _canWrite_Event.Reset();
+    InterlockedExchange(&_ringWriteWaits, 1);
+    // reader could change the state before (_ringWriteWaits = 1), so we check it again
+    if ((UInt32)RING_GET_POS(_ringReadPos) + _ringSize != writePos || _readingWasClosed)
+      continue;
+    HANDLE events[2] = { _canWrite_Event, _readingWasClosed_Event };
+    DWORD waitResult = ::WaitForMultipleObjects(2, events, FALSE, INFINITE);
+    if (waitResult >= WAIT_OBJECT_0 + 2)
+      return E_FAIL;
+  }
+
+  if (size > rem)
+    size = rem;
+  {
+    const UInt32 mask = _ringSize - 1;
+    const UInt32 offset = writePos & mask;
+    UInt32 cur = _ringSize - offset;
+    if (cur > size)
+      cur = size;
+    memcpy(_ringBuf + offset, data, cur);
+    if (cur != size)
+      memcpy(_ringBuf, (const Byte *)data + cur, size - cur);
+  }
+
+  InterlockedExchange(&_ringWritePos, (LONG)(writePos + size));
+  if (_ringReadWaits != 0 && InterlockedExchange(&_ringReadWaits, 0) != 0)
+    _canRead_Event.Set();
+
+  if (processedSize)
+    *processedSize = size;
+  return S_OK;
+}
@@ -19,6 +19,17 @@ writer thread:
 Can second call of _canWrite_Event.Set() be executed without memory barrier, if event is already set?
 */
 
+/*
+  (ringSize == 0) : Write() waits until reader reads all data of that Write() call.
+  (ringSize != 0) : the binder copies data to internal ring buffer.
+      Write() returns after copying, and it waits only if ring buffer is full.
+      Read() waits only if ring buffer is empty.
+      So writer and reader threads work at same time.
+      Positions in ring buffer are changed with Interlocked functions.
+      The thread calls Set() for event only if another thread waits for it,
+      so there are no kernel calls, if neither of threads waits.
+*/
+
 class CStreamBinder
 {
   NWindows::NSynchronization::CAutoResetEvent _canWrite_Event;
@@ -31,10 +42,26 @@ class CStreamBinder
   bool _waitWrite;
   UInt32 _bufSize;
   const void *_buf;
+
+  Byte *_ringBuf;
+  UInt32 _ringSize;
+  volatile LONG _ringWritePos;
+  volatile LONG _ringReadPos;
+  volatile LONG _ringWriteWaits;
+  volatile LONG _ringReadWaits;
+  volatile LONG _writingWasClosed;
+  volatile LONG _readingWasClosed;
+
+  HRESULT Ring_Read(void *data, UInt32 size, UInt32 *processedSize);
+  HRESULT Ring_Write(const void *data, UInt32 size, UInt32 *processedSize);
 public:
   UInt64 ProcessedSize;
 
-  WRes CreateEvents();
+  CStreamBinder(): _ringBuf(NULL), _ringSize(0) {}
+  ~CStreamBinder();
+
+  // ringSize must be 0 or power of 2
+  WRes CreateEvents(UInt32 ringSize = 0);
   void CreateStreams(ISequentialInStream **inStream, ISequentialOutStream **outStream);
   
   void ReInit();
@@ -44,6 +71,7 @@ public:
 
   void CloseRead()
   {
+    InterlockedExchange(&_readingWasClosed, 1);
     _readingWasClosed_Event.Set();
     // _readingWasClosed = true;
     // _canWrite_Event.Set();
@@ -53,6 +81,7 @@ public:
   {
     _buf = NULL;
     _bufSize = 0;
+    InterlockedExchange(&_writingWasClosed, 1);
     _canRead_Event.Set();
   }
 };
@@ -2,6 +2,8 @@
 
 #include "StdAfx.h"
 
+#include "../../Common/MyVector.h"
+
 #include "VirtThread.h"
 
 static THREAD_FUNC_DECL CoderThread(void *p)
@@ -46,3 +48,159 @@ void CVirtThread::WaitThreadFinish()
     Thread.Close();
   }
 }
+
+
+
+struct CVirtThreadWorker
+{
+  NWindows::NSynchronization::CAutoResetEvent StartEvent;
+  NWindows::CThread Thread;
+  CPooledVirtThread *Job; // (Job == NULL) means exit
+};
+
+class CVirtThreadPool
+{
+  NWindows::NSynchronization::CCriticalSection _cs;
+  CRecordVector<CVirtThreadWorker *> _idle;
+public:
+  unsigned MaxThreads;
+
+  CVirtThreadPool(): MaxThreads(32) {}
+  /* we don't stop idle threads here. In DLL this destructor is called
+     in DLL_PROCESS_DETACH under loader lock, and waiting for thread there
+     deadlocks. The DLL client calls SetThreadPoolSize(0) before FreeLibrary(). */
+
+  CVirtThreadWorker *Get()
+  {
+    NWindows::NSynchronization::CCriticalSectionLock lock(_cs);
+    if (_idle.IsEmpty())
+      return NULL;
+    // last returned thread is still "warm"
+    CVirtThreadWorker *w = _idle.Back();
+    _idle.DeleteBack();
+    return w;
+  }
+
+  bool Put(CVirtThreadWorker *w)
+  {
+    NWindows::NSynchronization::CCriticalSectionLock lock(_cs);
+    if (_idle.Size() >= MaxThreads)
+      return false;
+    _idle.Add(w);
+    return true;
+  }
+
+  void Reduce(unsigned maxThreads);
+};
+
+static CVirtThreadPool g_VirtThreadPool;
+
+// it's called only for thread that is not running Execute()
+
+static void VirtThreadWorker_Exit(CVirtThreadWorker *w)
+{
+  w->Job = NULL;
+  w->StartEvent.Set();
+  w->Thread.Wait();
+  delete w;
+}
+
+void CVirtThreadPool::Reduce(unsigned maxThreads)
+{
+  CRecordVector<CVirtThreadWorker *> items;
+  {
+    NWindows::NSynchronization::CCriticalSectionLock lock(_cs);
+    MaxThreads = maxThreads;
+    while (_idle.Size() > maxThreads)
+    {
+      items.Add(_idle.Back());
+      _idle.DeleteBack();
+    }
+  }
+  FOR_VECTOR (i, items)
+    VirtThreadWorker_Exit(items[i]);
+}
+
+void VirtThreadPool_SetMaxThreads(unsigned maxThreads)
+{
+  g_VirtThreadPool.Reduce(maxThreads);
+}
+
+static THREAD_FUNC_DECL PooledThread(void *p)
+{
+  CVirtThreadWorker *w = (CVirtThreadWorker *)p;
+  for (;;)
+  {
+    w->StartEvent.Lock();
+    CPooledVirtThread *job = w->Job;
+    if (!job)
+      return 0;
+    job->Execute();
+    /* we return the thread to pool before FinishedEvent.Set(),
+       so the owner of job can get same thread for next job */
+    const bool pooled = g_VirtThreadPool.Put(w);
+    // if the pool is full, the owner of job waits for exit of thread and deletes worker
+    job->_workerExits = !pooled;
+    job->FinishedEvent.Set();
+    if (!pooled)
+      return 0;
+  }
+}
+
+WRes CPooledVirtThread::Create()
+{
+  RINOK(FinishedEvent.CreateIfNotCreated());
+  FinishedEvent.Reset();
+  _started = false;
+  if (_worker)
+    return 0;
+  CVirtThreadWorker *w = g_VirtThreadPool.Get();
+  if (!w)
+  {
+    w = new CVirtThreadWorker;
+    WRes wres = w->StartEvent.Create();
+    if (wres == 0)
+      wres = w->Thread.Create(PooledThread, w);
+    if (wres != 0)
+    {
+      delete w;
+      return wres;
+    }
+  }
+  _worker = w;
+  return 0;
+}
+
+void CPooledVirtThread::Start()
+{
+  _started = true;
+  _workerExits = false;
+  _worker->Job = this;
+  _worker->StartEvent.Set();
+}
+
+void CPooledVirtThread::WaitExecuteFinish()
+{
+  FinishedEvent.Lock();
+  // the thread was returned to pool (or it exits) after Execute()
+  if (_workerExits)
+  {
+    _worker->Thread.Wait();
+    delete _worker;
+  }
+  _worker = NULL;
+  _started = false;
+}
+
+void CPooledVirtThread::WaitThreadFinish()
+{
+  if (_started)
+    WaitExecuteFinish();
+  if (_worker)
+  {
+    // the thread was taken by Create(), but Start() was not called
+    if (!g_VirtThreadPool.Put(_worker))
+      VirtThreadWorker_Exit(_worker);
+    _worker = NULL;
+  }
+}
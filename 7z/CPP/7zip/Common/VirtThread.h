@@ -21,4 +21,38 @@ struct CVirtThread
   void WaitExecuteFinish() { FinishedEvent.Lock(); }
 };
 
+
+struct CVirtThreadWorker;
+
+/*
+  CPooledVirtThread is like CVirtThread, but it doesn't own OS thread.
+  Create() takes idle thread from process-wide pool (or creates new thread).
+  After Execute() the thread returns to pool, so next Create() call
+  (in same or another object) doesn't create new thread.
+  The pool doesn't limit the number of running threads, because the coders
+  in mixer wait each other, so all of them must run at same time.
+  Thread that finishes Execute() exits, if the pool already keeps
+  VirtThreadPool_SetMaxThreads() idle threads.
+  The pool doesn't stop idle threads at exit. So DLL must call
+  VirtThreadPool_SetMaxThreads(0) before unloading.
+*/
+
+struct CPooledVirtThread
+{
+  NWindows::NSynchronization::CAutoResetEvent FinishedEvent;
+  CVirtThreadWorker *_worker;
+  bool _started;
+  bool _workerExits;
+
+  CPooledVirtThread(): _worker(NULL), _started(false), _workerExits(false) {}
+  ~CPooledVirtThread() { WaitThreadFinish(); }
+  void WaitThreadFinish(); // call it in destructor of child class !
+  WRes Create();
+  void Start();
+  virtual void Execute() = 0;
+  void WaitExecuteFinish();
+};
+
+void VirtThreadPool_SetMaxThreads(unsigned maxThreads);
+
 #endif
@@ -9,6 +9,7 @@
 #include "../Common/StreamUtils.h"
 
 #include "PpmdDecoder.h"
+#include "PpmdPool.h"
 
 namespace NCompress {
 namespace NPpmd {
@@ -26,7 +27,7 @@ enum
 CDecoder::~CDecoder()
 {
   ::MidFree(_outBuf);
-  Ppmd7_Free(&_ppmd, &g_BigAlloc);
+  Ppmd7_Free(&_ppmd, &g_PpmdModelAlloc);
 }
 
 STDMETHODIMP CDecoder::SetDecoderProperties2(const Byte *props, UInt32 size)
@@ -42,7 +43,7 @@ STDMETHODIMP CDecoder::SetDecoderProperties2(const Byte *props, UInt32 size)
     return E_NOTIMPL;
   if (!_inStream.Alloc(1 << 20))
     return E_OUTOFMEMORY;
-  if (!Ppmd7_Alloc(&_ppmd, memSize, &g_BigAlloc))
+  if (!Ppmd7_Alloc(&_ppmd, memSize, &g_PpmdModelAlloc))
     return E_OUTOFMEMORY;
   return S_OK;
 }
@@ -8,6 +8,7 @@
 #include "../Common/StreamUtils.h"
 
 #include "PpmdEncoder.h"
+#include "PpmdPool.h"
 
 namespace NCompress {
 namespace NPpmd {
@@ -50,7 +51,7 @@ CEncoder::CEncoder():
 CEncoder::~CEncoder()
 {
   ::MidFree(_inBuf);
-  Ppmd7_Free(&_ppmd, &g_BigAlloc);
+  Ppmd7_Free(&_ppmd, &g_PpmdModelAlloc);
 }
 
 STDMETHODIMP CEncoder::SetCoderProperties(const PROPID *propIDs, const PROPVARIANT *coderProps, UInt32 numProps)
@@ -114,7 +115,7 @@ HRESULT CEncoder::Code(ISequentialInStream *inStream, ISequentialOutStream *outS
   }
   if (!_outStream.Alloc(1 << 20))
     return E_OUTOFMEMORY;
-  if (!Ppmd7_Alloc(&_ppmd, _props.MemSize, &g_BigAlloc))
+  if (!Ppmd7_Alloc(&_ppmd, _props.MemSize, &g_PpmdModelAlloc))
     return E_OUTOFMEMORY;
 
   _outStream.Stream = outStream;
@@ -0,0 +1,150 @@
+// PpmdPool.cpp
+
+#include "StdAfx.h"
+
+#include "../../../C/Alloc.h"
+
+#ifndef _7ZIP_ST
+#include "../../Windows/Synchronization.h"
+#endif
+
+#include "PpmdPool.h"
+
+namespace NCompress {
+namespace NPpmd {
+
+/* each block starts with header that contains the size of block */
+static const size_t kHeaderSize = 16;
+
+static const unsigned kNumItemsMax = 8;
+
+/* the pool memory is not released until process exit (or DLL unload). So the limit is small:
+   it's enough for model of level 7 (mem = 64 MB) in 64-bit,
+   and for model of level 5 (mem = 16 MB) in 32-bit. */
+static const size_t kModelPoolMaxSize = (size_t)1 << (sizeof(size_t) > 4 ? 27 : 25);
+
+struct CPoolItem
+{
+  void *Block;
+  size_t Size;
+};
+
+class CModelPool
+{
+  CPoolItem _items[kNumItemsMax];
+  unsigned _numItems;
+  size_t _totalSize;
+
+  void Delete(unsigned index)
+  {
+    ::BigFree(_items[index].Block);
+    _totalSize -= _items[index].Size;
+    _numItems--;
+    for (unsigned i = index; i < _numItems; i++)
+      _items[i] = _items[i + 1];
+  }
+public:
+  size_t MaxSize;
+
+  CModelPool(): _numItems(0), _totalSize(0), MaxSize(kModelPoolMaxSize) {}
+
+  void *Get(size_t size)
+  {
+    // the last returned block is still in CPU cache
+    for (unsigned i = _numItems; i != 0;)
+    {
+      i--;
+      if (_items[i].Size == size)
+      {
+        void *block = _items[i].Block;
+        _totalSize -= size;
+        _numItems--;
+        for (; i < _numItems; i++)
+          _items[i] = _items[i + 1];
+        return block;
+      }
+    }
+    return NULL;
+  }
+
+  // old items are deleted first
+  void Reduce(size_t maxSize)
+  {
+    while (_numItems != 0 && _totalSize > maxSize)
+      Delete(0);
+  }
+
+  void Put(void *block, size_t size)
+  {
+    if (size > MaxSize)
+    {
+      ::BigFree(block);
+      return;
+    }
+    Reduce(MaxSize - size);
+    if (_numItems == kNumItemsMax)
+      Delete(0);
+    _items[_numItems].Block = block;
+    _items[_numItems].Size = size;
+    _numItems++;
+    _totalSize += size;
+  }
+};
+
+/* The coders can call Free() from destructors of static objects of other modules
+   after destructors of this module were called (at DLL unload or process exit).
+   So the pool and its critical section are never destroyed. CModelPoolRelease
+   releases the blocks and sets (MaxSize = 0), so later Free() calls release memory directly. */
+
+static CModelPool &g_ModelPool = *new CModelPool;
+
+#ifndef _7ZIP_ST
+  static NWindows::NSynchronization::CCriticalSection &g_ModelPoolCriticalSection =
+      *new NWindows::NSynchronization::CCriticalSection;
+  #define MT_LOCK NWindows::NSynchronization::CCriticalSectionLock lock(g_ModelPoolCriticalSection);
+#else
+  #define MT_LOCK
+#endif
+
+static struct CModelPoolRelease
+{
+  ~CModelPoolRelease()
+  {
+    MT_LOCK
+    g_ModelPool.MaxSize = 0;
+    g_ModelPool.Reduce(0);
+  }
+} g_ModelPoolRelease;
+
+static void *SzModelAlloc(ISzAllocPtr, size_t size)
+{
+  if (size == 0 || size > (size_t)0 - kHeaderSize)
+    return NULL;
+  size += kHeaderSize;
+  void *block;
+  {
+    MT_LOCK
+    block = g_ModelPool.Get(size);
+  }
+  if (!block)
+  {
+    block = ::BigAlloc(size);
+    if (!block)
+      return NULL;
+    *(size_t *)block = size;
+  }
+  return (Byte *)block + kHeaderSize;
+}
+
+static void SzModelFree(ISzAllocPtr, void *address)
+{
+  if (!address)
+    return;
+  void *block = (Byte *)address - kHeaderSize;
+  MT_LOCK
+  g_ModelPool.Put(block, *(const size_t *)block);
+}
+
+const ISzAlloc g_PpmdModelAlloc = { SzModelAlloc, SzModelFree };
+
+}}
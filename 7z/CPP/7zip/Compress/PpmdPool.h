@@ -0,0 +1,25 @@
+// PpmdPool.h
+
+#ifndef __COMPRESS_PPMD_POOL_H
+#define __COMPRESS_PPMD_POOL_H
+
+#include "../../../C/7zTypes.h"
+
+namespace NCompress {
+namespace NPpmd {
+
+/*
+  g_PpmdModelAlloc is allocator for PPMd model memory.
+  Free() doesn't release the block, but returns it to process-wide pool.
+  Alloc() with same size gets the block from pool, so new coder
+  doesn't allocate and doesn't fault in the pages of model again.
+  Ppmd7_Init() resets the model in borrowed block.
+  The pool keeps up to 8 blocks with total size that doesn't exceed
+  128 MB (32 MB in 32-bit). The blocks are released at process exit (or DLL unload).
+*/
+
+extern const ISzAlloc g_PpmdModelAlloc;
+
+}}
+
+#endif
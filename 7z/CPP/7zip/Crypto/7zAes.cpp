@@ -2,6 +2,7 @@
 
 #include "StdAfx.h"
 
+#include "../../../C/CpuArch.h"
 #include "../../../C/Sha256.h"
 
 #include "../../Common/ComTry.h"
@@ -48,29 +49,32 @@ void CKeyInfo::CalcKey()
   }
   else
   {
-    size_t bufSize = 8 + SaltSize + Password.Size();
-    CObjArray<Byte> buf(bufSize);
+    /* we hash (numUnroll) consecutive (Salt, Password, counter) records per
+       Sha256_Update() call, so full blocks go to SHA-256 code without copying */
+    const unsigned kUnrollPower = 6;
+    const UInt32 numUnroll = (UInt32)1 << (NumCyclesPower < kUnrollPower ? NumCyclesPower : kUnrollPower);
+    const size_t bufSize = 8 + SaltSize + Password.Size();
+    CObjArray<Byte> buf(bufSize * numUnroll);
     memcpy(buf, Salt, SaltSize);
     memcpy(buf + SaltSize, Password, Password.Size());
+    memset(buf + bufSize - 8, 0, 8);
+    for (UInt32 k = 1; k < numUnroll; k++)
+      memcpy(buf + bufSize * k, buf, bufSize);
     
     CSha256 sha;
     Sha256_Init(&sha);
     
-    Byte *ctr = buf + SaltSize + Password.Size();
-    
-    for (unsigned i = 0; i < 8; i++)
-      ctr[i] = 0;
-    
-    UInt64 numRounds = (UInt64)1 << NumCyclesPower;
-
+    const UInt64 numRounds = (UInt64)1 << NumCyclesPower;
+    UInt64 r = 0;
     do
     {
-      Sha256_Update(&sha, buf, bufSize);
-      for (unsigned i = 0; i < 8; i++)
-        if (++(ctr[i]) != 0)
-          break;
+      Byte *ctr = buf + bufSize - 8;
+      for (UInt32 k = 0; k < numUnroll; k++, ctr += bufSize)
+        SetUi64(ctr, r + k);
+      Sha256_Update(&sha, buf, bufSize * numUnroll);
+      r += numUnroll;
     }
-    while (--numRounds != 0);
+    while (r != numRounds);
 
     Sha256_Final(&sha, Key);
   }
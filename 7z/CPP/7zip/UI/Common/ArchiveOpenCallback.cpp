@@ -48,6 +48,7 @@ STDMETHODIMP COpenCallbackImp::GetProperty(PROPID propID, PROPVARIANT *value)
   else
     switch (propID)
     {
+      case kpidPath:  prop = fs2us(_folderPrefix + _fileInfo.Name); break;
       case kpidName:  prop = _fileInfo.Name; break;
       case kpidIsDir:  prop = _fileInfo.IsDir(); break;
       case kpidSize:  prop = _fileInfo.Size; break;
@@ -473,6 +473,9 @@ extern "C"
 }
 #endif
 
+// the number of idle threads that DLL keeps for next operations
+static const UInt32 kNumPoolThreads = 32;
+
 HRESULT CCodecs::LoadDll(const FString &dllPath, bool needCheckDll, bool *loadedOK)
 {
   if (loadedOK)
@@ -532,6 +535,13 @@ HRESULT CCodecs::LoadDll(const FString &dllPath, bool needCheckDll, bool *loaded
   
   if (!used)
     Libs.DeleteBack();
+  else
+  {
+    // CloseLibs() stops idle threads of DLL before FreeLibrary()
+    lib.SetThreadPoolSize = (Func_SetThreadPoolSize)lib.Lib.GetProc("SetThreadPoolSize");
+    if (lib.SetThreadPoolSize)
+      lib.SetThreadPoolSize(kNumPoolThreads);
+  }
 
   return res;
 }
@@ -566,6 +576,10 @@ void CCodecs::CloseLibs()
     const CCodecLib &lib = Libs[i];
     if (lib.SetCodecs)
       lib.SetCodecs(NULL);
+    /* DLL can't stop its idle threads in DllMain(DLL_PROCESS_DETACH),
+       so we stop them here */
+    if (lib.SetThreadPoolSize)
+      lib.SetThreadPoolSize(0);
   }
   
   // OutputDebugStringA("~CloseLibs after SetCodecs");
@@ -209,6 +209,7 @@ struct CCodecLib
   Func_CreateDecoder CreateDecoder;
   Func_CreateEncoder CreateEncoder;
   Func_SetCodecs SetCodecs;
+  Func_SetThreadPoolSize SetThreadPoolSize;
 
   CMyComPtr<IHashers> ComHashers;
   
@@ -221,7 +222,8 @@ struct CCodecLib
       GetMethodProperty(NULL),
       CreateDecoder(NULL),
       CreateEncoder(NULL),
-      SetCodecs(NULL)
+      SetCodecs(NULL),
+      SetThreadPoolSize(NULL)
       {}
 };
 
@@ -9,6 +9,12 @@
 #include <unistd.h>
 #endif
 
+#ifdef USE_IO_URING
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#endif
+
 namespace NC {
 namespace NFile {
 namespace NIO {
@@ -50,8 +56,122 @@ off_t CFileBase::Seek(off_t distanceToMove, int moveMethod) const
 /////////////////////////
 // CInFile
 
+#ifdef USE_IO_URING
+
+CInFile::CInFile(): _ring(NULL), _raDisabled(false)
+{
+  for (unsigned i = 0; i < kNumIoChunks; i++)
+    _chunks[i] = NULL;
+}
+
+CInFile::~CInFile()
+{
+  // Close() waits for all requests, so the kernel doesn't use the chunks after that
+  Close();
+  for (unsigned i = 0; i < kNumIoChunks; i++)
+    free(_chunks[i]);
+}
+
+bool CInFile::Close()
+{
+  ReadAhead_Stop();
+  _raDisabled = false;
+  return CFileBase::Close();
+}
+
+bool CInFile::ReadAhead_Start()
+{
+  if (_raDisabled)
+    return false;
+  // we don't use read-ahead for pipes
+  const off_t pos = CFileBase::Seek(0, SEEK_CUR);
+  if (pos != -1)
+    _ring = IoUring_Get();
+  if (!_ring)
+  {
+    _raDisabled = true;
+    return false;
+  }
+  _pos = (UInt64)pos;
+  _submitPos = (UInt64)pos;
+  _head = 0;
+  _numReqs = 0;
+  _headOffset = 0;
+  _eof = false;
+  _fullChunk = false;
+  return true;
+}
+
+// it must be called between _ring->Lock() and _ring->Unlock()
+
+bool CInFile::ReadAhead_Submit()
+{
+  while (!_eof && _numReqs < kNumIoChunks)
+  {
+    // we send one request for first chunk, because most of files are small
+    if (_numReqs != 0 && !_fullChunk)
+      break;
+    const unsigned index = (_head + _numReqs) % kNumIoChunks;
+    Byte *chunk = _chunks[index];
+    if (!chunk)
+    {
+      chunk = (Byte *)malloc(kIoChunkSize);
+      if (!chunk)
+      {
+        if (_numReqs != 0)
+          break;
+        errno = ENOMEM;
+        return false;
+      }
+      _chunks[index] = chunk;
+    }
+    if (!_ring->AddReadV(_handle, &_reqs[index], chunk, kIoChunkSize, _submitPos))
+      return false;
+    _submitPos += kIoChunkSize;
+    _numReqs++;
+  }
+  return _ring->Submit();
+}
+
+void CInFile::ReadAhead_Stop()
+{
+  if (!_ring)
+    return;
+  _ring->Lock();
+  for (unsigned i = 0; i < _numReqs; i++)
+  {
+    CIoRequest &req = _reqs[(_head + i) % kNumIoChunks];
+    // if Wait() fails, the request was dropped before the kernel got it, so the chunk is free
+    if (!req.Done)
+      _ring->Wait(&req);
+  }
+  _numReqs = 0;
+  _ring->Unlock();
+  _ring->Release();
+  _ring = NULL;
+  if (_handle != -1)
+    CFileBase::Seek((off_t)_pos, SEEK_SET);
+}
+
+off_t CInFile::Seek(off_t distanceToMove, int moveMethod)
+{
+  if (_ring)
+  {
+    if (moveMethod == SEEK_CUR && distanceToMove == 0)
+      return (off_t)_pos;
+    // ReadAhead_Stop() sets the position of file to _pos
+    ReadAhead_Stop();
+  }
+  return CFileBase::Seek(distanceToMove, moveMethod);
+}
+
+#endif
+
 bool CInFile::Open(const char *name)
 {
+  #ifdef USE_IO_URING
+  Close();
+  #endif
   return CFileBase::OpenBinary(name, O_RDONLY);
 }
 
@@ -62,14 +182,268 @@ bool CInFile::OpenShared(const char *name, bool)
 
 ssize_t CInFile::Read(void *data, size_t size)
 {
+  #ifdef USE_IO_URING
+  if (size != 0 && (_ring || ReadAhead_Start()))
+  {
+    ssize_t res = -1;
+    _ring->Lock();
+    for (;;)
+    {
+      if (!ReadAhead_Submit())
+        break;
+      if (_numReqs == 0)
+      {
+        res = 0;
+        break;
+      }
+      CIoRequest &req = _reqs[_head];
+      if (!req.Done && !_ring->Wait(&req))
+        break;
+      if (req.Res < 0)
+      {
+        errno = -req.Res;
+        break;
+      }
+      Byte *chunk = _chunks[_head];
+      // the request for rest of chunk starts at (req.Vec.iov_base)
+      const UInt32 chunkSize = (UInt32)((Byte *)req.Vec.iov_base - chunk) + (UInt32)req.Res;
+      if (chunkSize == kIoChunkSize)
+        _fullChunk = true;
+      else if (req.Res == 0)
+        _eof = true;
+      else
+      {
+        /* short read is not end of file: it's possible for FUSE, NFS and after signal.
+           We request the rest of chunk, and we return the data that we have already. */
+        if (!_ring->AddReadV(_handle, &req, chunk + chunkSize, kIoChunkSize - chunkSize, req.Offset + (UInt32)req.Res)
+            || !_ring->Submit())
+          break;
+      }
+      UInt32 cur = chunkSize - _headOffset;
+      if (cur != 0)
+      {
+        if (cur > size)
+          cur = (UInt32)size;
+        memcpy(data, chunk + _headOffset, cur);
+        _headOffset += cur;
+        _pos += cur;
+        res = (ssize_t)cur;
+      }
+      if (_headOffset == kIoChunkSize)
+      {
+        _head = (_head + 1) % kNumIoChunks;
+        _numReqs--;
+        _headOffset = 0;
+      }
+      if (cur != 0 || _eof)
+      {
+        if (cur == 0)
+          res = 0;
+        break;
+      }
+    }
+    _ring->Unlock();
+    return res;
+  }
+  #endif
   return read(_handle, data, size);
 }
 
 /////////////////////////
 // COutFile
 
+#ifdef USE_IO_URING
+
+COutFile::COutFile(): _ring(NULL), _error(0), _wbDisabled(false)
+{
+  for (unsigned i = 0; i < kNumIoChunks; i++)
+    _chunks[i] = NULL;
+}
+
+COutFile::~COutFile()
+{
+  // Close() waits for all requests, so the kernel doesn't use the chunks after that
+  Close();
+  for (unsigned i = 0; i < kNumIoChunks; i++)
+    free(_chunks[i]);
+}
+
+/*
+  WriteBehind_*() functions must be called between _ring->Lock() and _ring->Unlock().
+  It returns false, if some write request failed. errno of first error is kept in _error.
+*/
+
+bool COutFile::WriteBehind_Check(CIoRequest &req)
+{
+  if (req.Res < 0)
+  {
+    if (_error == 0)
+      _error = -req.Res;
+  }
+  else
+  {
+    // we write the rest of short write (disk is full, or file size limit) with pwrite()
+    const Byte *p = (const Byte *)req.Vec.iov_base + (size_t)req.Res;
+    size_t rem = req.Vec.iov_len - (size_t)req.Res;
+    UInt64 offset = req.Offset + (UInt64)req.Res;
+    while (rem != 0 && _error == 0)
+    {
+      const ssize_t res = pwrite(_handle, p, rem, (off_t)offset);
+      if (res <= 0)
+        _error = (res == 0 ? ENOSPC : errno);
+      else
+      {
+        p += res;
+        rem -= (size_t)res;
+        offset += (UInt64)res;
+      }
+    }
+  }
+  return _error == 0;
+}
+
+bool COutFile::WriteBehind_WaitHead()
+{
+  CIoRequest &req = _reqs[_head];
+  _head = (_head + 1) % kNumIoChunks;
+  _numReqs--;
+  if (!req.Done && !_ring->Wait(&req))
+  {
+    if (_error == 0)
+      _error = errno;
+    return false;
+  }
+  return WriteBehind_Check(req);
+}
+
+bool COutFile::WriteBehind_Submit()
+{
+  const unsigned index = (_head + _numReqs) % kNumIoChunks;
+  if (!_ring->AddWriteV(_handle, &_reqs[index], _chunks[index], _chunkPos, _pos, false) || !_ring->Submit())
+  {
+    if (_error == 0)
+      _error = errno;
+    return false;
+  }
+  _pos += _chunkPos;
+  _chunkPos = 0;
+  _numReqs++;
+  // (_head + _numReqs) chunk must be free for next data
+  if (_numReqs == kNumIoChunks)
+    return WriteBehind_WaitHead();
+  return _error == 0;
+}
+
+bool COutFile::WriteBehind_Flush()
+{
+  if (_chunkPos != 0)
+    WriteBehind_Submit();
+  while (_numReqs != 0)
+    WriteBehind_WaitHead();
+  return _error == 0;
+}
+
+bool COutFile::Close()
+{
+  if (!_ring)
+  {
+    _wbDisabled = false;
+    return CFileBase::Close();
+  }
+  
+  _ring->Lock();
+  
+  while (_numReqs != 0)
+    WriteBehind_WaitHead();
+  
+  bool closed = false;
+  
+  if (_error == 0 && _ring->CloseIsSupported)
+  {
+    /* we send last write and close() as linked requests in one io_uring_enter() call.
+       If write fails or it's short, the kernel cancels close() request. */
+    CIoRequest &writeReq = _reqs[_head];
+    CIoRequest closeReq;
+    const bool writeMode = (_chunkPos != 0);
+    const bool writeAdded = writeMode && _ring->AddWriteV(_handle, &writeReq, _chunks[_head], _chunkPos, _pos, true);
+    const bool closeAdded = (writeAdded || !writeMode) && _ring->AddClose(_handle, &closeReq);
+    // we wait for all added requests, because closeReq is on the stack
+    const bool writeDone = writeAdded && _ring->Wait(&writeReq);
+    const bool closeDone = closeAdded && _ring->Wait(&closeReq);
+    if (writeDone)
+    {
+      WriteBehind_Check(writeReq);
+      _pos += _chunkPos;
+      _chunkPos = 0;
+    }
+    if (closeDone)
+    {
+      if (closeReq.Res != -ECANCELED)
+      {
+        closed = true;
+        _handle = -1;
+        if (closeReq.Res < 0 && _error == 0)
+          _error = -closeReq.Res;
+      }
+    }
+    /* if Wait() fails for closeReq, the engine has failed, and the request was dropped
+       before the kernel got it. So we close the handle with close() */
+  }
+  
+  if (!closed)
+    WriteBehind_Flush();
+  
+  _ring->Unlock();
+  _ring->Release();
+  _ring = NULL;
+  _wbDisabled = false;
+  
+  const int error = _error;
+  _error = 0;
+  if (!closed && !CFileBase::Close())
+    return false;
+  if (error != 0)
+  {
+    errno = error;
+    return false;
+  }
+  return true;
+}
+
+off_t COutFile::Seek(off_t distanceToMove, int moveMethod)
+{
+  if (_ring)
+  {
+    _ring->Lock();
+    const bool ok = WriteBehind_Flush();
+    _ring->Unlock();
+    if (!ok)
+    {
+      errno = _error;
+      return -1;
+    }
+    CFileBase::Seek((off_t)_pos, SEEK_SET);
+  }
+  const off_t res = CFileBase::Seek(distanceToMove, moveMethod);
+  if (_ring && res != -1)
+    _pos = (UInt64)res;
+  return res;
+}
+
+bool COutFile::GetLength(UInt64 &length)
+{
+  if (Seek(0, SEEK_CUR) == -1)
+    return false;
+  return CFileBase::GetLength(length);
+}
+
+#endif
+
 bool COutFile::Create(const char *name, bool createAlways)
 {
+  #ifdef USE_IO_URING
+  Close();
+  #endif
   if (createAlways)
   {
     Close();
@@ -86,6 +460,66 @@ bool COutFile::Open(const char *name, DWORD creationDisposition)
 
 ssize_t COutFile::Write(const void *data, size_t size)
 {
+  #ifdef USE_IO_URING
+  if (!_ring && !_wbDisabled && size != 0)
+  {
+    const off_t pos = CFileBase::Seek(0, SEEK_CUR);
+    if (pos != -1)
+      _ring = IoUring_Get();
+    if (!_ring)
+      _wbDisabled = true;
+    else
+    {
+      _pos = (UInt64)pos;
+      _head = 0;
+      _numReqs = 0;
+      _chunkPos = 0;
+      _error = 0;
+    }
+  }
+  if (_ring)
+  {
+    if (_error != 0)
+    {
+      errno = _error;
+      return -1;
+    }
+    ssize_t res = (ssize_t)size;
+    _ring->Lock();
+    while (size != 0)
+    {
+      const unsigned index = (_head + _numReqs) % kNumIoChunks;
+      Byte *chunk = _chunks[index];
+      if (!chunk)
+      {
+        chunk = (Byte *)malloc(kIoChunkSize);
+        if (!chunk)
+        {
+          _error = ENOMEM;
+          break;
+        }
+        _chunks[index] = chunk;
+      }
+      size_t cur = kIoChunkSize - _chunkPos;
+      if (cur > size)
+        cur = size;
+      memcpy(chunk + _chunkPos, data, cur);
+      _chunkPos += (UInt32)cur;
+      data = (const Byte *)data + cur;
+      size -= cur;
+      if (_chunkPos == kIoChunkSize)
+        if (!WriteBehind_Submit())
+          break;
+    }
+    _ring->Unlock();
+    if (_error != 0)
+    {
+      errno = _error;
+      return -1;
+    }
+    return res;
+  }
+  #endif
   return write(_handle, data, size);
 }
 
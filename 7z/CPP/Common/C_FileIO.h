@@ -9,6 +9,8 @@
 #include "MyTypes.h"
 #include "MyWindows.h"
 
+#include "C_IoUring.h"
+
 #ifdef _WIN32
 #ifdef _MSC_VER
 typedef size_t ssize_t;
@@ -32,9 +34,49 @@ public:
   off_t Seek(off_t distanceToMove, int moveMethod) const;
 };
 
+#ifdef USE_IO_URING
+
+/*
+  If io_uring is available, CInFile reads the file with up to kNumIoChunks
+  requests ahead of the caller, and COutFile writes the data from its chunks,
+  while the caller fills next chunk. The requests use explicit file offsets,
+  so the position of the file descriptor is changed only by Seek().
+  The first read request of file is one chunk only, so small file is
+  read with one io_uring_enter() call. COutFile::Close() sends last write
+  and close() in one linked batch.
+*/
+
+const unsigned kNumIoChunks = 4;
+const UInt32 kIoChunkSize = (UInt32)1 << 18;
+
+#endif
+
 class CInFile: public CFileBase
 {
+  #ifdef USE_IO_URING
+  CIoUring *_ring;
+  Byte *_chunks[kNumIoChunks];
+  CIoRequest _reqs[kNumIoChunks];
+  UInt64 _pos;          // position of the data for next Read() call
+  UInt64 _submitPos;    // file offset for next read request
+  unsigned _head;       // index of chunk that contains the data at _pos
+  unsigned _numReqs;    // the number of submitted chunks starting from _head
+  UInt32 _headOffset;   // the number of bytes in head chunk that were returned to caller
+  bool _eof;
+  bool _fullChunk;      // some request returned full chunk, so it's not small file
+  bool _raDisabled;
+
+  bool ReadAhead_Start();
+  bool ReadAhead_Submit();
+  void ReadAhead_Stop();
+  #endif
 public:
+  #ifdef USE_IO_URING
+  CInFile();
+  ~CInFile();
+  bool Close();
+  off_t Seek(off_t distanceToMove, int moveMethod);
+  #endif
   bool Open(const char *name);
   bool OpenShared(const char *name, bool shareForWrite);
   ssize_t Read(void *data, size_t size);
@@ -42,7 +84,30 @@ public:
 
 class COutFile: public CFileBase
 {
+  #ifdef USE_IO_URING
+  CIoUring *_ring;
+  Byte *_chunks[kNumIoChunks];
+  CIoRequest _reqs[kNumIoChunks];
+  UInt64 _pos;          // file offset of the start of current chunk
+  unsigned _head;       // index of first submitted chunk
+  unsigned _numReqs;    // the number of submitted chunks starting from _head
+  UInt32 _chunkPos;     // the number of bytes in current chunk
+  int _error;           // errno of failed write request
+  bool _wbDisabled;
+
+  bool WriteBehind_Check(CIoRequest &req);
+  bool WriteBehind_WaitHead();
+  bool WriteBehind_Submit();
+  bool WriteBehind_Flush();
+  #endif
 public:
+  #ifdef USE_IO_URING
+  COutFile();
+  ~COutFile();
+  bool Close();
+  off_t Seek(off_t distanceToMove, int moveMethod);
+  bool GetLength(UInt64 &length);
+  #endif
   bool Create(const char *name, bool createAlways);
   bool Open(const char *name, DWORD creationDisposition);
   ssize_t Write(const void *data, size_t size);
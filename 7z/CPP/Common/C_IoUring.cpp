@@ -0,0 +1,389 @@
+// Common/C_IoUring.cpp
+
+#include "C_IoUring.h"
+
+#ifdef USE_IO_URING
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace NC {
+namespace NFile {
+namespace NIO {
+
+static const unsigned kNumEntries = 64;
+
+static int my_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int my_io_uring_enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+  return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int my_io_uring_register(int fd, unsigned opcode, void *arg, unsigned numArgs)
+{
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, numArgs);
+}
+
+#define RING_PTR(base, offset) ((unsigned *)(void *)((Byte *)(base) + (offset)))
+
+CIoUring::CIoUring():
+    _fd(-1),
+    _sqes((struct io_uring_sqe *)MAP_FAILED),
+    _sqRing(MAP_FAILED),
+    _cqRing(MAP_FAILED),
+    _numToSubmit(0),
+    _numInFlight(0),
+    _numRefs(1),
+    _failed(false),
+    CloseIsSupported(false)
+{
+  #ifndef _7ZIP_ST
+  pthread_mutex_init(&_cs, NULL);
+  #endif
+}
+
+CIoUring::~CIoUring()
+{
+  // the files wait for their requests before they release the engine, so no request is in flight here
+  if (_sqes != MAP_FAILED)
+    munmap(_sqes, _sqesSize);
+  if (_cqRing != MAP_FAILED)
+    munmap(_cqRing, _cqRingSize);
+  if (_sqRing != MAP_FAILED)
+    munmap(_sqRing, _sqRingSize);
+  if (_fd != -1)
+    close(_fd);
+  #ifndef _7ZIP_ST
+  pthread_mutex_destroy(&_cs);
+  #endif
+}
+
+bool CIoUring::Create(unsigned entries)
+{
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  _fd = my_io_uring_setup(entries, &p);
+  if (_fd < 0)
+  {
+    _fd = -1;
+    return false;
+  }
+
+  _sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  _cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  _sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+  
+  _sqRing = mmap(NULL, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+  if (_sqRing == MAP_FAILED)
+    return false;
+  _cqRing = mmap(NULL, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+  if (_cqRing == MAP_FAILED)
+    return false;
+  _sqes = (struct io_uring_sqe *)mmap(NULL, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+  if (_sqes == MAP_FAILED)
+    return false;
+
+  _sqHead = RING_PTR(_sqRing, p.sq_off.head);
+  _sqTail = RING_PTR(_sqRing, p.sq_off.tail);
+  _sqMask = *RING_PTR(_sqRing, p.sq_off.ring_mask);
+  _sqArray = RING_PTR(_sqRing, p.sq_off.array);
+  _cqHead = RING_PTR(_cqRing, p.cq_off.head);
+  _cqTail = RING_PTR(_cqRing, p.cq_off.tail);
+  _cqMask = *RING_PTR(_cqRing, p.cq_off.ring_mask);
+  _cqes = (struct io_uring_cqe *)(void *)((Byte *)_cqRing + p.cq_off.cqes);
+  _sqEntries = p.sq_entries;
+  _cqEntries = p.cq_entries;
+
+  {
+    const unsigned kNumOps = 256;
+    const size_t probeSize = sizeof(struct io_uring_probe) + kNumOps * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = (struct io_uring_probe *)malloc(probeSize);
+    if (probe)
+    {
+      memset(probe, 0, probeSize);
+      if (my_io_uring_register(_fd, IORING_REGISTER_PROBE, probe, kNumOps) == 0)
+      {
+        // IORING_OP_READV and IORING_OP_WRITEV are supported by any io_uring kernel
+        CloseIsSupported = (IORING_OP_CLOSE <= probe->last_op
+            && (probe->ops[IORING_OP_CLOSE].flags & IO_URING_OP_SUPPORTED) != 0);
+      }
+      free(probe);
+    }
+  }
+  return true;
+}
+
+void CIoUring::Lock()
+{
+  #ifndef _7ZIP_ST
+  pthread_mutex_lock(&_cs);
+  #endif
+}
+
+void CIoUring::Unlock()
+{
+  #ifndef _7ZIP_ST
+  pthread_mutex_unlock(&_cs);
+  #endif
+}
+
+void CIoUring::SetFailed()
+{
+  // the kernel has not read the sqes after (*_sqHead), so we can remove them
+  __atomic_store_n(_sqTail, *_sqTail - _numToSubmit, __ATOMIC_RELEASE);
+  _numToSubmit = 0;
+  /* the kernel still can read or write the buffers of submitted requests.
+     So we wait for all their completions. If io_uring_enter() can't wait,
+     we check completion queue after sched_yield(). */
+  while (_numInFlight != 0)
+  {
+    ReapCompletions();
+    if (_numInFlight != 0
+        && my_io_uring_enter(_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0
+        && errno != EINTR)
+      sched_yield();
+  }
+  __atomic_store_n(&_failed, true, __ATOMIC_RELEASE);
+}
+
+bool CIoUring::Enter(unsigned minComplete)
+{
+  if (_failed)
+  {
+    errno = EIO;
+    return false;
+  }
+  for (;;)
+  {
+    const int res = my_io_uring_enter(_fd, _numToSubmit, minComplete, minComplete != 0 ? IORING_ENTER_GETEVENTS : 0);
+    if (res >= 0)
+    {
+      _numToSubmit -= (unsigned)res;
+      _numInFlight += (unsigned)res;
+      return true;
+    }
+    if (errno == EINTR)
+      continue;
+    if ((errno == EAGAIN || errno == EBUSY) && _numInFlight != 0)
+    {
+      // completion queue is full, or the kernel has no memory for new requests
+      ReapCompletions();
+      minComplete = 1;
+      continue;
+    }
+    SetFailed();
+    return false;
+  }
+}
+
+void CIoUring::ReapCompletions()
+{
+  unsigned head = *_cqHead;
+  const unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+  if (head == tail)
+    return;
+  do
+  {
+    const struct io_uring_cqe *cqe = &_cqes[head & _cqMask];
+    CIoRequest *req = (CIoRequest *)(size_t)cqe->user_data;
+    req->Res = cqe->res;
+    req->Done = true;
+    _numInFlight--;
+  }
+  while (++head != tail);
+  __atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+}
+
+struct io_uring_sqe *CIoUring::GetSqe()
+{
+  if (_failed)
+  {
+    errno = EIO;
+    return NULL;
+  }
+  // we don't allow more requests than completion queue can hold
+  while (_numInFlight + _numToSubmit >= _cqEntries)
+  {
+    if (!Enter(1))
+      return NULL;
+    ReapCompletions();
+  }
+  const unsigned tail = *_sqTail;
+  if (tail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) == _sqEntries)
+    if (!Enter(0))
+      return NULL;
+  struct io_uring_sqe *sqe = &_sqes[tail & _sqMask];
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+#define COMMIT_SQE(sqe) { \
+  const unsigned tail = *_sqTail; \
+  _sqArray[tail & _sqMask] = (unsigned)(sqe - _sqes); \
+  __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE); \
+  _numToSubmit++; }
+
+bool CIoUring::AddReadV(int fd, CIoRequest *req, void *data, size_t size, UInt64 offset)
+{
+  struct io_uring_sqe *sqe = GetSqe();
+  if (!sqe)
+    return false;
+  req->Vec.iov_base = data;
+  req->Vec.iov_len = size;
+  req->Offset = offset;
+  req->Res = 0;
+  req->Done = false;
+  sqe->opcode = IORING_OP_READV;
+  sqe->fd = fd;
+  sqe->addr = (UInt64)(size_t)&req->Vec;
+  sqe->len = 1;
+  sqe->off = offset;
+  sqe->user_data = (UInt64)(size_t)req;
+  COMMIT_SQE(sqe)
+  return true;
+}
+
+bool CIoUring::AddWriteV(int fd, CIoRequest *req, const void *data, size_t size, UInt64 offset, bool linkNext)
+{
+  struct io_uring_sqe *sqe = GetSqe();
+  if (!sqe)
+    return false;
+  req->Vec.iov_base = (void *)data;
+  req->Vec.iov_len = size;
+  req->Offset = offset;
+  req->Res = 0;
+  req->Done = false;
+  sqe->opcode = IORING_OP_WRITEV;
+  sqe->fd = fd;
+  if (linkNext)
+    sqe->flags = IOSQE_IO_LINK;
+  sqe->addr = (UInt64)(size_t)&req->Vec;
+  sqe->len = 1;
+  sqe->off = offset;
+  sqe->user_data = (UInt64)(size_t)req;
+  COMMIT_SQE(sqe)
+  return true;
+}
+
+bool CIoUring::AddClose(int fd, CIoRequest *req)
+{
+  struct io_uring_sqe *sqe = GetSqe();
+  if (!sqe)
+    return false;
+  req->Res = 0;
+  req->Done = false;
+  sqe->opcode = IORING_OP_CLOSE;
+  sqe->fd = fd;
+  sqe->user_data = (UInt64)(size_t)req;
+  COMMIT_SQE(sqe)
+  return true;
+}
+
+bool CIoUring::Wait(CIoRequest *req)
+{
+  for (;;)
+  {
+    ReapCompletions();
+    if (req->Done)
+      return true;
+    if (!Enter(1))
+      return false;
+  }
+}
+
+
+// it can be changed by IoUring_Enable() and by IoUring_Get() in any thread
+static bool g_IoUring_Disabled = false;
+
+#define IS_IO_URING_DISABLED  __atomic_load_n(&g_IoUring_Disabled, __ATOMIC_ACQUIRE)
+#define SET_IO_URING_DISABLED(v)  __atomic_store_n(&g_IoUring_Disabled, (v), __ATOMIC_RELEASE)
+
+#ifdef _7ZIP_ST
+
+static CIoUring *g_IoUring = NULL;
+
+CIoUring *IoUring_Get()
+{
+  if (IS_IO_URING_DISABLED)
+    return NULL;
+  if (g_IoUring && g_IoUring->IsFailed())
+  {
+    // the files that still use failed engine keep references to it
+    g_IoUring->Release();
+    g_IoUring = NULL;
+  }
+  if (!g_IoUring)
+  {
+    CIoUring *ring = new CIoUring;
+    if (!ring->Create(kNumEntries))
+    {
+      delete ring;
+      SET_IO_URING_DISABLED(true);
+      return NULL;
+    }
+    g_IoUring = ring;
+  }
+  g_IoUring->AddRef();
+  return g_IoUring;
+}
+
+#else
+
+static pthread_key_t g_IoUring_Key;
+static pthread_once_t g_IoUring_Once = PTHREAD_ONCE_INIT;
+
+static void IoUring_Release(void *p)
+{
+  ((CIoUring *)p)->Release();
+}
+
+static void IoUring_CreateKey()
+{
+  if (pthread_key_create(&g_IoUring_Key, IoUring_Release) != 0)
+    SET_IO_URING_DISABLED(true);
+}
+
+CIoUring *IoUring_Get()
+{
+  pthread_once(&g_IoUring_Once, IoUring_CreateKey);
+  if (IS_IO_URING_DISABLED)
+    return NULL;
+  CIoUring *ring = (CIoUring *)pthread_getspecific(g_IoUring_Key);
+  if (!ring || ring->IsFailed())
+  {
+    CIoUring *prev = ring;
+    ring = new CIoUring;
+    if (!ring->Create(kNumEntries) || pthread_setspecific(g_IoUring_Key, ring) != 0)
+    {
+      delete ring;
+      // the kernel doesn't support io_uring, or it's not allowed for this process
+      SET_IO_URING_DISABLED(true);
+      return NULL;
+    }
+    // the files that still use failed engine keep references to it
+    if (prev)
+      prev->Release();
+  }
+  ring->AddRef();
+  return ring;
+}
+
+#endif
+
+void IoUring_Enable(bool enable)
+{
+  SET_IO_URING_DISABLED(!enable);
+}
+
+}}}
+
+#endif
@@ -0,0 +1,117 @@
+// Common/C_IoUring.h
+
+#ifndef __COMMON_C_IO_URING_H
+#define __COMMON_C_IO_URING_H
+
+#if defined(__linux__) && !defined(_7ZIP_NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+// we need IORING_OP_CLOSE and IORING_REGISTER_PROBE from Linux 5.6+ headers
+#ifdef IORING_FEAT_FAST_POLL
+#define USE_IO_URING
+#endif
+#endif
+#endif
+
+#ifdef USE_IO_URING
+
+#include <sys/uio.h>
+
+#ifndef _7ZIP_ST
+#include <pthread.h>
+#endif
+
+#include "MyTypes.h"
+
+namespace NC {
+namespace NFile {
+namespace NIO {
+
+/*
+  CIoUring is small io_uring engine over raw syscalls (no liburing).
+  There is one engine per thread. File objects submit requests with
+  explicit file offsets and wait for them later, so the kernel reads
+  and writes data while the coder works with previous data.
+  If the kernel doesn't support io_uring (ENOSYS, or it's disabled by
+  seccomp or sysctl), IoUring_Get() returns NULL, and file objects
+  use blocking read() / write().
+*/
+
+struct CIoRequest
+{
+  struct iovec Vec;
+  UInt64 Offset;
+  int Res;
+  bool Done;
+};
+
+class CIoUring
+{
+  int _fd;
+  unsigned *_sqHead;
+  unsigned *_sqTail;
+  unsigned _sqMask;
+  unsigned *_sqArray;
+  struct io_uring_sqe *_sqes;
+  unsigned *_cqHead;
+  unsigned *_cqTail;
+  unsigned _cqMask;
+  struct io_uring_cqe *_cqes;
+  void *_sqRing;
+  void *_cqRing;
+  size_t _sqRingSize;
+  size_t _cqRingSize;
+  size_t _sqesSize;
+  unsigned _sqEntries;
+  unsigned _cqEntries;
+  unsigned _numToSubmit;  // the number of sqes that were not submitted to kernel yet
+  unsigned _numInFlight;  // the number of submitted requests without completion
+  unsigned _numRefs;
+  bool _failed;
+  #ifndef _7ZIP_ST
+  pthread_mutex_t _cs;
+  #endif
+
+  struct io_uring_sqe *GetSqe();
+  bool Enter(unsigned minComplete);
+  void ReapCompletions();
+  void SetFailed();
+public:
+  bool CloseIsSupported;
+
+  CIoUring();
+  ~CIoUring();
+  bool Create(unsigned entries);
+
+  // file object keeps reference to engine, because the thread can exit before file is closed
+  void AddRef() { __atomic_add_fetch(&_numRefs, 1, __ATOMIC_RELAXED); }
+  void Release() { if (__atomic_sub_fetch(&_numRefs, 1, __ATOMIC_ACQ_REL) == 0) delete this; }
+
+  void Lock();
+  void Unlock();
+
+  /* if io_uring_enter() fails, the engine drops the requests that were not sent to kernel,
+     and it waits for completions of all requests that were sent to kernel.
+     So the buffer of request is not used by kernel after completion or after failure:
+     Wait() returns true for completed request, and it returns false for dropped request.
+     The owner must not free the buffer of request that was neither completed nor dropped.
+     IoUring_Get() replaces failed engine. */
+  bool IsFailed() const { return __atomic_load_n(&_failed, __ATOMIC_ACQUIRE); }
+
+  // these functions must be called between Lock() and Unlock()
+  bool AddReadV(int fd, CIoRequest *req, void *data, size_t size, UInt64 offset);
+  bool AddWriteV(int fd, CIoRequest *req, const void *data, size_t size, UInt64 offset, bool linkNext);
+  bool AddClose(int fd, CIoRequest *req);
+  bool Submit() { return _numToSubmit == 0 || Enter(0); }
+  bool Wait(CIoRequest *req);
+};
+
+// it returns engine for current thread with new reference, or NULL, if io_uring is not available
+CIoUring *IoUring_Get();
+void IoUring_Enable(bool enable);
+
+}}}
+
+#endif
+
+#endif
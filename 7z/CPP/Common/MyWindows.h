@@ -91,6 +91,11 @@ typedef LONG SCODE;
 #define E_OUTOFMEMORY ((HRESULT)0x8007000EL)
 #define E_INVALIDARG ((HRESULT)0x80070057L)
 
+#define FACILITY_WIN32 7
+#define HRESULT_FROM_WIN32(x) ((HRESULT)(x) <= 0 ? ((HRESULT)(x)) : ((HRESULT)(((x) & 0x0000FFFF) | (FACILITY_WIN32 << 16) | 0x80000000)))
+
+#define ERROR_NEGATIVE_SEEK 131L
+
 #ifdef _MSC_VER
 #define STDMETHODCALLTYPE __stdcall
 #else
@@ -103,6 +103,8 @@ public:
   CFileBase(): _handle(INVALID_HANDLE_VALUE) {};
   ~CFileBase() { Close(); }
 
+  HANDLE GetHandle() const { return _handle; }
+
   bool Close() throw();
 
   bool GetPosition(UInt64 &position) const throw();
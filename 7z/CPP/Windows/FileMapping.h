@@ -18,6 +18,12 @@ public:
     return ::GetLastError();
   }
 
+  WRes Create(HANDLE file, DWORD protect, UInt64 maxSize, LPCTSTR name)
+  {
+    _handle = ::CreateFileMapping(file, NULL, protect, (DWORD)(maxSize >> 32), (DWORD)maxSize, name);
+    return ::GetLastError();
+  }
+
   WRes Open(DWORD
       #ifndef UNDER_CE
       desiredAccess
@@ -5,6 +5,7 @@
 namespace
 {
 	constexpr auto DefaultLibraryPath = _T("7z.dll");
+	constexpr UINT32 DefaultThreadPoolSize = 32;
 }
 
 namespace SevenZip
@@ -32,6 +33,12 @@ namespace SevenZip
 				m_CreateObjectFunc = reinterpret_cast<CreateObjectFunc>(::GetProcAddress(m_LibraryHandle, "CreateObject"));
 				if (m_CreateObjectFunc)
 				{
+					// Older 7z.dll doesn't export it and doesn't keep idle threads
+					m_SetThreadPoolSizeFunc = reinterpret_cast<SetThreadPoolSizeFunc>(::GetProcAddress(m_LibraryHandle, "SetThreadPoolSize"));
+					if (m_SetThreadPoolSizeFunc)
+					{
+						m_SetThreadPoolSizeFunc(DefaultThreadPoolSize);
+					}
 					return true;
 				}
 			}
@@ -44,10 +51,16 @@ namespace SevenZip
 	{
 		if (m_LibraryHandle)
 		{
+			// 7z.dll can't join its idle threads in DllMain, so they must be stopped before unloading
+			if (m_SetThreadPoolSizeFunc)
+			{
+				m_SetThreadPoolSizeFunc(0);
+			}
 			::FreeLibrary(m_LibraryHandle);
 
 			m_LibraryHandle = nullptr;
 			m_CreateObjectFunc = nullptr;
+			m_SetThreadPoolSizeFunc = nullptr;
 		}
 	}
 	
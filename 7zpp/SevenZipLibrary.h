@@ -8,10 +8,12 @@ namespace SevenZip
 	{
 		private:
 			using CreateObjectFunc = UINT32(WINAPI*)(const GUID* classID, const GUID* interfaceID, void** outObject);
+			using SetThreadPoolSizeFunc = HRESULT(WINAPI*)(UINT32 numIdleThreads);
 
 		private:
 			HMODULE m_LibraryHandle = nullptr;
 			CreateObjectFunc m_CreateObjectFunc = nullptr;
+			SetThreadPoolSizeFunc m_SetThreadPoolSizeFunc = nullptr;
 
 		public:
 			Library();